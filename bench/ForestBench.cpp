@@ -0,0 +1,655 @@
+/**
+* @file ForestBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Microbenchmarks of the forest life rule: legacy array of BlockInfo loop against LifeGrid kernels, threads scaling,
+//memory and generation time of the chunked grid against the dense one on mostly blocked fields, cells evaluated while the forest settles,
+//hashlife fast forward against plain steps, cache misses of the array of structs field against the planes
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <boost/multi_array.hpp>
+
+#include "../src/Common/WorkerPool.h"
+#include "../src/Nature/LifeGrid.h"
+#include "../src/Nature/LifeHashlife.h"
+
+namespace
+{
+    //Copy of the EternalForest block layout before LifeGrid was introduced
+    struct LegacyBlockInfo
+    {
+        enum : uint8_t
+        {
+            EMPTY = 1,
+            BLOCKED = 2,
+            TREE = 4
+        };
+
+        void* treeNode = nullptr;
+        uint8_t flags = EMPTY;
+        float _height = 0.0f;
+    };
+    using LegacyField = boost::multi_array<LegacyBlockInfo, 2>;
+
+    void LegacyStep(std::unique_ptr<LegacyField> & fieldPtr, std::unique_ptr<LegacyField> & fieldNextPtr, std::vector<LifeChange> & changes)
+    {
+        LegacyField & field = *fieldPtr;
+        LegacyField & fieldNext = *fieldNextPtr;
+        changes.clear();
+        uint32_t height = static_cast<uint32_t>(field.shape()[0]);
+        uint32_t width = static_cast<uint32_t>(field.shape()[1]);
+        for (uint32_t z = 1; z < height - 1; ++z)
+        {
+            for (uint32_t x = 1; x < width - 1; ++x)
+            {
+                LegacyBlockInfo& current = field[z][x];
+                LegacyBlockInfo& next = fieldNext[z][x];
+                next = current;
+                if (0 == (current.flags & LegacyBlockInfo::BLOCKED))
+                {
+                    auto neighbors = {
+                        field[z - 1][x - 1].flags,
+                        field[z - 1][x].flags,
+                        field[z - 1][x + 1].flags,
+                        field[z][x - 1].flags,
+                        field[z][x + 1].flags,
+                        field[z + 1][x - 1].flags,
+                        field[z + 1][x].flags,
+                        field[z + 1][x + 1].flags
+                    };
+                    uint8_t sum = 0;
+                    std::for_each(std::cbegin(neighbors), std::cend(neighbors), [&sum](const uint8_t& flags)->void { if (flags & LegacyBlockInfo::TREE) ++sum; });
+                    if (current.flags & LegacyBlockInfo::TREE)
+                    {
+                        if (sum < 3 || sum > 4)
+                        {
+                            next.flags = LegacyBlockInfo::EMPTY;
+                            changes.push_back({ z * width + x, LifeChange::DIED });
+                        }
+                    }
+                    else if (sum >= 3 && sum <= 4)
+                    {
+                        next.flags = LegacyBlockInfo::TREE;
+                        changes.push_back({ z * width + x, LifeChange::BORN });
+                    }
+                }
+            }
+        }
+        fieldPtr.swap(fieldNextPtr);
+    }
+    //-------------------------------------------------------
+
+    /**
+     *	Copy of LifeGrid before the chunks: dense padded planes over the whole field
+     */
+    class DenseLifeGrid
+    {
+        static const size_t ROW_PADDING = LifeKernel::ROW_ALIGNMENT;
+
+        size_t mWidth;
+        size_t mHeight;
+        size_t mStride;
+        std::vector<uint8_t> mCells;
+        std::vector<uint8_t> mCellsNext;
+        std::vector<uint8_t> mFree;
+
+        size_t Offset(size_t x, size_t z) const
+        {
+            return (z + 1) * mStride + ROW_PADDING + x;
+        }
+
+    public:
+        DenseLifeGrid(size_t width, size_t height):
+            mWidth(width), mHeight(height)
+        {
+            size_t alignedWidth = (width + LifeKernel::ROW_ALIGNMENT - 1) / LifeKernel::ROW_ALIGNMENT * LifeKernel::ROW_ALIGNMENT;
+            mStride = ROW_PADDING + alignedWidth + ROW_PADDING;
+            size_t size = (height + 2) * mStride;
+            mCells.assign(size, 0);
+            mCellsNext.assign(size, 0);
+            mFree.assign(size, 0);
+        }
+
+        void Set(size_t x, size_t z, bool free, bool alive)
+        {
+            mFree[Offset(x, z)] = free ? 0xFF : 0x00;
+            mCells[Offset(x, z)] = (free && alive) ? 1 : 0;
+        }
+
+        void Step(std::vector<LifeChange> & changes)
+        {
+            changes.clear();
+            for (size_t z = 0; z < mHeight; ++z)
+            {
+                const uint8_t* row = &mCells[Offset(0, z)];
+                uint8_t* next = &mCellsNext[Offset(0, z)];
+                LifeKernel::StepRow(row - mStride, row, row + mStride, &mFree[Offset(0, z)], next, mWidth);
+                LifeKernel::CollectChanges(row, next, mWidth, static_cast<uint32_t>(z * mWidth), changes);
+            }
+            std::swap(mCells, mCellsNext);
+        }
+
+        size_t GetMemorySize() const
+        {
+            return mCells.size() + mCellsNext.size() + mFree.size();
+        }
+    };
+
+    //tree handle and height of every cell kept by EternalForest with the dense grid
+    const size_t BLOCK_INFO_SIZE = 8;
+    //tree handle of every cell of the allocated chunks kept by EternalForest, heights are a plane of LifeGrid
+    const size_t TREE_HANDLE_SIZE = 4;
+    //-------------------------------------------------------
+
+    struct Scene
+    {
+        size_t size;
+        std::vector<uint8_t> flags;
+    };
+
+    Scene MakeScene(size_t size, float density, float blockedRatio, uint32_t seed)
+    {
+        Scene scene;
+        scene.size = size;
+        scene.flags.resize(size * size);
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (size_t z = 0; z < size; ++z)
+        {
+            for (size_t x = 0; x < size; ++x)
+            {
+                uint8_t flags = LegacyBlockInfo::EMPTY;
+                if (z == 0 || z == size - 1 || x == 0 || x == size - 1 || unit(rng) < blockedRatio)
+                {
+                    flags = LegacyBlockInfo::BLOCKED;
+                }
+                else if (unit(rng) < density)
+                {
+                    flags = LegacyBlockInfo::TREE;
+                }
+                scene.flags[z * size + x] = flags;
+            }
+        }
+        return scene;
+    }
+
+    /**
+     *	Blocked field with round free islands
+     *  @param freeRatio - part of the field covered by the islands
+     */
+    Scene MakeIslandsScene(size_t size, float density, float freeRatio, uint32_t seed)
+    {
+        const float RADIUS = 100.0f;
+        Scene scene;
+        scene.size = size;
+        scene.flags.assign(size * size, LegacyBlockInfo::BLOCKED);
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        size_t islands = static_cast<size_t>(freeRatio * size * size / (3.14159f * RADIUS * RADIUS)) + 1;
+        for (size_t i = 0; i < islands; ++i)
+        {
+            float cx = RADIUS + unit(rng) * (size - 2.0f * RADIUS);
+            float cz = RADIUS + unit(rng) * (size - 2.0f * RADIUS);
+            for (size_t z = static_cast<size_t>(cz - RADIUS); z < static_cast<size_t>(cz + RADIUS); ++z)
+            {
+                for (size_t x = static_cast<size_t>(cx - RADIUS); x < static_cast<size_t>(cx + RADIUS); ++x)
+                {
+                    float dx = x - cx;
+                    float dz = z - cz;
+                    if (dx * dx + dz * dz < RADIUS * RADIUS)
+                    {
+                        scene.flags[z * size + x] = (unit(rng) < density) ? LegacyBlockInfo::TREE : LegacyBlockInfo::EMPTY;
+                    }
+                }
+            }
+        }
+        return scene;
+    }
+
+    std::unique_ptr<LifeGrid> MakeGrid(const Scene & scene)
+    {
+        auto grid = std::make_unique<LifeGrid>(scene.size, scene.size);
+        for (size_t i = 0; i < scene.flags.size(); ++i)
+        {
+            grid->SetFree(i % scene.size, i / scene.size, LegacyBlockInfo::BLOCKED != scene.flags[i]);
+            grid->SetAlive(i % scene.size, i / scene.size, LegacyBlockInfo::TREE == scene.flags[i]);
+        }
+        return grid;
+    }
+
+    template <typename Func>
+    double MeasureMs(size_t repeats, Func && func)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < repeats; ++i)
+        {
+            func();
+        }
+        auto stop = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count() / repeats;
+    }
+
+    void Report(const char* name, size_t size, double ms, double baselineMs, size_t changes)
+    {
+        double nsPerCell = ms * 1.0e6 / (size * size);
+        std::printf("  %-10s %9.3f ms/gen %8.3f ns/cell  x%6.2f  (%zu changes in last gen)\n", name, ms, nsPerCell, baselineMs / ms, changes);
+    }
+
+    /**
+     *	Hardware event counter of the calling thread, unavailable without perf events support (e.g. in virtual machines)
+     */
+    class PerfCounter
+    {
+        int mFd = -1;
+
+        PerfCounter(const PerfCounter&) = delete;
+        PerfCounter& operator=(const PerfCounter&) = delete;
+
+    public:
+        PerfCounter(uint32_t type, uint64_t config)
+        {
+#ifdef __linux__
+            perf_event_attr attr = {};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            mFd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+
+        ~PerfCounter()
+        {
+#ifdef __linux__
+            if (mFd >= 0)
+            {
+                close(mFd);
+            }
+#endif
+        }
+
+        bool IsAvailable() const
+        {
+            return mFd >= 0;
+        }
+
+        void Start()
+        {
+#ifdef __linux__
+            if (mFd >= 0)
+            {
+                ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+
+        uint64_t Stop()
+        {
+            uint64_t count = 0;
+#ifdef __linux__
+            if (mFd >= 0)
+            {
+                ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+                if (sizeof(count) != read(mFd, &count, sizeof(count)))
+                {
+                    count = 0;
+                }
+            }
+#endif
+            return count;
+        }
+    };
+
+    bool SameCells(const LifeGrid & lhs, const LifeGrid & rhs)
+    {
+        for (size_t z = 0; z < lhs.GetHeight(); ++z)
+        {
+            for (size_t x = 0; x < lhs.GetWidth(); ++x)
+            {
+                if (lhs.IsAlive(x, z) != rhs.IsAlive(x, z))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool SameChanges(const std::vector<LifeChange> & lhs, const std::vector<LifeChange> & rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.cbegin(), lhs.cend(), rhs.cbegin(),
+            [](const LifeChange & a, const LifeChange & b) { return a.cell == b.cell && a.type == b.type; });
+    }
+}
+
+void BenchKernels()
+{
+    const size_t GENERATIONS = 8;
+
+    std::printf("Kernels, best ISA: %s\n", LifeKernel::GetIsaName(LifeKernel::GetBestIsa()));
+    for (size_t size : { 1024, 4096 })
+    {
+        Scene scene = MakeScene(size, 0.3f, 0.1f, 42);
+        std::printf("Field %zux%zu, %zu generations\n", size, size, GENERATIONS);
+
+        std::vector<LifeChange> legacyChanges;
+        double legacyMs = 0.0;
+        {
+            auto field = std::make_unique<LegacyField>(boost::extents[size][size]);
+            auto fieldNext = std::make_unique<LegacyField>(boost::extents[size][size]);
+            for (size_t i = 0; i < scene.flags.size(); ++i)
+            {
+                (*field)[i / size][i % size].flags = scene.flags[i];
+            }
+            legacyMs = MeasureMs(GENERATIONS, [&]() { LegacyStep(field, fieldNext, legacyChanges); });
+            Report("legacy", size, legacyMs, legacyMs, legacyChanges.size());
+        }
+
+        for (LifeKernel::Isa isa : { LifeKernel::ISA_SCALAR, LifeKernel::ISA_SSE2, LifeKernel::ISA_AVX2 })
+        {
+            if (isa > LifeKernel::GetBestIsa())
+            {
+                continue;
+            }
+            LifeKernel::SetIsa(isa);
+
+            std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+            std::vector<LifeChange> changes;
+            double ms = MeasureMs(GENERATIONS, [&]() { grid->Step(changes); });
+            Report(LifeKernel::GetIsaName(isa), size, ms, legacyMs, changes.size());
+            if (!SameChanges(changes, legacyChanges))
+            {
+                std::printf("  ERROR: %s result differs from the legacy loop\n", LifeKernel::GetIsaName(isa));
+                std::exit(1);
+            }
+        }
+        LifeKernel::SetIsa(LifeKernel::GetBestIsa());
+    }
+}
+//-------------------------------------------------------
+
+void BenchThreads(size_t maxThreads)
+{
+    const size_t GENERATIONS = 8;
+    const size_t SIZE = 4096;
+
+    Scene scene = MakeScene(SIZE, 0.3f, 0.1f, 7);
+    std::printf("Threads scaling, field %zux%zu, %zu generations, %s\n", SIZE, SIZE, GENERATIONS, LifeKernel::GetIsaName(LifeKernel::GetIsa()));
+
+    std::vector<LifeChange> referenceChanges;
+    double referenceMs = 0.0;
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        WorkerPool pool(threads);
+        std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+        std::vector<LifeChange> changes;
+        double ms = MeasureMs(GENERATIONS, [&]() { grid->Step(changes, &pool); });
+        if (1 == threads)
+        {
+            referenceMs = ms;
+            referenceChanges = changes;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%zu thr", threads);
+        Report(name, SIZE, ms, referenceMs, changes.size());
+        if (!SameChanges(changes, referenceChanges))
+        {
+            std::printf("  ERROR: %zu threads result differs from the single thread one\n", threads);
+            std::exit(1);
+        }
+    }
+}
+//-------------------------------------------------------
+
+void BenchSparse()
+{
+    const size_t GENERATIONS = 8;
+
+    std::printf("Chunked grid against the dense one, 5%% of free cells in islands\n");
+    std::printf("  %8s %12s %12s %10s %10s %10s\n", "size", "dense MB", "chunked MB", "chunks", "dense ms", "chunked ms");
+    for (size_t size : { 2048, 8192 })
+    {
+        Scene scene = MakeIslandsScene(size, 0.3f, 0.05f, 11);
+
+        std::vector<LifeChange> denseChanges;
+        DenseLifeGrid dense(size, size);
+        for (size_t i = 0; i < scene.flags.size(); ++i)
+        {
+            dense.Set(i % size, i / size, LegacyBlockInfo::BLOCKED != scene.flags[i], LegacyBlockInfo::TREE == scene.flags[i]);
+        }
+        double denseMs = MeasureMs(GENERATIONS, [&]() { dense.Step(denseChanges); });
+        size_t denseBytes = dense.GetMemorySize() + size * size * BLOCK_INFO_SIZE;
+
+        std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+        std::vector<LifeChange> changes;
+        double ms = MeasureMs(GENERATIONS, [&]() { grid->Step(changes); });
+        size_t chunkedBytes = grid->GetMemorySize() + grid->GetAllocatedChunksNumber() * LifeGrid::CHUNK_SIZE * LifeGrid::CHUNK_SIZE * TREE_HANDLE_SIZE;
+
+        char chunks[32];
+        std::snprintf(chunks, sizeof(chunks), "%zu/%zu", grid->GetAllocatedChunksNumber(), grid->GetChunksNumber());
+        std::printf("  %8zu %12.1f %12.1f %10s %10.3f %10.3f\n", size, denseBytes / (1024.0 * 1024.0), chunkedBytes / (1024.0 * 1024.0), chunks, denseMs, ms);
+        if (!SameChanges(changes, denseChanges))
+        {
+            std::printf("  ERROR: chunked grid result differs from the dense one\n");
+            std::exit(1);
+        }
+    }
+}
+//-------------------------------------------------------
+
+void BenchActivity()
+{
+    const size_t SIZE = 4096;
+    const size_t GENERATIONS = 256;
+    const size_t PATCHES = 16;
+    const size_t PATCH_SIZE = 32;
+
+    //still 2x2 groups of trees everywhere, random trees only in a few patches
+    Scene scene = MakeIslandsScene(SIZE, 0.0f, 0.25f, 5);
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (size_t i = 0; i < scene.flags.size(); ++i)
+    {
+        if (LegacyBlockInfo::BLOCKED != scene.flags[i] && (i % SIZE) % 4 < 2 && (i / SIZE) % 4 < 2)
+        {
+            scene.flags[i] = LegacyBlockInfo::TREE;
+        }
+    }
+    for (size_t patch = 0; patch < PATCHES; ++patch)
+    {
+        size_t px = static_cast<size_t>(unit(rng) * (SIZE - PATCH_SIZE));
+        size_t pz = static_cast<size_t>(unit(rng) * (SIZE - PATCH_SIZE));
+        for (size_t z = pz; z < pz + PATCH_SIZE; ++z)
+        {
+            for (size_t x = px; x < px + PATCH_SIZE; ++x)
+            {
+                uint8_t & flags = scene.flags[z * SIZE + x];
+                if (LegacyBlockInfo::BLOCKED != flags)
+                {
+                    flags = (unit(rng) < 0.3f) ? LegacyBlockInfo::TREE : LegacyBlockInfo::EMPTY;
+                }
+            }
+        }
+    }
+
+    std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+    DenseLifeGrid dense(SIZE, SIZE);
+    for (size_t i = 0; i < scene.flags.size(); ++i)
+    {
+        dense.Set(i % SIZE, i / SIZE, LegacyBlockInfo::BLOCKED != scene.flags[i], LegacyBlockInfo::TREE == scene.flags[i]);
+    }
+
+    std::printf("Settling forest, field %zux%zu, 25%% of free cells in islands, %zu active patches\n", SIZE, SIZE, PATCHES);
+    std::printf("  %8s %12s %10s %10s %10s\n", "gen", "evaluated", "changes", "dense ms", "chunked ms");
+    std::vector<LifeChange> changes;
+    std::vector<LifeChange> denseChanges;
+    for (size_t generation = 1; generation <= GENERATIONS; ++generation)
+    {
+        double denseMs = MeasureMs(1, [&]() { dense.Step(denseChanges); });
+        double ms = MeasureMs(1, [&]() { grid->Step(changes); });
+        if (!SameChanges(changes, denseChanges))
+        {
+            std::printf("  ERROR: generation %zu differs from the dense grid\n", generation);
+            std::exit(1);
+        }
+        if (0 == (generation & (generation - 1)))
+        {
+            std::printf("  %8zu %12zu %10zu %10.3f %10.3f\n", generation, grid->GetEvaluatedCellsNumber(), changes.size(), denseMs, ms);
+        }
+    }
+}
+//-------------------------------------------------------
+
+void BenchLayout()
+{
+    const size_t SIZE = 4096;
+    const size_t GENERATIONS = 8;
+
+#ifdef __linux__
+    PerfCounter l1Misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    PerfCounter llcMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#else
+    PerfCounter l1Misses(0, 0);
+    PerfCounter llcMisses(0, 0);
+#endif
+
+    Scene scene = MakeScene(SIZE, 0.3f, 0.1f, 3);
+    std::printf("Field layout, %zux%zu, %zu generations, cache misses are %s\n", SIZE, SIZE, GENERATIONS,
+        (l1Misses.IsAvailable() && llcMisses.IsAvailable()) ? "per cell and generation" : "not available");
+    std::printf("  %-18s %10s %10s %12s %12s %14s\n", "layout", "ms/gen", "Mcells/s", "bytes/cell", "L1D misses", "LLC misses");
+
+    //bytes of the field planes streamed through the cache per cell: read current state, write next one
+    auto report = [&](const char* name, double ms, size_t bytesPerCell, uint64_t l1, uint64_t llc)
+    {
+        const double cells = static_cast<double>(SIZE) * SIZE;
+        char l1Text[32] = "n/a";
+        char llcText[32] = "n/a";
+        if (l1Misses.IsAvailable() && llcMisses.IsAvailable())
+        {
+            std::snprintf(l1Text, sizeof(l1Text), "%.4f", l1 / (cells * GENERATIONS));
+            std::snprintf(llcText, sizeof(llcText), "%.4f", llc / (cells * GENERATIONS));
+        }
+        std::printf("  %-18s %10.3f %10.1f %12zu %12s %14s\n", name, ms, cells / (ms * 1.0e3), bytesPerCell, l1Text, llcText);
+    };
+
+    std::vector<LifeChange> legacyChanges;
+    {
+        auto field = std::make_unique<LegacyField>(boost::extents[SIZE][SIZE]);
+        auto fieldNext = std::make_unique<LegacyField>(boost::extents[SIZE][SIZE]);
+        for (size_t i = 0; i < scene.flags.size(); ++i)
+        {
+            (*field)[i / SIZE][i % SIZE].flags = scene.flags[i];
+        }
+        LegacyStep(field, fieldNext, legacyChanges);
+        l1Misses.Start();
+        llcMisses.Start();
+        double ms = MeasureMs(GENERATIONS, [&]() { LegacyStep(field, fieldNext, legacyChanges); });
+        uint64_t llc = llcMisses.Stop();
+        uint64_t l1 = l1Misses.Stop();
+        report("array of structs", ms, 2 * sizeof(LegacyBlockInfo), l1, llc);
+    }
+
+    for (LifeKernel::Isa isa : { LifeKernel::ISA_SCALAR, LifeKernel::GetBestIsa() })
+    {
+        LifeKernel::SetIsa(isa);
+        std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+        std::vector<LifeChange> changes;
+        grid->Step(changes);
+        l1Misses.Start();
+        llcMisses.Start();
+        double ms = MeasureMs(GENERATIONS, [&]() { grid->Step(changes); });
+        uint64_t llc = llcMisses.Stop();
+        uint64_t l1 = l1Misses.Stop();
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "planes %s", LifeKernel::GetIsaName(isa));
+        //alive and free planes are read, next alive plane is written, heights are not touched
+        report(name, ms, 3 * sizeof(uint8_t), l1, llc);
+        if (!SameChanges(changes, legacyChanges))
+        {
+            std::printf("  ERROR: planes result differs from the array of structs\n");
+            std::exit(1);
+        }
+    }
+    LifeKernel::SetIsa(LifeKernel::GetBestIsa());
+}
+//-------------------------------------------------------
+
+void BenchFastForward()
+{
+    const size_t SIZE = 1024;
+
+    std::printf("Fast forward against plain steps, field %zux%zu\n", SIZE, SIZE);
+    std::printf("  %-10s %8s %10s %12s %10s %10s\n", "scene", "gens", "steps ms", "hashlife ms", "nodes", "changes");
+    //sparse trees on islands freeze quickly, dense ones keep changing, a noisy free mask doesn't repeat at all
+    const char* names[] = { "settling", "chaotic", "noisy" };
+    for (size_t kind = 0; kind < 3; ++kind)
+    {
+        const char* name = names[kind];
+        Scene scene = (2 == kind) ? MakeScene(SIZE, 0.05f, 0.1f, 21) : MakeIslandsScene(SIZE, (0 == kind) ? 0.05f : 0.3f, 0.3f, 21);
+        for (size_t generations : { 64, 1024 })
+        {
+            std::unique_ptr<LifeGrid> stepped = MakeGrid(scene);
+            std::vector<LifeChange> changes;
+            double stepsMs = MeasureMs(1, [&]() {
+                for (size_t i = 0; i < generations; ++i)
+                {
+                    stepped->Step(changes);
+                }
+            });
+
+            std::unique_ptr<LifeGrid> grid = MakeGrid(scene);
+            LifeHashlife hashlife;
+            double ms = MeasureMs(1, [&]() { hashlife.Advance(*grid, generations, changes); });
+            std::printf("  %-10s %8zu %10.3f %12.3f %10zu %10zu\n", name, generations, stepsMs, ms, hashlife.GetNodesNumber(), changes.size());
+            if (!SameCells(*grid, *stepped))
+            {
+                std::printf("  ERROR: fast forward result differs from the plain steps\n");
+                std::exit(1);
+            }
+        }
+    }
+}
+//-------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    size_t maxThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (argc > 1)
+    {
+        maxThreads = std::max(1, std::atoi(argv[1]));
+    }
+
+    BenchKernels();
+    BenchThreads(maxThreads);
+    BenchSparse();
+    BenchActivity();
+    BenchLayout();
+    BenchFastForward();
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+* @file ForestRenderBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Forest rendering benchmark: batches and CPU frame time of per-node and instanced trees.
+//Renders into a hidden window, no input or interaction is required.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include <OgreRoot.h>
+#include <OgreConfigFile.h>
+#include <OgreRenderWindow.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreCamera.h>
+#include <OgreViewport.h>
+
+#include "../src/Nature/TreePool.h"
+
+namespace
+{
+    void SetupResources(const Ogre::String & resourcesCfg)
+    {
+        Ogre::ConfigFile cf;
+        cf.load(resourcesCfg);
+        Ogre::ConfigFile::SectionIterator seci = cf.getSectionIterator();
+        while (seci.hasMoreElements())
+        {
+            Ogre::String secName = seci.peekNextKey();
+            Ogre::ConfigFile::SettingsMultiMap *settings = seci.getNext();
+            for (auto i = settings->begin(); i != settings->end(); ++i)
+            {
+                Ogre::ResourceGroupManager::getSingleton().addResourceLocation(i->second, i->first, secName);
+            }
+        }
+    }
+
+    const char* ModeName(TreePool::Mode mode)
+    {
+        return (TreePool::MODE_INSTANCED == mode) ? "instanced" : "nodes";
+    }
+}
+
+int main()
+{
+    const size_t WARMUP_FRAMES = 5;
+    const size_t FRAMES = 50;
+
+#ifdef NDEBUG
+    Ogre::Root root(DATA_DIR"/plugins.cfg", "", "ForestRenderBench.log");
+#else
+    Ogre::Root root(DATA_DIR"/plugins_d.cfg", "", "ForestRenderBench.log");
+#endif
+    SetupResources(DATA_DIR"/resources.cfg");
+
+    if (root.getAvailableRenderers().empty())
+    {
+        std::printf("No render systems available\n");
+        return 1;
+    }
+    root.setRenderSystem(root.getAvailableRenderers().front());
+    root.initialise(false);
+
+    Ogre::NameValuePairList windowParams;
+    windowParams["hidden"] = "true";
+    windowParams["vsync"] = "false";
+    Ogre::RenderWindow* window = root.createRenderWindow("ForestRenderBench", 640, 480, false, &windowParams);
+
+    Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
+
+    Ogre::SceneManager* sceneManager = root.createSceneManager(Ogre::ST_GENERIC);
+    Ogre::Camera* camera = sceneManager->createCamera("BenchCam");
+    camera->setNearClipDistance(0.1f);
+    camera->setFarClipDistance(5000.0f);
+    window->addViewport(camera);
+
+    const Ogre::Vector3 treeScale(0.0005f, 0.0005f, 0.0005f);
+
+    std::printf("%10s %10s %10s %12s %14s\n", "trees", "mode", "batches", "triangles", "cpu ms/frame");
+    for (size_t trees : { 10000, 100000 })
+    {
+        size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(trees))));
+        camera->setPosition(Ogre::Vector3(0.0f, 0.75f * side, 0.75f * side));
+        camera->lookAt(Ogre::Vector3::ZERO);
+
+        for (TreePool::Mode mode : { TreePool::MODE_NODES, TreePool::MODE_INSTANCED })
+        {
+            TreePool pool(sceneManager, "tree_1.mesh", treeScale, sceneManager->getRootSceneNode(), trees, mode);
+            if (pool.GetMode() != mode)
+            {
+                std::printf("%10zu %10s %s\n", trees, ModeName(mode), "not supported");
+                continue;
+            }
+            for (size_t i = 0; i < trees; ++i)
+            {
+                float x = static_cast<float>(i % side) - 0.5f * side;
+                float z = static_cast<float>(i / side) - 0.5f * side;
+                pool.Acquire(Ogre::Vector3(x, 0.0f, z));
+            }
+
+            for (size_t i = 0; i < WARMUP_FRAMES; ++i)
+            {
+                root.renderOneFrame();
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < FRAMES; ++i)
+            {
+                root.renderOneFrame();
+            }
+            auto stop = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(stop - start).count() / FRAMES;
+
+            std::printf("%10zu %10s %10zu %12zu %14.3f\n", trees, ModeName(mode), window->getBatchCount(), window->getTriangleCount(), ms);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,355 @@
+/**
+* @file ForestSimBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Forest simulation benchmark without a scene: field init and update ticks as EternalForest runs them,
+//over field sizes, start densities and blocked cells ratios. Reports ns per cell, generations per second and heap allocations per tick,
+//optionally writes the results as JSON to track regressions.
+//Usage: ForestSimBench [--sizes 1024,4096] [--densities 0.05,0.3] [--blocked 0.1,0.5] [--ticks 32] [--threads N] [--quota N] [--json file]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/Common/WorkerPool.h"
+#include "../src/Nature/ForestSimulation.h"
+#include "../src/Nature/LifeGrid.h"
+
+namespace
+{
+    std::atomic<size_t> gAllocations(0);
+
+    void* CountedAllocate(size_t size)
+    {
+        gAllocations.fetch_add(1, std::memory_order_relaxed);
+        void* ptr = std::malloc(size > 0 ? size : 1);
+        if (nullptr == ptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+}
+
+//every heap allocation of the process is counted, arrays included
+void* operator new(size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    struct Options
+    {
+        std::vector<size_t> sizes = { 1024, 4096 };
+        std::vector<float> densities = { 0.05f, 0.3f };
+        std::vector<float> blockedRatios = { 0.1f, 0.5f };
+        size_t ticks = 32;
+        size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        //0 means no population limit
+        size_t quota = 0;
+        std::string jsonPath;
+    };
+
+    struct Result
+    {
+        size_t size;
+        float density;
+        float blockedRatio;
+        size_t freeCells;
+        double initMs;
+        double tickMs;
+        double allocationsPerTick;
+        double evaluatedCellsPerTick;
+        double changesPerTick;
+        size_t alive;
+        size_t memoryBytes;
+    };
+
+    template <typename Type>
+    std::vector<Type> ParseList(const char* text, Type (*parse)(const char*))
+    {
+        std::vector<Type> values;
+        std::string list(text);
+        size_t begin = 0;
+        while (begin <= list.size())
+        {
+            size_t end = std::min(list.find(',', begin), list.size());
+            if (end > begin)
+            {
+                values.push_back(parse(list.substr(begin, end - begin).c_str()));
+            }
+            begin = end + 1;
+        }
+        return values;
+    }
+
+    size_t ParseSize(const char* text)
+    {
+        return static_cast<size_t>(std::strtoull(text, nullptr, 10));
+    }
+
+    float ParseFloat(const char* text)
+    {
+        return std::strtof(text, nullptr);
+    }
+
+    bool ParseOptions(int argc, char** argv, Options & options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const char* name = argv[i];
+            const char* value = argv[i + 1];
+            if (0 == std::strcmp(name, "--sizes"))
+            {
+                options.sizes = ParseList(value, ParseSize);
+            }
+            else if (0 == std::strcmp(name, "--densities"))
+            {
+                options.densities = ParseList(value, ParseFloat);
+            }
+            else if (0 == std::strcmp(name, "--blocked"))
+            {
+                options.blockedRatios = ParseList(value, ParseFloat);
+            }
+            else if (0 == std::strcmp(name, "--ticks"))
+            {
+                options.ticks = std::max<size_t>(1, ParseSize(value));
+            }
+            else if (0 == std::strcmp(name, "--threads"))
+            {
+                options.threads = std::max<size_t>(1, ParseSize(value));
+            }
+            else if (0 == std::strcmp(name, "--quota"))
+            {
+                options.quota = ParseSize(value);
+            }
+            else if (0 == std::strcmp(name, "--json"))
+            {
+                options.jsonPath = value;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return 0 == (argc - 1) % 2;
+    }
+
+    float Lattice(int32_t x, int32_t z, uint32_t seed)
+    {
+        uint32_t h = static_cast<uint32_t>(x) * 0x8DA6B343u ^ static_cast<uint32_t>(z) * 0xD8163841u ^ seed * 0xCB1AB31Fu;
+        h ^= h >> 13;
+        h *= 0x5BD1E995u;
+        h ^= h >> 15;
+        return (h & 0xFFFFFF) / static_cast<float>(0x1000000);
+    }
+
+    /**
+     *	Smooth heights of a terrain-like field: few octaves of value noise
+     */
+    std::vector<float> MakeTerrain(size_t size, uint32_t seed)
+    {
+        std::vector<float> heights(size * size, 0.0f);
+        float amplitude = 1.0f;
+        for (size_t period = 256; period >= 16; period /= 4, amplitude *= 0.35f)
+        {
+            for (size_t z = 0; z < size; ++z)
+            {
+                const int32_t cz = static_cast<int32_t>(z / period);
+                const float tz = static_cast<float>(z % period) / period;
+                for (size_t x = 0; x < size; ++x)
+                {
+                    const int32_t cx = static_cast<int32_t>(x / period);
+                    const float tx = static_cast<float>(x % period) / period;
+                    const float top = Lattice(cx, cz, seed) + (Lattice(cx + 1, cz, seed) - Lattice(cx, cz, seed)) * tx;
+                    const float bottom = Lattice(cx, cz + 1, seed) + (Lattice(cx + 1, cz + 1, seed) - Lattice(cx, cz + 1, seed)) * tx;
+                    heights[z * size + x] += amplitude * (top + (bottom - top) * tz);
+                }
+            }
+        }
+        return heights;
+    }
+
+    Result Run(size_t size, float density, float blockedRatio, const Options & options, WorkerPool & pool)
+    {
+        Result result = {};
+        result.size = size;
+        result.density = density;
+        result.blockedRatio = blockedRatio;
+
+        //the lowest part of the terrain is free, so the blocked cells form hills
+        std::vector<float> heights = MakeTerrain(size, static_cast<uint32_t>(size));
+        std::vector<float> sorted(heights);
+        const size_t freeCount = std::min(sorted.size() - 1, static_cast<size_t>((1.0f - blockedRatio) * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + freeCount, sorted.end());
+        const float maxHeight = sorted[freeCount];
+        sorted = std::vector<float>();
+
+        ForestSimulation::HeightsSource source = [&heights, size](float x0, float z0, float dx, float dz, size_t countX, size_t countZ, float* output)
+        {
+            for (size_t j = 0; j < countZ; ++j)
+            {
+                const size_t z = std::min(static_cast<size_t>(z0 + j * dz), size - 1);
+                for (size_t i = 0; i < countX; ++i)
+                {
+                    const size_t x = std::min(static_cast<size_t>(x0 + i * dx), size - 1);
+                    output[j * countX + i] = heights[z * size + x];
+                }
+            }
+        };
+
+        const float extent = static_cast<float>(size);
+        ForestSimulation simulation(0.0f, 0.0f, extent, extent, -1.0f, maxHeight - 1.0e-6f, 1.0f, 7);
+        simulation.SetTreesQuota((0 != options.quota) ? options.quota : size * size);
+        std::vector<LifeChange> changes;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        //planting attempts are made with the start density over the whole field, attempts in the blocked cells are retried
+        simulation.Init(source, static_cast<size_t>(density * (1.0f - blockedRatio) * size * size));
+        simulation.TakeChanges(0, changes);
+        auto stop = std::chrono::high_resolution_clock::now();
+        result.initMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        for (size_t z = 0; z < size; ++z)
+        {
+            for (size_t x = 0; x < size; ++x)
+            {
+                result.freeCells += simulation.GetField().IsFree(x, z) ? 1 : 0;
+            }
+        }
+
+        size_t evaluated = 0;
+        size_t changesCount = 0;
+        const size_t allocationsBefore = gAllocations.load();
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t tick = 0; tick < options.ticks; ++tick)
+        {
+            //the same work as EternalForest::Update without the scene: compute the generation, take the changes for the view
+            changes.clear();
+            simulation.Tick(&pool);
+            changesCount += simulation.TakeChanges(0, changes);
+            evaluated += simulation.GetEvaluatedCellsNumber();
+        }
+        stop = std::chrono::high_resolution_clock::now();
+        const size_t allocations = gAllocations.load() - allocationsBefore;
+
+        result.tickMs = std::chrono::duration<double, std::milli>(stop - start).count() / options.ticks;
+        result.allocationsPerTick = static_cast<double>(allocations) / options.ticks;
+        result.evaluatedCellsPerTick = static_cast<double>(evaluated) / options.ticks;
+        result.changesPerTick = static_cast<double>(changesCount) / options.ticks;
+        result.alive = simulation.GetField().GetAliveCount();
+        result.memoryBytes = simulation.GetField().GetMemorySize();
+        return result;
+    }
+
+    bool WriteJson(const std::string & path, const Options & options, size_t threads, const std::vector<Result> & results)
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (nullptr == file)
+        {
+            return false;
+        }
+        std::fprintf(file, "{\n");
+        std::fprintf(file, "  \"benchmark\": \"ForestSimBench\",\n");
+        std::fprintf(file, "  \"isa\": \"%s\",\n", LifeKernel::GetIsaName(LifeKernel::GetIsa()));
+        std::fprintf(file, "  \"threads\": %zu,\n", threads);
+        std::fprintf(file, "  \"ticks\": %zu,\n", options.ticks);
+        std::fprintf(file, "  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result & r = results[i];
+            const double cells = static_cast<double>(r.size) * r.size;
+            std::fprintf(file, "    {\"size\": %zu, \"density\": %.4f, \"blocked\": %.4f, \"free_cells\": %zu, "
+                "\"init_ms\": %.4f, \"init_ns_per_cell\": %.4f, \"tick_ms\": %.4f, \"ns_per_cell\": %.4f, \"generations_per_second\": %.4f, "
+                "\"allocations_per_tick\": %.4f, \"evaluated_cells_per_tick\": %.1f, \"changes_per_tick\": %.1f, \"alive\": %zu, \"memory_bytes\": %zu}%s\n",
+                r.size, r.density, r.blockedRatio, r.freeCells,
+                r.initMs, r.initMs * 1.0e6 / cells, r.tickMs, r.tickMs * 1.0e6 / cells, 1000.0 / r.tickMs,
+                r.allocationsPerTick, r.evaluatedCellsPerTick, r.changesPerTick, r.alive, r.memoryBytes,
+                (i + 1 < results.size()) ? "," : "");
+        }
+        std::fprintf(file, "  ]\n");
+        std::fprintf(file, "}\n");
+        return 0 == std::fclose(file);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::printf("Usage: ForestSimBench [--sizes 1024,4096] [--densities 0.05,0.3] [--blocked 0.1,0.5] [--ticks 32] [--threads N] [--quota N] [--json file]\n");
+        return 1;
+    }
+
+    WorkerPool pool(options.threads);
+    std::printf("Forest simulation, %zu ticks, %zu threads, %s\n", options.ticks, pool.GetThreadsNumber(), LifeKernel::GetIsaName(LifeKernel::GetIsa()));
+    std::printf("  %6s %8s %8s %10s %10s %10s %12s %10s %12s %10s\n", "size", "density", "blocked", "init ms", "tick ms", "ns/cell", "gens/s", "allocs", "evaluated", "alive");
+
+    std::vector<Result> results;
+    for (size_t size : options.sizes)
+    {
+        for (float density : options.densities)
+        {
+            for (float blockedRatio : options.blockedRatios)
+            {
+                Result r = Run(size, density, blockedRatio, options, pool);
+                std::printf("  %6zu %8.3f %8.3f %10.3f %10.3f %10.3f %12.1f %10.1f %12.0f %10zu\n", r.size, r.density, r.blockedRatio,
+                    r.initMs, r.tickMs, r.tickMs * 1.0e6 / (static_cast<double>(r.size) * r.size), 1000.0 / r.tickMs, r.allocationsPerTick, r.evaluatedCellsPerTick, r.alive);
+                results.push_back(r);
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty())
+    {
+        if (!WriteJson(options.jsonPath, options, pool.GetThreadsNumber(), results))
+        {
+            std::printf("Can't write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        std::printf("Results are written to %s\n", options.jsonPath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+* @file HeightLoadBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Heights startup benchmark: time to get all heights of terrain.jpg from the image decoding and from the mapped heights files.
+//Cold runs drop the file from the OS cache first where the OS allows it (POSIX), otherwise the first run of the process is reported.
+//No render system is required.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <OgreRoot.h>
+#include <OgreImage.h>
+#include <OgreDataStream.h>
+#include <OgreColourValue.h>
+
+#include "../src/Nature/HeightFile.h"
+
+namespace
+{
+    const char IMAGE_PATH[] = DATA_DIR"/media/materials/textures/terrain.jpg";
+
+    /**
+     *	Ask the OS to forget cached pages of a file, dirty pages are written back first since they can't be dropped
+     */
+    void EvictFile(const std::string & path)
+    {
+#ifndef _WIN32
+        int file = open(path.c_str(), O_RDONLY);
+        if (file >= 0)
+        {
+            fdatasync(file);
+            posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+            close(file);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    size_t GetFileSize(const std::string & path)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+        return file.is_open() ? static_cast<size_t>(file.tellg()) : 0;
+    }
+
+    void LoadImage(const std::string & path, Ogre::Image & image)
+    {
+        std::ifstream* file = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(path.c_str(), std::ios::in | std::ios::binary);
+        Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(path, file, true));
+        image.load(stream, "jpg");
+    }
+
+    /**
+     *	Heights of the image red channel, the same values the ground samples
+     */
+    float DecodeImage(const std::string & path, std::vector<float> & heights)
+    {
+        Ogre::Image image;
+        LoadImage(path, image);
+        heights.resize(image.getWidth() * image.getHeight());
+        for (size_t y = 0; y < image.getHeight(); ++y)
+        {
+            for (size_t x = 0; x < image.getWidth(); ++x)
+            {
+                heights[y * image.getWidth() + x] = image.getColourAt(x, y, 0)[0];
+            }
+        }
+        return heights.back();
+    }
+
+    float MapFile(const std::string & path, std::vector<float> & heights)
+    {
+        HeightFile file;
+        if (!file.Open(path))
+        {
+            return 0.0f;
+        }
+        heights.resize(file.GetWidth() * file.GetHeight());
+        for (size_t y = 0; y < file.GetHeight(); ++y)
+        {
+            file.ReadRow(y, 0, file.GetWidth(), &heights[y * file.GetWidth()]);
+        }
+        return heights.back();
+    }
+
+    double Measure(const std::function<float()> & load)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        volatile float sink = load();
+        (void)sink;
+        auto stop = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+}
+
+int main()
+{
+    const size_t WARM_RUNS = 5;
+    const size_t TILE_SIZE = 64;
+
+    //root registers the image codecs
+    Ogre::Root root("", "", "HeightLoadBench.log");
+
+    //heights files are converted from the same image
+    std::vector<float> heights;
+    Ogre::Image image;
+    LoadImage(IMAGE_PATH, image);
+    DecodeImage(IMAGE_PATH, heights);
+    const std::string uint16Path = "HeightLoadBench_uint16.hf";
+    const std::string floatPath = "HeightLoadBench_float.hf";
+    if (!HeightFile::Write(uint16Path, heights.data(), image.getWidth(), image.getHeight(), TILE_SIZE, HeightFile::SAMPLE_UINT16) ||
+        !HeightFile::Write(floatPath, heights.data(), image.getWidth(), image.getHeight(), TILE_SIZE, HeightFile::SAMPLE_FLOAT))
+    {
+        std::printf("Can't write heights files\n");
+        return 1;
+    }
+
+    struct Source
+    {
+        const char* name;
+        std::string path;
+        std::function<float(const std::string &, std::vector<float> &)> load;
+    };
+    const Source sources[] = {
+        { "jpg decode", IMAGE_PATH, DecodeImage },
+        { "hf uint16", uint16Path, MapFile },
+        { "hf float", floatPath, MapFile }
+    };
+
+    std::printf("%d x %d heights\n", static_cast<int>(image.getWidth()), static_cast<int>(image.getHeight()));
+    std::printf("%12s %10s %10s %10s\n", "source", "file KB", "cold ms", "warm ms");
+    for (const Source & source : sources)
+    {
+        std::vector<float> result;
+        EvictFile(source.path);
+        double cold = Measure([&]() { return source.load(source.path, result); });
+        std::vector<double> warm;
+        for (size_t i = 0; i < WARM_RUNS; ++i)
+        {
+            warm.push_back(Measure([&]() { return source.load(source.path, result); }));
+        }
+        std::sort(warm.begin(), warm.end());
+        std::printf("%12s %10zu %10.3f %10.3f\n", source.name, GetFileSize(source.path) / 1024, cold, warm[WARM_RUNS / 2]);
+    }
+
+    std::remove(uint16Path.c_str());
+    std::remove(floatPath.c_str());
+    return 0;
+}
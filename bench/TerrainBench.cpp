@@ -0,0 +1,314 @@
+/**
+* @file TerrainBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Ground ray casting benchmark: rays per second of the mesh triangles test, the tiles walk and the min/max pyramid walk,
+//then single and batched picking through the world.
+//With --check only verifies the heightfield queries against ray casting on the ground mesh and exits with 1 on mismatches.
+//Creates a hidden window for the render system, no input or interaction is required.
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <random>
+#include <vector>
+
+#include <OgreRoot.h>
+#include <OgreConfigFile.h>
+#include <OgreRenderWindow.h>
+#include <OgreSceneManager.h>
+#include <OgreCamera.h>
+#include <OgreImage.h>
+#include <OgreRay.h>
+#include <OgreSceneNode.h>
+#include <OgreMatrix4.h>
+
+#include "../src/Nature/Ground.h"
+#include "../src/Nature/World.h"
+
+namespace
+{
+    void SetupResources(const Ogre::String & resourcesCfg)
+    {
+        Ogre::ConfigFile cf;
+        cf.load(resourcesCfg);
+        Ogre::ConfigFile::SectionIterator seci = cf.getSectionIterator();
+        while (seci.hasMoreElements())
+        {
+            Ogre::String secName = seci.peekNextKey();
+            Ogre::ConfigFile::SettingsMultiMap *settings = seci.getNext();
+            for (auto i = settings->begin(); i != settings->end(); ++i)
+            {
+                Ogre::ResourceGroupManager::getSingleton().addResourceLocation(i->second, i->first, secName);
+            }
+        }
+    }
+
+    /**
+     *	Local space rays from points above the ground towards random ground points
+     *  @param slope - vertical drop per unit of horizontal distance, small values give shallow rays
+     */
+    std::vector<Ogre::Ray> MakeRays(const Ogre::AxisAlignedBox & bounds, size_t count, float slope, uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> randomX(bounds.getMinimum()[0], bounds.getMaximum()[0]);
+        std::uniform_real_distribution<float> randomY(bounds.getMinimum()[1], bounds.getMaximum()[1]);
+
+        std::vector<Ogre::Ray> rays;
+        rays.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Ogre::Vector3 target(randomX(generator), randomY(generator), bounds.getMinimum()[2]);
+            Ogre::Vector3 origin(randomX(generator), randomY(generator), 0.0f);
+            origin[2] = bounds.getMaximum()[2] + slope * origin.distance(target);
+            rays.push_back(Ogre::Ray(origin, (target - origin).normalisedCopy()));
+        }
+        return rays;
+    }
+
+    template <typename Intersect_>
+    double MeasureRaysPerSecond(const std::vector<Ogre::Ray> & rays, std::vector<std::pair<bool, Ogre::Vector3>> & hits, Intersect_ intersect)
+    {
+        hits.resize(rays.size());
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            hits[i] = intersect(rays[i]);
+        }
+        auto stop = std::chrono::high_resolution_clock::now();
+        return rays.size() / std::chrono::duration<double>(stop - start).count();
+    }
+
+    /**
+     *	Heights and ray casts of the heightfield against ray casting on the ground mesh, batch heights against the single point ones
+     *  @return number of mismatching probes
+     */
+    size_t CheckWorld(const World & world, const Ground & ground)
+    {
+        const size_t MESH_PROBES = 1024;
+        const size_t GRID_SIDE = 32;
+        const float MESH_TOLERANCE = 1e-2f;
+        const float BATCH_TOLERANCE = 1e-3f;
+
+        const Ogre::SceneNode* node = ground.GetNode();
+        Ogre::Matrix4 groundWorldMat;
+        groundWorldMat.makeTransform(node->getPosition(), node->getScale(), node->getOrientation());
+        const Ogre::Matrix4 groundInvWorldMat = groundWorldMat.inverseAffine();
+        Ogre::AxisAlignedBox box = ground.GetLocalSpaceBounds();
+        box.transformAffine(groundWorldMat);
+
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> randomX(box.getMinimum()[0], box.getMaximum()[0]);
+        std::uniform_real_distribution<float> randomZ(box.getMinimum()[2], box.getMaximum()[2]);
+        size_t mismatches = 0;
+        float maxError = 0.0f;
+        for (size_t i = 0; i < MESH_PROBES; ++i)
+        {
+            const Ogre::Vector3 top(randomX(generator), box.getMaximum()[1] + 10.0f, randomZ(generator));
+            const Ogre::Vector3 localTop = groundInvWorldMat.transformAffine(top);
+            const Ogre::Vector3 localDown = groundInvWorldMat.transformAffine(top + Ogre::Vector3::NEGATIVE_UNIT_Y) - localTop;
+            auto meshHit = ground.GetIntersectionLocalSpaceMesh(Ogre::Ray(localTop, localDown.normalisedCopy()));
+            if (!meshHit.first)
+            {
+                continue;
+            }
+            float meshHeight = groundWorldMat.transformAffine(meshHit.second)[1];
+            auto hit = world.GetIntersection(Ogre::Ray(top, Ogre::Vector3::NEGATIVE_UNIT_Y));
+            float error = std::abs(meshHeight - world.GetGroundHeightAt(top[0], top[2]));
+            error = std::max(error, std::get<0>(hit) ? std::abs(meshHeight - std::get<1>(hit)[1]) : std::numeric_limits<float>::infinity());
+            maxError = std::max(maxError, error);
+            mismatches += (error < MESH_TOLERANCE) ? 0 : 1;
+        }
+        std::printf("mesh probes %zu, max deviation %g, mismatches %zu\n", MESH_PROBES, maxError, mismatches);
+
+        const float dx = (box.getMaximum()[0] - box.getMinimum()[0]) / GRID_SIDE;
+        const float dz = (box.getMaximum()[2] - box.getMinimum()[2]) / GRID_SIDE;
+        std::vector<float> heights(GRID_SIDE * GRID_SIDE);
+        world.GetGroundHeightsOnGrid(box.getMinimum()[0], box.getMinimum()[2], dx, dz, GRID_SIDE, GRID_SIDE, heights.data());
+        size_t batchMismatches = 0;
+        for (size_t j = 0; j < GRID_SIDE; ++j)
+        {
+            for (size_t i = 0; i < GRID_SIDE; ++i)
+            {
+                float h = world.GetGroundHeightAt(box.getMinimum()[0] + i * dx, box.getMinimum()[2] + j * dz);
+                float batch = heights[j * GRID_SIDE + i];
+                bool same = (std::isinf(h) && std::isinf(batch)) || std::abs(h - batch) < BATCH_TOLERANCE;
+                batchMismatches += same ? 0 : 1;
+            }
+        }
+        std::printf("batch heights %zu, mismatches %zu\n", GRID_SIDE * GRID_SIDE, batchMismatches);
+        return mismatches + batchMismatches;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool checkOnly = (argc > 1 && 0 == std::strcmp(argv[1], "--check"));
+    const size_t MESH_RAYS = 200;
+    const size_t HEIGHTFIELD_RAYS = 100000;
+
+#ifdef NDEBUG
+    Ogre::Root root(DATA_DIR"/plugins.cfg", "", "TerrainBench.log");
+#else
+    Ogre::Root root(DATA_DIR"/plugins_d.cfg", "", "TerrainBench.log");
+#endif
+    SetupResources(DATA_DIR"/resources.cfg");
+
+    if (root.getAvailableRenderers().empty())
+    {
+        std::printf("No render systems available\n");
+        return 1;
+    }
+    root.setRenderSystem(root.getAvailableRenderers().front());
+    root.initialise(false);
+
+    Ogre::NameValuePairList windowParams;
+    windowParams["hidden"] = "true";
+    root.createRenderWindow("TerrainBench", 64, 64, false, &windowParams);
+
+    Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
+    Ogre::SceneManager* sceneManager = root.createSceneManager(Ogre::ST_GENERIC);
+
+    World world("World", sceneManager);
+    const Ground & ground = *world.GetGround();
+    if (checkOnly)
+    {
+        return (0 == CheckWorld(world, ground)) ? 0 : 1;
+    }
+
+    std::printf("%10s %16s %16s %16s %10s %12s\n", "rays", "mesh rays/s", "tiles rays/s", "pyramid rays/s", "speedup", "mismatches");
+    struct RaysSet
+    {
+        const char* name;
+        float slope;
+    };
+    for (const RaysSet & set : { RaysSet{ "steep", 2.0f }, RaysSet{ "shallow", 0.05f } })
+    {
+        std::vector<Ogre::Ray> rays = MakeRays(ground.GetLocalSpaceBounds(), HEIGHTFIELD_RAYS, set.slope, 42);
+        std::vector<Ogre::Ray> meshRays(rays.cbegin(), rays.cbegin() + MESH_RAYS);
+
+        std::vector<std::pair<bool, Ogre::Vector3>> meshHits;
+        std::vector<std::pair<bool, Ogre::Vector3>> tilesHits;
+        std::vector<std::pair<bool, Ogre::Vector3>> pyramidHits;
+        double meshSpeed = MeasureRaysPerSecond(meshRays, meshHits, [&](const Ogre::Ray & ray) { return ground.GetIntersectionLocalSpaceMesh(ray); });
+        double tilesSpeed = MeasureRaysPerSecond(rays, tilesHits, [&](const Ogre::Ray & ray)
+        {
+            const Ogre::Vector3 & o = ray.getOrigin();
+            const Ogre::Vector3 & d = ray.getDirection();
+            auto hit = ground.GetHeightfield().IntersectWalk(o[0], o[1], o[2], d[0], d[1], d[2]);
+            return std::make_pair(hit.first, ray.getPoint(hit.second));
+        });
+        double pyramidSpeed = MeasureRaysPerSecond(rays, pyramidHits, [&](const Ogre::Ray & ray) { return ground.GetIntersectionLocalSpace(ray); });
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            const auto & reference = (i < MESH_RAYS) ? meshHits[i] : tilesHits[i];
+            for (const auto & hit : { tilesHits[i], pyramidHits[i] })
+            {
+                if (reference.first != hit.first || (reference.first && !reference.second.positionEquals(hit.second, 1e-2f)))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        std::printf("%10s %16.1f %16.1f %16.1f %9.1fx %12zu\n", set.name, meshSpeed, tilesSpeed, pyramidSpeed, pyramidSpeed / meshSpeed, mismatches);
+    }
+
+    //picking through the world, rays from a camera towards a rectangle on the ground
+    std::printf("\n%10s %16s %16s %16s %12s\n", "batch", "single rays/s", "batch rays/s", "threads rays/s", "mismatches");
+    const size_t PICKING_RAYS = 100000;
+    for (size_t batch : { 1, 64, 4096 })
+    {
+        size_t side = static_cast<size_t>(std::sqrt(static_cast<float>(batch)));
+        std::vector<Ogre::Ray> rays;
+        for (size_t i = 0; i < batch; ++i)
+        {
+            Ogre::Vector3 target(-50.0f + 100.0f * (i % side) / side, 0.0f, -50.0f + 100.0f * (i / side) / side);
+            Ogre::Vector3 origin(0.0f, 100.0f, 150.0f);
+            rays.push_back(Ogre::Ray(origin, (target - origin).normalisedCopy()));
+        }
+        const size_t repeats = std::max<size_t>(1, PICKING_RAYS / batch);
+
+        std::vector<std::tuple<bool, Ogre::Vector3, Ogre::Entity*>> single(batch);
+        std::vector<std::tuple<bool, Ogre::Vector3, Ogre::Entity*>> batched(batch);
+        std::vector<std::tuple<bool, Ogre::Vector3, Ogre::Entity*>> threaded(batch);
+        auto measure = [&](const std::function<void()> & query)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+            {
+                query();
+            }
+            auto stop = std::chrono::high_resolution_clock::now();
+            return repeats * batch / std::chrono::duration<double>(stop - start).count();
+        };
+        double singleSpeed = measure([&]()
+        {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                single[i] = world.GetIntersection(rays[i]);
+            }
+        });
+        double batchSpeed = measure([&]() { world.GetIntersections(rays.data(), batch, batched.data()); });
+        double threadsSpeed = measure([&]() { world.GetIntersections(rays.data(), batch, threaded.data(), world.GetWorkerPool()); });
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < batch; ++i)
+        {
+            for (const auto & hit : { batched[i], threaded[i] })
+            {
+                if (std::get<0>(single[i]) != std::get<0>(hit) || (std::get<0>(hit) && !std::get<1>(single[i]).positionEquals(std::get<1>(hit), 1e-2f)))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        std::printf("%10zu %16.1f %16.1f %16.1f %12zu\n", batch, singleSpeed, batchSpeed, threadsSpeed, mismatches);
+    }
+
+    //ground levels of detail for a 1080p viewport, a huge viewport forces the full resolution
+    const float VIEWPORT_HEIGHT = 1080.0f;
+    const size_t LOD_UPDATES = 1000;
+    Ogre::Camera* camera = sceneManager->createCamera("BenchCam");
+    camera->setAspectRatio(16.0f / 9.0f);
+    camera->setNearClipDistance(1.0f);
+    std::printf("\n%10s %16s %16s %10s %16s\n", "view", "full triangles", "lod triangles", "ratio", "update us");
+    struct View
+    {
+        const char* name;
+        Ogre::Vector3 position;
+    };
+    for (const View & view : { View{ "close", Ogre::Vector3(0.0f, 20.0f, 30.0f) }, View{ "rts", Ogre::Vector3(0.0f, 100.0f, 150.0f) }, View{ "wide", Ogre::Vector3(0.0f, 250.0f, 250.0f) } })
+    {
+        camera->setPosition(view.position);
+        camera->lookAt(Ogre::Vector3::ZERO);
+
+        world.UpdateGroundLod(camera, std::numeric_limits<float>::max());
+        size_t fullTriangles = ground.GetTrianglesNumber();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < LOD_UPDATES; ++i)
+        {
+            world.UpdateGroundLod(camera, VIEWPORT_HEIGHT);
+        }
+        auto stop = std::chrono::high_resolution_clock::now();
+        double us = std::chrono::duration<double, std::micro>(stop - start).count() / LOD_UPDATES;
+        size_t lodTriangles = ground.GetTrianglesNumber();
+
+        std::printf("%10s %16zu %16zu %9.2fx %16.2f\n", view.name, fullTriangles, lodTriangles, static_cast<double>(fullTriangles) / std::max<size_t>(lodTriangles, 1), us);
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+/**
+* @file TerrainQueryBench.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Terrain queries benchmark: queries per second and latency percentiles for random vertical probes, camera picking rays and grazing horizon rays.
+//Terrain sizes are swept on heightfields of 513, 2049 and 8193 noise samples per side (Heightfield::Sample and Heightfield::Intersect),
+//the ground of a fixed size is measured on terrain.jpg (Ground::GetHeightAt, World::GetGroundHeightAt, Ground::GetIntersectionLocalSpace).
+//terrain.jpg is loaded as heights only, no render system or window is required.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <OgreRoot.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreImage.h>
+#include <OgreDataStream.h>
+#include <OgreRay.h>
+#include <OgreMatrix4.h>
+
+#include "../src/Nature/Ground.h"
+#include "../src/Nature/Heightfield.h"
+#include "../src/Nature/World.h"
+
+namespace
+{
+    const char IMAGE_PATH[] = DATA_DIR"/media/materials/textures/terrain.jpg";
+
+    //samples spacing and heights range of the fixed ground
+    const float VERTEX_STEP = 1.0f;
+    const float HEIGHT_STEP = 8.0f;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        double queriesPerSecond;
+        double p50;
+        double p90;
+        double p99;
+        double p999;
+        double hitRatio;
+    };
+
+    std::shared_ptr<Ogre::Image> LoadImage(const std::string & path)
+    {
+        std::ifstream* file = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(path.c_str(), std::ios::in | std::ios::binary);
+        if (!file->is_open())
+        {
+            OGRE_DELETE_T(file, basic_ifstream, Ogre::MEMCATEGORY_GENERAL);
+            return nullptr;
+        }
+        Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(path, file, true));
+        auto image = std::make_shared<Ogre::Image>();
+        image->load(stream, "jpg");
+        return image;
+    }
+
+    /**
+     *	Heights from [0, 1] of smoothed value noise octaves, row by row
+     */
+    std::vector<float> MakeNoiseHeights(size_t size, uint32_t seed)
+    {
+        const size_t OCTAVES = 5;
+        const size_t BASE_CELLS = 4;
+
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<float> heights(size * size, 0.0f);
+        float amplitude = 0.5f;
+        for (size_t octave = 0, cells = BASE_CELLS; octave < OCTAVES; ++octave, cells *= 2, amplitude *= 0.5f)
+        {
+            std::vector<float> lattice((cells + 1) * (cells + 1));
+            for (float & value : lattice)
+            {
+                value = unit(generator);
+            }
+            const float scale = static_cast<float>(cells) / (size - 1);
+            for (size_t y = 0; y < size; ++y)
+            {
+                float fy = y * scale;
+                size_t cy = std::min(static_cast<size_t>(fy), cells - 1);
+                float ty = fy - cy;
+                ty = ty * ty * (3.0f - 2.0f * ty);
+                for (size_t x = 0; x < size; ++x)
+                {
+                    float fx = x * scale;
+                    size_t cx = std::min(static_cast<size_t>(fx), cells - 1);
+                    float tx = fx - cx;
+                    tx = tx * tx * (3.0f - 2.0f * tx);
+                    const float* row0 = &lattice[cy * (cells + 1) + cx];
+                    const float* row1 = row0 + cells + 1;
+                    float h0 = row0[0] + (row0[1] - row0[0]) * tx;
+                    float h1 = row1[0] + (row1[1] - row1[0]) * tx;
+                    heights[y * size + x] += amplitude * (h0 + (h1 - h0) * ty);
+                }
+            }
+        }
+        return heights;
+    }
+
+    /**
+     *	Cost of reading the clock twice, subtracted from the single query latencies
+     */
+    double MeasureClockOverhead()
+    {
+        const size_t SAMPLES = 100000;
+        std::vector<double> samples(SAMPLES);
+        for (double & sample : samples)
+        {
+            auto start = Clock::now();
+            auto stop = Clock::now();
+            sample = std::chrono::duration<double, std::nano>(stop - start).count();
+        }
+        std::nth_element(samples.begin(), samples.begin() + SAMPLES / 2, samples.end());
+        return samples[SAMPLES / 2];
+    }
+
+    double Percentile(const std::vector<double> & sorted, double p)
+    {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    }
+
+    /**
+     *	Throughput of the back to back queries, then latencies of the queries timed one by one
+     *  @param query - query(i) returns hit flag and value
+     */
+    template <typename Query_>
+    Stats Measure(size_t count, double clockOverhead, Query_ query)
+    {
+        Stats stats;
+        volatile float sink = 0.0f;
+
+        float sum = 0.0f;
+        size_t hits = 0;
+        auto start = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto result = query(i);
+            hits += result.first ? 1 : 0;
+            sum += result.second;
+        }
+        auto stop = Clock::now();
+        sink = sum;
+        stats.queriesPerSecond = count / std::chrono::duration<double>(stop - start).count();
+        stats.hitRatio = static_cast<double>(hits) / count;
+
+        std::vector<double> latencies(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto queryStart = Clock::now();
+            auto result = query(i);
+            auto queryStop = Clock::now();
+            sink = result.second;
+            latencies[i] = std::max(0.0, std::chrono::duration<double, std::nano>(queryStop - queryStart).count() - clockOverhead);
+        }
+        (void)sink;
+        std::sort(latencies.begin(), latencies.end());
+        stats.p50 = Percentile(latencies, 0.5);
+        stats.p90 = Percentile(latencies, 0.9);
+        stats.p99 = Percentile(latencies, 0.99);
+        stats.p999 = Percentile(latencies, 0.999);
+        return stats;
+    }
+
+    void Report(const std::string & terrain, const char* query, const Stats & stats)
+    {
+        std::printf("%12s %18s %14.0f %9.1f %9.1f %9.1f %9.1f %7.1f\n", terrain.c_str(), query, stats.queriesPerSecond,
+            stats.p50, stats.p90, stats.p99, stats.p999, 100.0 * stats.hitRatio);
+    }
+
+    /**
+     *	Local space rays looking down from a few camera positions above the ground to random ground points
+     */
+    std::vector<Ogre::Ray> MakePickingRays(const Ogre::AxisAlignedBox & bounds, size_t count, std::mt19937 & generator)
+    {
+        const size_t CAMERAS = 8;
+        const Ogre::Vector3 size = bounds.getSize();
+        std::uniform_real_distribution<float> randomX(bounds.getMinimum()[0], bounds.getMaximum()[0]);
+        std::uniform_real_distribution<float> randomY(bounds.getMinimum()[1], bounds.getMaximum()[1]);
+
+        std::vector<Ogre::Vector3> cameras;
+        for (size_t i = 0; i < CAMERAS; ++i)
+        {
+            cameras.push_back(Ogre::Vector3(randomX(generator), randomY(generator), bounds.getMaximum()[2] + 0.1f * std::max(size[0], size[1])));
+        }
+        std::vector<Ogre::Ray> rays;
+        rays.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            //a burst of clicks from every camera position
+            const Ogre::Vector3 & origin = cameras[i * CAMERAS / count];
+            Ogre::Vector3 target(randomX(generator), randomY(generator), bounds.getMinimum()[2]);
+            rays.push_back(Ogre::Ray(origin, (target - origin).normalisedCopy()));
+        }
+        return rays;
+    }
+
+    /**
+     *	Local space rays from the border of the ground at the relief tops, looking across the ground slightly down
+     */
+    std::vector<Ogre::Ray> MakeGrazingRays(const Ogre::AxisAlignedBox & bounds, size_t count, std::mt19937 & generator)
+    {
+        const float SLOPE = 0.01f;
+        const Ogre::Vector3 center = bounds.getCenter();
+        const Ogre::Vector3 half = bounds.getHalfSize();
+        std::uniform_real_distribution<float> randomAngle(0.0f, Ogre::Math::TWO_PI);
+        std::uniform_real_distribution<float> randomSpread(-0.25f, 0.25f);
+        std::uniform_real_distribution<float> randomTop(0.8f, 1.0f);
+
+        std::vector<Ogre::Ray> rays;
+        rays.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            float angle = randomAngle(generator);
+            Ogre::Vector3 origin(center[0] + half[0] * std::cos(angle), center[1] + half[1] * std::sin(angle),
+                bounds.getMinimum()[2] + randomTop(generator) * (bounds.getMaximum()[2] - bounds.getMinimum()[2]));
+            //towards the center with a spread of directions
+            float heading = angle + Ogre::Math::PI + randomSpread(generator);
+            Ogre::Vector3 direction(std::cos(heading), std::sin(heading), -SLOPE);
+            rays.push_back(Ogre::Ray(origin, direction.normalisedCopy()));
+        }
+        return rays;
+    }
+
+    /**
+     *	Vertical, picking and grazing rays over local space bounds of a surface
+     *  @param intersect - intersect(ray) returns hit flag and hit height
+     */
+    template <typename Intersect_>
+    void BenchRays(const std::string & name, const Ogre::AxisAlignedBox & bounds, size_t count, double clockOverhead, std::mt19937 & generator, Intersect_ intersect)
+    {
+        std::uniform_real_distribution<float> localX(bounds.getMinimum()[0], bounds.getMaximum()[0]);
+        std::uniform_real_distribution<float> localY(bounds.getMinimum()[1], bounds.getMaximum()[1]);
+        std::vector<Ogre::Ray> verticalRays;
+        verticalRays.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            verticalRays.push_back(Ogre::Ray(Ogre::Vector3(localX(generator), localY(generator), bounds.getMaximum()[2] + 1.0f), Ogre::Vector3::NEGATIVE_UNIT_Z));
+        }
+        Report(name, "vertical rays", Measure(count, clockOverhead, [&](size_t i) { return intersect(verticalRays[i]); }));
+
+        std::vector<Ogre::Ray> pickingRays = MakePickingRays(bounds, count, generator);
+        Report(name, "picking rays", Measure(count, clockOverhead, [&](size_t i) { return intersect(pickingRays[i]); }));
+
+        std::vector<Ogre::Ray> grazingRays = MakeGrazingRays(bounds, count, generator);
+        Report(name, "grazing rays", Measure(count, clockOverhead, [&](size_t i) { return intersect(grazingRays[i]); }));
+    }
+
+    /**
+     *	Queries on a heightfield of size x size noise samples with the spacing and heights range of the ground
+     */
+    void BenchHeightfield(size_t size, uint32_t seed, size_t count, double clockOverhead)
+    {
+        const std::string name = "noise " + std::to_string(size);
+        std::vector<float> noise = MakeNoiseHeights(size, seed);
+
+        auto buildStart = Clock::now();
+        Heightfield heightfield;
+        const float origin = -0.5f * (size - 1) * VERTEX_STEP;
+        heightfield.Reset(size, size, origin, origin, VERTEX_STEP);
+        for (size_t y = 0; y < size; ++y)
+        {
+            float* row = heightfield.GetRow(y);
+            for (size_t x = 0; x < size; ++x)
+            {
+                row[x] = noise[y * size + x] * HEIGHT_STEP;
+            }
+        }
+        heightfield.UpdateBounds();
+        double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+        std::printf("%12s %zu x %zu heightfield, build %.1f ms\n", name.c_str(), size, size, buildMs);
+
+        const float extent = (size - 1) * VERTEX_STEP;
+        const Ogre::AxisAlignedBox bounds(origin, origin, heightfield.GetMinHeight(), origin + extent, origin + extent, heightfield.GetMaxHeight());
+
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> localX(bounds.getMinimum()[0], bounds.getMaximum()[0]);
+        std::uniform_real_distribution<float> localY(bounds.getMinimum()[1], bounds.getMaximum()[1]);
+        std::vector<std::pair<float, float>> points(count);
+        for (auto & point : points)
+        {
+            point = std::make_pair(localX(generator), localY(generator));
+        }
+        Report(name, "sample", Measure(count, clockOverhead, [&](size_t i)
+        {
+            return heightfield.Sample(points[i].first, points[i].second);
+        }));
+
+        BenchRays(name, bounds, count, clockOverhead, generator, [&](const Ogre::Ray & ray)
+        {
+            const Ogre::Vector3 & o = ray.getOrigin();
+            const Ogre::Vector3 & d = ray.getDirection();
+            auto hit = heightfield.Intersect(o[0], o[1], o[2], d[0], d[1], d[2]);
+            return std::make_pair(hit.first, hit.first ? o[2] + hit.second * d[2] : 0.0f);
+        });
+    }
+
+    /**
+     *	Queries through the ground and the world loaded from a height map
+     */
+    void BenchGround(const std::string & name, std::shared_ptr<Ogre::Image> heightMap, Ogre::SceneManager* sceneManager, size_t count, double clockOverhead)
+    {
+        auto loadStart = Clock::now();
+        World world("World", sceneManager, heightMap, true);
+        double loadMs = std::chrono::duration<double, std::milli>(Clock::now() - loadStart).count();
+        const Ground & ground = *world.GetGround();
+        const Ogre::AxisAlignedBox bounds = ground.GetLocalSpaceBounds();
+        std::printf("%12s %zu x %zu map, heights load %.1f ms\n", name.c_str(), static_cast<size_t>(heightMap->getWidth()), static_cast<size_t>(heightMap->getHeight()), loadMs);
+
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<std::pair<float, float>> texCoords(count);
+        for (auto & st : texCoords)
+        {
+            st = std::make_pair(unit(generator), unit(generator));
+        }
+        Report(name, "height map", Measure(count, clockOverhead, [&](size_t i)
+        {
+            return std::make_pair(true, ground.GetHeightAt(texCoords[i].first, texCoords[i].second));
+        }));
+
+        //world space probes over the ground
+        const Ogre::SceneNode* node = ground.GetNode();
+        Ogre::Matrix4 groundWorldMat;
+        groundWorldMat.makeTransform(node->getPosition(), node->getScale(), node->getOrientation());
+        Ogre::AxisAlignedBox worldBounds = bounds;
+        worldBounds.transformAffine(groundWorldMat);
+        std::uniform_real_distribution<float> randomX(worldBounds.getMinimum()[0], worldBounds.getMaximum()[0]);
+        std::uniform_real_distribution<float> randomZ(worldBounds.getMinimum()[2], worldBounds.getMaximum()[2]);
+        std::vector<std::pair<float, float>> points(count);
+        for (auto & point : points)
+        {
+            point = std::make_pair(randomX(generator), randomZ(generator));
+        }
+        Report(name, "world height", Measure(count, clockOverhead, [&](size_t i)
+        {
+            float h = world.GetGroundHeightAt(points[i].first, points[i].second);
+            return std::make_pair(!std::isinf(h), std::isinf(h) ? 0.0f : h);
+        }));
+
+        BenchRays(name, bounds, count, clockOverhead, generator, [&](const Ogre::Ray & ray)
+        {
+            auto hit = ground.GetIntersectionLocalSpace(ray);
+            return std::make_pair(hit.first, hit.second[2]);
+        });
+    }
+}
+
+int main()
+{
+    const size_t QUERIES = 200000;
+    const size_t HEIGHTFIELD_SIZES[] = { 513, 2049, 8193 };
+
+    const double clockOverhead = MeasureClockOverhead();
+    std::printf("clock overhead %.1f ns is subtracted from the latencies\n", clockOverhead);
+    std::printf("%12s %18s %14s %9s %9s %9s %9s %7s\n", "terrain", "query", "queries/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "hits %");
+
+    uint32_t seed = 1;
+    for (size_t size : HEIGHTFIELD_SIZES)
+    {
+        BenchHeightfield(size, seed++, QUERIES, clockOverhead);
+    }
+
+    //root registers the image codecs, the scene manager only keeps the ground node
+    Ogre::Root root("", "", "TerrainQueryBench.log");
+    Ogre::SceneManager* sceneManager = root.createSceneManager(Ogre::ST_GENERIC);
+    std::shared_ptr<Ogre::Image> terrain = LoadImage(IMAGE_PATH);
+    if (nullptr != terrain.get())
+    {
+        BenchGround("terrain.jpg", terrain, sceneManager, QUERIES, clockOverhead);
+    }
+    else
+    {
+        std::printf("%s is not found\n", IMAGE_PATH);
+    }
+
+    root.destroySceneManager(sceneManager);
+    return 0;
+}
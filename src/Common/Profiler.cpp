@@ -0,0 +1,175 @@
+/**
+* @file Profiler.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "Profiler.h"
+
+#include <cstdio>
+
+const size_t Profiler::THREAD_CAPACITY = 1 << 16;
+
+namespace
+{
+    std::string EscapeJson(const std::string & text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if ('"' == c || '\\' == c)
+            {
+                escaped.push_back('\\');
+            }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+}
+
+//-------------------------------------------------------
+Profiler::Profiler():
+    mEpoch(std::chrono::steady_clock::now()), mEnabled(false)
+{
+
+}
+//-------------------------------------------------------
+Profiler::~Profiler()
+{
+
+}
+//-------------------------------------------------------
+Profiler & Profiler::GetInstance()
+{
+    static Profiler instance;
+    return instance;
+}
+//-------------------------------------------------------
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+    //buffers are owned by the profiler, so zones of finished threads are kept until they are saved
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (nullptr == buffer)
+    {
+        std::lock_guard<std::mutex> lock(mThreadsMutex);
+        mThreads.push_back(std::make_unique<ThreadBuffer>());
+        buffer = mThreads.back().get();
+        buffer->id = static_cast<uint32_t>(mThreads.size() - 1);
+        buffer->name = "Thread " + std::to_string(buffer->id);
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+    return buffer;
+}
+//-------------------------------------------------------
+void Profiler::SetThreadName(const std::string & name)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(mThreadsMutex);
+    buffer->name = name;
+}
+//-------------------------------------------------------
+void Profiler::Record(const char* name, uint64_t begin, uint64_t end)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if (nullptr == buffer->zones.get())
+    {
+        buffer->zones.reset(new Zone[THREAD_CAPACITY]);
+    }
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->zones[head & (THREAD_CAPACITY - 1)] = Zone{ name, begin, end };
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+//-------------------------------------------------------
+void Profiler::StartCapture(size_t frames)
+{
+    if (frames > 0 && !IsCapturing())
+    {
+        mCaptureFrames = frames;
+        mCapturePending = true;
+    }
+}
+//-------------------------------------------------------
+bool Profiler::NextFrame()
+{
+    uint64_t now = GetTime();
+    if (mCapturePending)
+    {
+        mFramesThread = GetThreadBuffer()->id;
+        mCapturePending = false;
+        mCaptureBegin = now;
+        mFrames.clear();
+        mEnabled.store(true, std::memory_order_relaxed);
+    }
+    if (!mEnabled.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    if (mFrames.size() < mCaptureFrames)
+    {
+        mFrames.push_back(now);
+        return false;
+    }
+    mEnabled.store(false, std::memory_order_relaxed);
+    mCaptureEnd = now;
+    return true;
+}
+//-------------------------------------------------------
+bool Profiler::SaveTrace(const std::string & path) const
+{
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (nullptr == file)
+    {
+        return false;
+    }
+    //timestamps are microseconds from the capture beginning
+    auto toMicroseconds = [this](uint64_t time)
+    {
+        return static_cast<double>(time - mCaptureBegin) / 1000.0;
+    };
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto separate = [&]()
+    {
+        if (!first)
+        {
+            std::fprintf(file, ",\n");
+        }
+        first = false;
+    };
+    for (size_t i = 0; i < mFrames.size(); ++i)
+    {
+        separate();
+        std::fprintf(file, "{\"name\":\"Frame %zu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", i, mFramesThread, toMicroseconds(mFrames[i]));
+    }
+
+    std::lock_guard<std::mutex> lock(mThreadsMutex);
+    for (const auto & buffer : mThreads)
+    {
+        separate();
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", buffer->id, EscapeJson(buffer->name).c_str());
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        //the oldest slot of a full buffer can be overwritten by a zone finishing right now
+        uint64_t tail = (head > THREAD_CAPACITY) ? head - THREAD_CAPACITY + 1 : 0;
+        for (uint64_t i = tail; i < head; ++i)
+        {
+            const Zone & zone = buffer->zones[i & (THREAD_CAPACITY - 1)];
+            if (zone.begin < mCaptureBegin || zone.end > mCaptureEnd)
+            {
+                continue;
+            }
+            separate();
+            std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", EscapeJson(zone.name).c_str(), buffer->id,
+                toMicroseconds(zone.begin), static_cast<double>(zone.end - zone.begin) / 1000.0);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return 0 == std::fclose(file);
+}
+//-------------------------------------------------------
@@ -0,0 +1,176 @@
+/**
+* @file Profiler.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//zones are compiled out with NATURE_PROFILER=0
+#ifndef NATURE_PROFILER
+#define NATURE_PROFILER 1
+#endif
+
+/**
+ *	CPU profiler of named scoped zones over a window of frames.
+ *  Every thread writes its zones into an own ring buffer without locks, the oldest zones are overwritten when the buffer is full.
+ *  Zones are recorded only during a capture, the captured window is saved as Chrome trace events JSON (chrome://tracing, Perfetto).
+ */
+class Profiler
+{
+    //zones kept by a thread, power of two
+    static const size_t THREAD_CAPACITY;
+
+    struct Zone
+    {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t id = 0;
+        std::string name;
+        //allocated by the first zone of the thread
+        std::unique_ptr<Zone[]> zones;
+        //written by the owning thread only, zones before the head are complete
+        std::atomic<uint64_t> head;
+    };
+
+    std::chrono::steady_clock::time_point mEpoch;
+    std::atomic<bool> mEnabled;
+
+    //capture state is changed by the frames thread only
+    size_t mCaptureFrames = 0;
+    bool mCapturePending = false;
+    uint64_t mCaptureBegin = 0;
+    uint64_t mCaptureEnd = 0;
+    std::vector<uint64_t> mFrames;
+    uint32_t mFramesThread = 0;
+
+    mutable std::mutex mThreadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+
+    Profiler();
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    //-------------------------------------------------------
+
+    /**
+     *	Buffer of the calling thread, registered on the first call
+     */
+    ThreadBuffer* GetThreadBuffer();
+
+public:
+    static Profiler & GetInstance();
+
+    /**
+     *	Record zones of the next frames, the capture starts by the next NextFrame call
+     */
+    void StartCapture(size_t frames);
+
+    /**
+     *	Mark the beginning of a frame, has to be called by the frames thread before any zone of the frame
+     *  @return true if the capture window has just ended and the trace can be saved
+     */
+    bool NextFrame();
+
+    bool IsCapturing() const
+    {
+        return mCapturePending || mEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     *	Check if zones are recorded now
+     */
+    bool IsEnabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     *	Name of the calling thread in the trace
+     */
+    void SetThreadName(const std::string & name);
+
+    /**
+     *	Nanoseconds since the profiler creation
+     */
+    uint64_t GetTime() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mEpoch).count());
+    }
+
+    /**
+     *	Add a finished zone of the calling thread
+     *  @param name - has to live as long as the profiler, e.g. a string literal
+     */
+    void Record(const char* name, uint64_t begin, uint64_t end);
+
+    /**
+     *	Save zones of the last captured window as Chrome trace events, frames are marked by instant events
+     *  @return false if the file can't be written
+     */
+    bool SaveTrace(const std::string & path) const;
+};
+
+/**
+ *	Record the scope as a zone of the calling thread
+ */
+class ProfileZone
+{
+    const char* mName;
+    uint64_t mBegin = 0;
+    bool mActive;
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+    //-------------------------------------------------------
+public:
+    explicit ProfileZone(const char* name):
+        mName(name), mActive(Profiler::GetInstance().IsEnabled())
+    {
+        if (mActive)
+        {
+            mBegin = Profiler::GetInstance().GetTime();
+        }
+    }
+
+    ~ProfileZone()
+    {
+        if (mActive)
+        {
+            Profiler & profiler = Profiler::GetInstance();
+            profiler.Record(mName, mBegin, profiler.GetTime());
+        }
+    }
+};
+
+#if NATURE_PROFILER
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+
+#endif
@@ -0,0 +1,112 @@
+/**
+* @file WorkerPool.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#include "Profiler.h"
+
+//-------------------------------------------------------
+WorkerPool::WorkerPool(size_t threadsNumber):
+    mNextIndex(0)
+{
+    if (0 == threadsNumber)
+    {
+        threadsNumber = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 1; i < threadsNumber; ++i)
+    {
+        mWorkers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+//-------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mShutDown = true;
+    }
+    mWakeUp.notify_all();
+    for (auto & worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+//-------------------------------------------------------
+void WorkerPool::RunTasks(const std::function<void(size_t)> & task, size_t count)
+{
+    for (size_t i = mNextIndex.fetch_add(1); i < count; i = mNextIndex.fetch_add(1))
+    {
+        task(i);
+    }
+}
+//-------------------------------------------------------
+void WorkerPool::WorkerLoop()
+{
+    Profiler::GetInstance().SetThreadName("Worker");
+    uint64_t seenGeneration = 0;
+    for (;;)
+    {
+        const std::function<void(size_t)>* task = nullptr;
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWakeUp.wait(lock, [&]() { return mShutDown || mGeneration != seenGeneration; });
+            if (mShutDown)
+            {
+                return;
+            }
+            seenGeneration = mGeneration;
+            task = mTask;
+            count = mTaskSize;
+        }
+
+        RunTasks(*task, count);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mActiveWorkers;
+        }
+        mDone.notify_all();
+    }
+}
+//-------------------------------------------------------
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)> & task)
+{
+    if (mWorkers.empty() || count <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = &task;
+        mTaskSize = count;
+        mNextIndex = 0;
+        //every worker has to check in, so the task stays alive until the last one leaves it
+        mActiveWorkers = mWorkers.size();
+        ++mGeneration;
+    }
+    mWakeUp.notify_all();
+
+    RunTasks(task, count);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [&]() { return 0 == mActiveWorkers; });
+    mTask = nullptr;
+    mTaskSize = 0;
+}
+//-------------------------------------------------------
@@ -0,0 +1,73 @@
+/**
+* @file WorkerPool.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *	Fixed set of worker threads running data parallel loops
+ */
+class WorkerPool
+{
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mDone;
+
+    const std::function<void(size_t)>* mTask = nullptr;
+    size_t mTaskSize = 0;
+    std::atomic<size_t> mNextIndex;
+    size_t mActiveWorkers = 0;
+    uint64_t mGeneration = 0;
+    bool mShutDown = false;
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    //-------------------------------------------------------
+
+    void WorkerLoop();
+    void RunTasks(const std::function<void(size_t)> & task, size_t count);
+
+public:
+    /**
+     *	Create pool
+     *  @param threadsNumber - total number of threads including the calling one, 0 means hardware concurrency
+     */
+    explicit WorkerPool(size_t threadsNumber = 0);
+    ~WorkerPool();
+
+    /**
+     *	Number of threads executing tasks including the calling one
+     */
+    size_t GetThreadsNumber() const
+    {
+        return mWorkers.size() + 1;
+    }
+
+    /**
+     *	Run task(i) for every i from [0, count) and wait for completion.
+     *  The calling thread takes part in the work. Not reentrant.
+     */
+    void ParallelFor(size_t count, const std::function<void(size_t)> & task);
+};
+
+
+#endif
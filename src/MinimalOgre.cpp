@@ -42,11 +42,17 @@ This source file is part of the
 
 #include "Nature/Ground.h"
 #include "Nature/World.h"
+#include "Nature/ImageTileSource.h"
+#include "Nature/TerrainPager.h"
+#include "Nature/EternalForest.h"
+#include "Common/Profiler.h"
 
 const Ogre::Real MinimalOgre::ROTATION_VELOCITY = static_cast<Ogre::Real>(100.0);
 const Ogre::Real MinimalOgre::ZOOM_VELOCITY = static_cast<Ogre::Real>(1000.0);
 const Ogre::Real MinimalOgre::HEAD_SCALE_MIN = static_cast<Ogre::Real>(0.1);
 const Ogre::Real MinimalOgre::HEAD_SCALE_MAX = static_cast<Ogre::Real>(2.0);
+const size_t MinimalOgre::PROFILE_FRAMES = 300;
+const Ogre::String MinimalOgre::PROFILE_TRACE_NAME = "Frames.trace.json";
 
 //-------------------------------------------------------------------------------------
 MinimalOgre::MinimalOgre(void)
@@ -92,6 +98,8 @@ bool MinimalOgre::go(void)
 	mResourcesCfg = DATA_DIR"/resources.cfg";
 	mPluginsCfg = DATA_DIR"/plugins_d.cfg";
 #endif
+    Profiler::GetInstance().SetThreadName("Main");
+
     // construct Ogre::Root
     mRoot = new Ogre::Root(mPluginsCfg);
  
@@ -260,15 +268,30 @@ bool MinimalOgre::frameRenderingQueued(const Ogre::FrameEvent& evt)
  
     if(mShutDown)
         return false;
+
+    if (Profiler::GetInstance().NextFrame())
+    {
+        bool saved = Profiler::GetInstance().SaveTrace(PROFILE_TRACE_NAME);
+        Ogre::LogManager::getSingleton().logMessage("MinimalOgre: profile of " + Ogre::StringConverter::toString(PROFILE_FRAMES) + " frames " +
+            (saved ? "is saved to " : "can't be saved to ") + PROFILE_TRACE_NAME);
+    }
+    PROFILE_ZONE("Frame");
  
     //Need to capture/update each device
-    mKeyboard->capture();
-    mMouse->capture();
+    {
+        PROFILE_ZONE("Input capture");
+        mKeyboard->capture();
+        mMouse->capture();
+    }
  
-    mTrayMgr->frameRenderingQueued(evt);
+    {
+        PROFILE_ZONE("Tray update");
+        mTrayMgr->frameRenderingQueued(evt);
+    }
     
     if (!mTrayMgr->isDialogVisible())
     {
+        PROFILE_ZONE("Camera update");
         mCameraMan->frameRenderingQueued(evt);   // if dialog isn't up, then update the camera
         /*
         if (mDetailsPanel->isVisible())   // if details panel is visible, then update its contents
@@ -283,7 +306,12 @@ bool MinimalOgre::frameRenderingQueued(const Ogre::FrameEvent& evt)
         }*/
     }
     
-    mWorld->Update(static_cast<float>(mTimer.getMilliseconds()) / 1000.0f);
+    {
+        PROFILE_ZONE("World update");
+        mWorld->SetObserverPosition(mCamera->getDerivedPosition());
+        mWorld->UpdateGroundLod(mCamera, static_cast<float>(mCamera->getViewport()->getActualHeight()));
+        mWorld->Update(static_cast<float>(mTimer.getMilliseconds()) / 1000.0f);
+    }
  
     return true;
 }
@@ -309,6 +337,22 @@ bool MinimalOgre::keyPressed( const OIS::KeyEvent &arg )
             mTrayMgr->removeWidgetFromTray(mDetailsPanel);
             mDetailsPanel->hide();
         }*/
+        if (nullptr != mWorld->GetGround())
+        {
+            Ogre::LogManager::getSingleton().logMessage("MinimalOgre: ground triangles in view = " + Ogre::StringConverter::toString(mWorld->GetGround()->GetTrianglesNumber()));
+        }
+        if (nullptr != mWorld->GetTerrainPager())
+        {
+            const TerrainPager* pager = mWorld->GetTerrainPager();
+            Ogre::LogManager::getSingleton().logMessage("MinimalOgre: terrain tiles = " + Ogre::StringConverter::toString(pager->GetTilesNumber()) +
+                ", pending = " + Ogre::StringConverter::toString(pager->GetPendingTilesNumber()) + ", memory = " + Ogre::StringConverter::toString(pager->GetMemoryUsed() / 1024) + " KB");
+        }
+        if (nullptr != mWorld->GetForest())
+        {
+            const EternalForest* forest = mWorld->GetForest();
+            Ogre::LogManager::getSingleton().logMessage("MinimalOgre: forest cells evaluated per tick = " + Ogre::StringConverter::toString(forest->GetEvaluatedCellsNumber()) +
+                ", pending changes = " + Ogre::StringConverter::toString(forest->GetPendingChangesNumber()));
+        }
     }
     else if (arg.key == OIS::KC_T)   // cycle texture filtering mode
     {
@@ -368,6 +412,17 @@ bool MinimalOgre::keyPressed( const OIS::KeyEvent &arg )
         //mDetailsPanel->setParamValue(10, newVal);
         
     }
+    else if (arg.key == OIS::KC_J)   // skip forest generations
+    {
+        if (nullptr != mWorld->GetForest())
+        {
+            mWorld->GetForest()->FastForward(1000);
+        }
+    }
+    else if (arg.key == OIS::KC_P)   // capture a profile of the next frames
+    {
+        Profiler::GetInstance().StartCapture(PROFILE_FRAMES);
+    }
     else if(arg.key == OIS::KC_F5)   // refresh all textures
     {
         Ogre::TextureManager::getSingleton().reloadAll();
@@ -601,7 +656,12 @@ void MinimalOgre::SetupScene()
 
 	//mOgreHead = mSceneMgr->createEntity("Head", "ogrehead.mesh");
 
+#ifdef TERRAIN_TILES_DIR
+    //tiles of the same size and heights as the regions of the fixed ground
+    mWorld = std::make_unique<World>("Default", mSceneMgr, std::make_shared<ImageTileSource>(TERRAIN_TILES_DIR, "png", 64, 8.0f));
+#else
     mWorld = std::make_unique<World>("Default", mSceneMgr);
+#endif
 
 	// Set ambient light
 	mSceneMgr->setAmbientLight(Ogre::ColourValue(0.5, 0.5, 0.5));
@@ -67,6 +67,9 @@ protected:
     static const Ogre::Real ZOOM_VELOCITY;
     static const Ogre::Real HEAD_SCALE_MIN;
     static const Ogre::Real HEAD_SCALE_MAX;
+    //frames captured by the profiler after the P key
+    static const size_t PROFILE_FRAMES;
+    static const Ogre::String PROFILE_TRACE_NAME;
 
     Ogre::Timer mTimer;
 
@@ -11,159 +11,187 @@
 
 #include "EternalForest.h"
 
-#include <boost/multi_array.hpp>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <string>
 
+#include <OgreLogManager.h>
 #include <OgreSceneManager.h>
 #include <OgreEntity.h>
 #include <OgreSceneNode.h>
 
 #include "Ground.h"
 #include "World.h"
+#include "ForestSimulation.h"
+#include "LifeGrid.h"
+#include "../Common/Profiler.h"
 
 const float EternalForest::FIELD_BLOCK_SIZE  = 1.0f;
 const float EternalForest::FIELD_UPDATE_TICK = 1.0f;
+const size_t EternalForest::CHANGES_PER_FRAME = 256;
 //-------------------------------------------------------
 EternalForest::EternalForest(Ogre::SceneManager* sceneManager, const World* world, const Ground* ground, const Ogre::AxisAlignedBox & forestBorders):
     mBorders(forestBorders), mSceneManager(sceneManager), mGround(ground), mWorld(world), mUpdateTickController(FIELD_UPDATE_TICK)
 {
+    mFocus = mBorders.getCenter();
     
 }
 //-------------------------------------------------------
 EternalForest::~EternalForest()
 {
-
+    mTreePool.reset();
+}
+//-------------------------------------------------------
+ForestSimulation::HeightsSource EternalForest::GetHeightsSource() const
+{
+    const World* world = mWorld;
+    return [world](float x0, float z0, float dx, float dz, size_t countX, size_t countZ, float* heights)
+    {
+        world->GetGroundHeightsOnGrid(x0, z0, dx, dz, countX, countZ, heights, world->GetWorkerPool());
+    };
 }
 //-------------------------------------------------------
 void EternalForest::InitField(size_t startAmount)
 {
-    Ogre::Vector3 minBorder = mBorders.getMinimum();
-    Ogre::Vector3 maxBorder = mBorders.getMaximum();
+    const Ogre::Vector3 & minBorder = mBorders.getMinimum();
+    const Ogre::Vector3 & maxBorder = mBorders.getMaximum();
 
-    uint32_t fieldSizeX = static_cast<uint32_t>((maxBorder[0] - minBorder[0]) / FIELD_BLOCK_SIZE);
-    uint32_t fieldSizeZ = static_cast<uint32_t>((maxBorder[2] - minBorder[2]) / FIELD_BLOCK_SIZE);
+    mSimulation = std::make_unique<ForestSimulation>(minBorder[0], minBorder[2], maxBorder[0], maxBorder[2], minBorder[1], maxBorder[1], FIELD_BLOCK_SIZE,
+        static_cast<uint32_t>(std::rand()));
+    mSimulation->SetTreesQuota(mTreesQuota);
+    mSimulation->SetFocus(mFocus[0], mFocus[2]);
 
-    mFieldOffset[0] = 0.5f * std::fmod(maxBorder[0] - minBorder[0], FIELD_BLOCK_SIZE) + minBorder[0];
-    mFieldOffset[1] = 0.5f * std::fmod(maxBorder[0] - minBorder[0], FIELD_BLOCK_SIZE) + minBorder[2];
+    mTreesChunksX = (mSimulation->GetWidth() + LifeGrid::CHUNK_SIZE - 1) / LifeGrid::CHUNK_SIZE;
+    mTrees.clear();
+    mTrees.resize(mTreesChunksX * ((mSimulation->GetHeight() + LifeGrid::CHUNK_SIZE - 1) / LifeGrid::CHUNK_SIZE));
+    mTreePool = std::make_unique<TreePool>(mSceneManager, "tree_1.mesh", Ogre::Vector3(0.0005f, 0.0005f, 0.0005f), mSceneManager->getRootSceneNode(), mTreesQuota, mRenderMode);
 
-    mLifeField = std::make_unique<LifeField>(boost::extents[fieldSizeZ][fieldSizeX]);
-    mLifeFieldNext = std::make_unique<LifeField>(boost::extents[fieldSizeZ][fieldSizeX]);
-    
-    LifeField& field = *mLifeField;
-    for (uint32_t z = 0; z < fieldSizeZ; ++z)
+    mSimulation->Init(GetHeightsSource(), startAmount);
+}
+//-------------------------------------------------------
+void EternalForest::RefreshArea(float minX, float minZ, float maxX, float maxZ)
+{
+    //InitField reads all heights later
+    if (nullptr == mSimulation.get())
     {
-        for (uint32_t x = 0; x < fieldSizeX; ++x)
-        {
-            if (z == 0 || z == fieldSizeZ - 1 || x == 0 || x == fieldSizeX - 1)
-            {
-                field[z][x].flags = BlockInfo::BLOCKED;
-                continue;
-            }
-            float s = mFieldOffset[0] + (x + 0.5f) * FIELD_BLOCK_SIZE;
-            float t = mFieldOffset[1] + (z + 0.5f) * FIELD_BLOCK_SIZE;
-            float h = mWorld->GetGroundHeightAt(s, t);
-            field[z][x].flags = (h >= minBorder[1] && h <= maxBorder[1]) ? BlockInfo::EMPTY : BlockInfo::BLOCKED;
-            field[z][x]._height = h;
-        }
+        return;
+    }
+    mSimulation->RefreshArea(minX, minZ, maxX, maxZ, GetHeightsSource());
+}
+//-------------------------------------------------------
+TreePool::Handle & EternalForest::GetTree(uint32_t x, uint32_t z)
+{
+    std::unique_ptr<TreePool::Handle[]> & chunk = mTrees[(z / LifeGrid::CHUNK_SIZE) * mTreesChunksX + x / LifeGrid::CHUNK_SIZE];
+    if (nullptr == chunk.get())
+    {
+        chunk.reset(new TreePool::Handle[LifeGrid::CHUNK_SIZE * LifeGrid::CHUNK_SIZE]);
+        std::fill_n(chunk.get(), LifeGrid::CHUNK_SIZE * LifeGrid::CHUNK_SIZE, TreePool::INVALID_HANDLE);
     }
+    return chunk[(z % LifeGrid::CHUNK_SIZE) * LifeGrid::CHUNK_SIZE + x % LifeGrid::CHUNK_SIZE];
+}
+//-------------------------------------------------------
+void EternalForest::PlantTree(uint32_t x, uint32_t z)
+{
+    TreePool::Handle & tree = GetTree(x, z);
+    assert(TreePool::INVALID_HANDLE == tree);
+
+    Ogre::Vector3 position;
+    mSimulation->GetCellPosition(x, z, position[0], position[1], position[2]);
+    tree = mTreePool->Acquire(position);
+}
+//-------------------------------------------------------
+void EternalForest::CutTree(uint32_t x, uint32_t z)
+{
+    TreePool::Handle & tree = GetTree(x, z);
+    assert(TreePool::INVALID_HANDLE != tree);
 
-    //generate random start positions
-    size_t amount = std::min(startAmount, fieldSizeX * fieldSizeZ);
-    while (amount > 0)
+    mTreePool->Release(tree);
+    tree = TreePool::INVALID_HANDLE;
+}
+//-------------------------------------------------------
+void EternalForest::ApplyChanges(size_t budget)
+{
+    PROFILE_ZONE("Forest apply changes");
+    uint32_t width = static_cast<uint32_t>(mSimulation->GetWidth());
+    mChanges.clear();
+    mSimulation->TakeChanges(budget, mChanges);
+    for (const LifeChange & change : mChanges)
     {
-        uint8_t attempts = 0;
-        while (attempts < 10)
+        uint32_t x = change.cell % width;
+        uint32_t z = change.cell / width;
+        if (LifeChange::BORN == change.type)
+        {
+            PlantTree(x, z);
+        }
+        else
         {
-            uint32_t x = static_cast<uint32_t>(Ogre::Math::UnitRandom() * fieldSizeX);
-            uint32_t z = static_cast<uint32_t>(Ogre::Math::UnitRandom() * fieldSizeZ);
-            if ((*mLifeField)[z][x].flags & BlockInfo::EMPTY)
-            {
-                (*mLifeField)[z][x].flags = BlockInfo::TREE;
-                auto tree = mSceneManager->createEntity("tree_1.mesh");
-                auto node = mSceneManager->getRootSceneNode()->createChildSceneNode();
-                node->setScale(0.0005f, 0.0005f, 0.0005f);
-                node->setPosition(Ogre::Vector3(mFieldOffset[0] + (x + 0.5f) * FIELD_BLOCK_SIZE, (*mLifeField)[z][x]._height, mFieldOffset[1] + (z + 0.5f) * FIELD_BLOCK_SIZE));
-                node->attachObject(tree);
-                (*mLifeField)[z][x].treeNode = node;
-                break;
-            }
-            ++attempts;
+            CutTree(x, z);
         }
-        --amount;
     }
 }
 //-------------------------------------------------------
-void EternalForest::UpdateField(float time, size_t quota)
+void EternalForest::FastForward(uint64_t generations)
 {
-    LifeField& field = *mLifeField;
-    uint32_t width =  mLifeField->shape()[0];
-    uint32_t height = mLifeField->shape()[1];
-
-    for (uint32_t z = 1; z < height - 1; ++z)
+    if (nullptr == mSimulation.get())
     {
-        for (uint32_t x = 1; x < width - 1; ++x)
-        {
-            BlockInfo& current = field[z][x];
-            BlockInfo& next = (*mLifeFieldNext)[z][x];
-            assert(current.flags == BlockInfo::BLOCKED || current.flags == BlockInfo::TREE || current.flags == BlockInfo::EMPTY);
+        InitField(mTreesQuota);
+    }
 
-            next = current;
-            if (0 == (current.flags & BlockInfo::BLOCKED))
-            {
-                auto neighbors = {
-                    field[z - 1][x - 1].flags,
-                    field[z - 1][x].flags,
-                    field[z - 1][x + 1].flags,
-                    field[z][x - 1].flags,
-                    field[z][x + 1].flags,
-                    field[z + 1][x - 1].flags,
-                    field[z + 1][x].flags,
-                    field[z + 1][x + 1].flags
-                };
-                uint8_t sum = 0;
-                std::for_each(std::cbegin(neighbors), std::cend(neighbors), [&sum](const uint8_t& flags)->void { if(flags & BlockInfo::TREE) ++sum; });
-                if (current.flags & BlockInfo::TREE)
-                {
-                    if (sum < 3 || sum > 4)
-                    {
-                        current.treeNode->detachAllObjects();
-                        current.treeNode->removeAndDestroyAllChildren();
-                        current.treeNode = nullptr;
+    auto start = std::chrono::high_resolution_clock::now();
+    mSimulation->FastForward(generations);
+    auto stop = std::chrono::high_resolution_clock::now();
+    size_t changes = mSimulation->GetPendingChangesNumber();
 
-                        next.flags = BlockInfo::EMPTY;
-                        next.treeNode = nullptr;
-                    }
-                }
-                else if (current.flags & BlockInfo::EMPTY)
-                {
-                    if (sum >= 3 && sum <= 4)
-                    {
-                        auto tree = mSceneManager->createEntity("tree_1.mesh");
-                        auto node = mSceneManager->getRootSceneNode()->createChildSceneNode();
-                        node->setScale(0.0005f, 0.0005f, 0.0005f);
-                        node->setPosition(Ogre::Vector3(mFieldOffset[0] + (x + 0.5f) * FIELD_BLOCK_SIZE, (*mLifeField)[z][x]._height, mFieldOffset[1] + (z + 0.5f) * FIELD_BLOCK_SIZE));
-                        node->attachObject(tree);
+    ApplyChanges(0);
 
-                        next.flags = BlockInfo::TREE;
-                        next.treeNode = node;
-                    }
-                }
-            }
-        }
+    Ogre::LogManager::getSingleton().logMessage("EternalForest: fast forward " + std::to_string(generations) + " generations " +
+        std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()) + " ms, " +
+        std::to_string(changes) + " changes, " + std::to_string(mSimulation->GetFastForwardNodesNumber()) + " nodes");
+}
+//-------------------------------------------------------
+void EternalForest::SetTreesQuota(size_t quota)
+{
+    mTreesQuota = quota;
+    if (nullptr != mSimulation.get())
+    {
+        mSimulation->SetTreesQuota(quota);
     }
-    mLifeField.swap(mLifeFieldNext);
+}
+//-------------------------------------------------------
+void EternalForest::SetFocus(const Ogre::Vector3 & focus)
+{
+    mFocus = focus;
+    if (nullptr != mSimulation.get())
+    {
+        mSimulation->SetFocus(focus[0], focus[2]);
+    }
+}
+//-------------------------------------------------------
+size_t EternalForest::GetPendingChangesNumber() const
+{
+    return (nullptr != mSimulation.get()) ? mSimulation->GetPendingChangesNumber() : 0;
+}
+//-------------------------------------------------------
+size_t EternalForest::GetEvaluatedCellsNumber() const
+{
+    return (nullptr != mSimulation.get()) ? mSimulation->GetEvaluatedCellsNumber() : 0;
 }
 //-------------------------------------------------------
 void EternalForest::Update(float time)
 {
-    if (nullptr == mLifeField.get())
+    PROFILE_ZONE("Forest update");
+    if (nullptr == mSimulation.get())
     {
-        InitField(6 * mTreesQuota);
+        InitField(mTreesQuota);
     }
     else
     {
         if (mUpdateTickController.Tick(time))
         {
-            UpdateField(time, mTreesQuota);
+            mSimulation->Tick(mWorld->GetWorkerPool());
         }
     }
+    ApplyChanges(mChangesPerFrame);
 }
\ No newline at end of file
@@ -14,19 +14,17 @@
 
 #include <memory>
 #include <cstdint>
+#include <vector>
 
 #include <OgrePrerequisites.h>
 #include <OgreCommon.h>
 #include <OgreAxisAlignedBox.h>
-#include <OgreVector2.h>
+#include <OgreVector3.h>
 
 #include "../Common/Controllers.h"
-
-namespace boost
-{
-    template<typename T, std::size_t NumDims, typename Allocator>
-    class multi_array;
-}
+#include "ForestSimulation.h"
+#include "LifeKernel.h"
+#include "TreePool.h"
 
 namespace Ogre
 {
@@ -38,25 +36,14 @@ namespace Ogre
 class Ground;
 class World;
 
+/**
+ *	Scene view of the forest simulation: mirrors births and deaths of the simulated field into trees of the pool
+ */
 class EternalForest
 {
-    struct BlockInfo
-    {
-        enum : uint8_t
-        {
-            EMPTY = 1,
-            BLOCKED = 2,
-            TREE = 4
-        };
-
-        Ogre::SceneNode* treeNode = nullptr;
-        uint8_t flags = EMPTY;
-        float _height = 0.0f;
-    };
-    using LifeField = boost::multi_array<BlockInfo, 2, std::allocator<BlockInfo> >;
-
     static const float FIELD_BLOCK_SIZE;
     static const float FIELD_UPDATE_TICK;
+    static const size_t CHANGES_PER_FRAME;
 
     Ogre::SceneManager* mSceneManager;
     const World* mWorld;
@@ -65,15 +52,37 @@ class EternalForest
     size_t mTreesQuota = 1000;
     Ogre::AxisAlignedBox mBorders;
 
-    std::unique_ptr<LifeField> mLifeField;
-    std::unique_ptr<LifeField> mLifeFieldNext;
-    Ogre::Vector2 mFieldOffset = Ogre::Vector2::ZERO;
+    std::unique_ptr<ForestSimulation> mSimulation;
+    //trees of the field cells, chunks of the field are allocated by the first tree
+    std::vector<std::unique_ptr<TreePool::Handle[]> > mTrees;
+    size_t mTreesChunksX = 0;
+    std::unique_ptr<TreePool> mTreePool;
+    //the pool falls back to separate nodes if hardware instancing is not supported
+    TreePool::Mode mRenderMode = TreePool::MODE_INSTANCED;
+    std::vector<LifeChange> mChanges;
+    size_t mChangesPerFrame = CHANGES_PER_FRAME;
+    Ogre::Vector3 mFocus;
 
     TimeStepController<float> mUpdateTickController;
 
 protected:
     void InitField(size_t startAmount);
-    void UpdateField(float time, size_t quota);
+
+    /**
+     *	Ground heights of the world for the simulation
+     */
+    ForestSimulation::HeightsSource GetHeightsSource() const;
+
+    TreePool::Handle & GetTree(uint32_t x, uint32_t z);
+
+    void PlantTree(uint32_t x, uint32_t z);
+    void CutTree(uint32_t x, uint32_t z);
+
+    /**
+     *	Mirror queued births and deaths into the scene
+     *  @param budget - max number of changes to apply
+     */
+    void ApplyChanges(size_t budget);
 
 public:
     /**
@@ -90,6 +99,71 @@ public:
      *	Update
      */
     void Update(float time);
+
+    /**
+     *	Skip a number of generations at once, pending and skipped changes are mirrored into the scene immediately.
+     *  The trees quota is applied to the final state only.
+     */
+    void FastForward(uint64_t generations);
+
+    /**
+     *	Re-read ground heights of the cells inside a world space XZ rectangle, e.g. after the terrain there was loaded or unloaded.
+     *  Cells without ground become blocked and lose their trees.
+     */
+    void RefreshArea(float minX, float minZ, float maxX, float maxZ);
+
+    /**
+     *	Set max number of living trees
+     */
+    void SetTreesQuota(size_t quota);
+
+    /**
+     *	Births closer to the focus point are preferred when the trees quota is reached
+     */
+    void SetFocus(const Ogre::Vector3 & focus);
+
+    /**
+     *	Limit scene changes applied per Update call, 0 means no limit
+     */
+    void SetChangesPerFrame(size_t changes)
+    {
+        mChangesPerFrame = changes;
+    }
+
+    /**
+     *	Number of simulated changes not yet mirrored into the scene
+     */
+    size_t GetPendingChangesNumber() const;
+
+    /**
+     *	Number of field cells computed by the last tick, only cells near the last changes are computed
+     */
+    size_t GetEvaluatedCellsNumber() const;
+
+    /**
+     *	Select how trees are rendered, has effect only before the first Update.
+     *  Trees are instanced by default, instanced mode falls back to separate scene nodes if hardware instancing is not supported.
+     */
+    void SetRenderMode(TreePool::Mode mode)
+    {
+        mRenderMode = mode;
+    }
+
+    /**
+     *	Simulated field, nullptr until the first Update
+     */
+    const ForestSimulation* GetSimulation() const
+    {
+        return mSimulation.get();
+    }
+
+    /**
+     *	Pool of tree objects, nullptr until the field is initialized
+     */
+    const TreePool* GetTreePool() const
+    {
+        return mTreePool.get();
+    }
 };
 
 
@@ -0,0 +1,208 @@
+/**
+* @file ForestSimulation.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "ForestSimulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "LifeGrid.h"
+#include "LifeHashlife.h"
+#include "../Common/Profiler.h"
+
+//-------------------------------------------------------
+ForestSimulation::ForestSimulation(float minX, float minZ, float maxX, float maxZ, float minHeight, float maxHeight, float cellSize, uint32_t seed):
+    mCellSize(cellSize), mMinHeight(minHeight), mMaxHeight(maxHeight), mRandom(seed)
+{
+    uint32_t fieldSizeX = static_cast<uint32_t>((maxX - minX) / mCellSize);
+    uint32_t fieldSizeZ = static_cast<uint32_t>((maxZ - minZ) / mCellSize);
+
+    mOffsetX = 0.5f * std::fmod(maxX - minX, mCellSize) + minX;
+    mOffsetZ = 0.5f * std::fmod(maxX - minX, mCellSize) + minZ;
+
+    mFocusX = 0.5f * (minX + maxX);
+    mFocusZ = 0.5f * (minZ + maxZ);
+
+    mField = std::make_unique<LifeGrid>(fieldSizeX, fieldSizeZ);
+}
+//-------------------------------------------------------
+ForestSimulation::~ForestSimulation()
+{
+
+}
+//-------------------------------------------------------
+void ForestSimulation::Init(const HeightsSource & heightsSource, size_t startAmount)
+{
+    PROFILE_ZONE("Forest init");
+    LifeGrid& field = *mField;
+    const uint32_t fieldSizeX = static_cast<uint32_t>(field.GetWidth());
+    const uint32_t fieldSizeZ = static_cast<uint32_t>(field.GetHeight());
+
+    //ground heights at the cells centers
+    std::vector<float> heights(static_cast<size_t>(fieldSizeX) * fieldSizeZ);
+    heightsSource(mOffsetX + 0.5f * mCellSize, mOffsetZ + 0.5f * mCellSize, mCellSize, mCellSize, fieldSizeX, fieldSizeZ, heights.data());
+
+    for (uint32_t z = 0; z < fieldSizeZ; ++z)
+    {
+        for (uint32_t x = 0; x < fieldSizeX; ++x)
+        {
+            if (z == 0 || z == fieldSizeZ - 1 || x == 0 || x == fieldSizeX - 1)
+            {
+                continue;
+            }
+            float h = heights[static_cast<size_t>(z) * fieldSizeX + x];
+            if (h >= mMinHeight && h <= mMaxHeight)
+            {
+                field.SetFree(x, z, true, h);
+            }
+        }
+    }
+
+    //generate random start positions
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    size_t amount = std::min(startAmount, static_cast<size_t>(fieldSizeX) * fieldSizeZ);
+    while (amount > 0)
+    {
+        uint8_t attempts = 0;
+        while (attempts < 10)
+        {
+            uint32_t x = static_cast<uint32_t>(unit(mRandom) * fieldSizeX);
+            uint32_t z = static_cast<uint32_t>(unit(mRandom) * fieldSizeZ);
+            if (field.SetAlive(x, z, true))
+            {
+                mPendingChanges.push_back({ field.GetCellIndex(x, z), LifeChange::BORN });
+                break;
+            }
+            ++attempts;
+        }
+        --amount;
+    }
+}
+//-------------------------------------------------------
+void ForestSimulation::RefreshArea(float minX, float minZ, float maxX, float maxZ, const HeightsSource & heightsSource)
+{
+    PROFILE_ZONE("Forest refresh area");
+    LifeGrid& field = *mField;
+
+    //cells with centers inside the area, border cells stay blocked
+    auto firstCell = [this](float coord, float offset, size_t size)
+    {
+        float cell = std::ceil((coord - offset) / mCellSize - 0.5f);
+        return static_cast<uint32_t>(std::min(std::max(cell, 1.0f), static_cast<float>(size - 1)));
+    };
+    uint32_t x0 = firstCell(minX, mOffsetX, field.GetWidth());
+    uint32_t x1 = firstCell(maxX, mOffsetX, field.GetWidth());
+    uint32_t z0 = firstCell(minZ, mOffsetZ, field.GetHeight());
+    uint32_t z1 = firstCell(maxZ, mOffsetZ, field.GetHeight());
+    if (x0 >= x1 || z0 >= z1)
+    {
+        return;
+    }
+
+    const uint32_t countX = x1 - x0;
+    const uint32_t countZ = z1 - z0;
+    std::vector<float> heights(static_cast<size_t>(countX) * countZ);
+    heightsSource(mOffsetX + (x0 + 0.5f) * mCellSize, mOffsetZ + (z0 + 0.5f) * mCellSize, mCellSize, mCellSize, countX, countZ, heights.data());
+
+    size_t freed = 0;
+    for (uint32_t z = z0; z < z1; ++z)
+    {
+        for (uint32_t x = x0; x < x1; ++x)
+        {
+            float h = heights[static_cast<size_t>(z - z0) * countX + (x - x0)];
+            bool free = h >= mMinHeight && h <= mMaxHeight;
+            if (!free && field.IsAlive(x, z))
+            {
+                mPendingChanges.push_back({ field.GetCellIndex(x, z), LifeChange::DIED });
+            }
+            if (free && !field.IsFree(x, z))
+            {
+                ++freed;
+            }
+            field.SetFree(x, z, free, h);
+        }
+    }
+
+    //seed the new ground at the rate of Init, which spreads the trees quota over the whole field area,
+    //seeds are not limited by LimitPopulation, so they can't take more than the quota left
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    size_t seeds = freed * mTreesQuota / (field.GetWidth() * field.GetHeight());
+    seeds = std::min(seeds, mTreesQuota - std::min(mTreesQuota, field.GetAliveCount()));
+    for (size_t i = 0; i < seeds; ++i)
+    {
+        uint32_t x = std::min(x0 + static_cast<uint32_t>(unit(mRandom) * countX), x1 - 1);
+        uint32_t z = std::min(z0 + static_cast<uint32_t>(unit(mRandom) * countZ), z1 - 1);
+        if (field.SetAlive(x, z, true))
+        {
+            mPendingChanges.push_back({ field.GetCellIndex(x, z), LifeChange::BORN });
+        }
+    }
+}
+//-------------------------------------------------------
+void ForestSimulation::QueueChanges()
+{
+    mField->LimitPopulation(mChanges, mTreesQuota, (mFocusX - mOffsetX) / mCellSize - 0.5f, (mFocusZ - mOffsetZ) / mCellSize - 0.5f);
+    mPendingChanges.insert(mPendingChanges.end(), mChanges.cbegin(), mChanges.cend());
+}
+//-------------------------------------------------------
+void ForestSimulation::Tick(WorkerPool* pool)
+{
+    PROFILE_ZONE("Forest tick");
+    mField->Step(mChanges, pool);
+    QueueChanges();
+}
+//-------------------------------------------------------
+void ForestSimulation::FastForward(uint64_t generations)
+{
+    PROFILE_ZONE("Forest fast forward");
+    if (nullptr == mHashlife.get())
+    {
+        mHashlife = std::make_unique<LifeHashlife>();
+    }
+    mHashlife->Advance(*mField, generations, mChanges);
+    QueueChanges();
+}
+//-------------------------------------------------------
+size_t ForestSimulation::TakeChanges(size_t budget, std::vector<LifeChange> & changes)
+{
+    size_t count = (0 == budget) ? mPendingChanges.size() : std::min(budget, mPendingChanges.size());
+    changes.insert(changes.end(), mPendingChanges.cbegin(), mPendingChanges.cbegin() + count);
+    mPendingChanges.erase(mPendingChanges.cbegin(), mPendingChanges.cbegin() + count);
+    return count;
+}
+//-------------------------------------------------------
+size_t ForestSimulation::GetWidth() const
+{
+    return mField->GetWidth();
+}
+//-------------------------------------------------------
+size_t ForestSimulation::GetHeight() const
+{
+    return mField->GetHeight();
+}
+//-------------------------------------------------------
+void ForestSimulation::GetCellPosition(uint32_t x, uint32_t z, float & worldX, float & worldY, float & worldZ) const
+{
+    worldX = mOffsetX + (x + 0.5f) * mCellSize;
+    worldY = mField->GetCellHeight(x, z);
+    worldZ = mOffsetZ + (z + 0.5f) * mCellSize;
+}
+//-------------------------------------------------------
+size_t ForestSimulation::GetEvaluatedCellsNumber() const
+{
+    return mField->GetEvaluatedCellsNumber();
+}
+//-------------------------------------------------------
+size_t ForestSimulation::GetFastForwardNodesNumber() const
+{
+    return (nullptr != mHashlife.get()) ? mHashlife->GetNodesNumber() : 0;
+}
+//-------------------------------------------------------
@@ -0,0 +1,172 @@
+/**
+* @file ForestSimulation.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _FOREST_SIMULATION_H_
+#define _FOREST_SIMULATION_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "LifeKernel.h"
+
+class LifeGrid;
+class LifeHashlife;
+class WorkerPool;
+
+/**
+ *	Forest life field without any scene objects: free cells from the ground heights, seeding, generations, population limit.
+ *  Every change of the field is queued, a view takes the queued changes and mirrors them into the scene at its own pace.
+ *  The field covers an XZ rectangle of the world by square cells, coordinates in the interface are world space ones.
+ */
+class ForestSimulation
+{
+public:
+    /**
+     *	Heights at the points (x0 + i * dx, z0 + j * dz), i from [0, countX), j from [0, countZ), row by row along X
+     */
+    using HeightsSource = std::function<void(float x0, float z0, float dx, float dz, size_t countX, size_t countZ, float* heights)>;
+
+private:
+    float mCellSize;
+    float mOffsetX;
+    float mOffsetZ;
+    float mMinHeight;
+    float mMaxHeight;
+
+    std::unique_ptr<LifeGrid> mField;
+    //kept between fast forwards, so the memoized nodes are reused
+    std::unique_ptr<LifeHashlife> mHashlife;
+
+    size_t mTreesQuota = 1000;
+    float mFocusX;
+    float mFocusZ;
+    std::mt19937 mRandom;
+
+    std::vector<LifeChange> mChanges;
+    std::deque<LifeChange> mPendingChanges;
+
+    ForestSimulation(const ForestSimulation&) = delete;
+    ForestSimulation& operator=(const ForestSimulation&) = delete;
+    //-------------------------------------------------------
+
+    /**
+     *	Reject births over the trees quota and queue the changes
+     */
+    void QueueChanges();
+
+public:
+    /**
+     *	Create empty field, all cells are blocked until Init
+     *  @param minX, minZ, maxX, maxZ - world space XZ rectangle of the field
+     *  @param minHeight, maxHeight - ground heights where trees can grow
+     *  @param cellSize - side of a cell
+     *  @param seed - seed of the random start positions
+     */
+    ForestSimulation(float minX, float minZ, float maxX, float maxZ, float minHeight, float maxHeight, float cellSize, uint32_t seed = 0);
+    /**
+     *	Destructor
+     */
+    ~ForestSimulation();
+
+    /**
+     *	Read ground heights of all cells and plant random trees
+     *  @param startAmount - number of attempts to plant a tree
+     */
+    void Init(const HeightsSource & heights, size_t startAmount);
+
+    /**
+     *	Re-read ground heights of the cells inside a world space XZ rectangle, e.g. after the terrain there was loaded or unloaded.
+     *  Cells without ground become blocked and lose their trees, the new ground is seeded with the density of the initial trees.
+     */
+    void RefreshArea(float minX, float minZ, float maxX, float maxZ, const HeightsSource & heights);
+
+    /**
+     *	Compute the next generation
+     *  @param pool - optional threads to split the field
+     */
+    void Tick(WorkerPool* pool = nullptr);
+
+    /**
+     *	Skip a number of generations at once, only the difference with the final state is queued.
+     *  The trees quota is applied to the final state only.
+     */
+    void FastForward(uint64_t generations);
+
+    /**
+     *	Move queued changes out in the order they happened
+     *  @param budget - max number of changes to take, 0 means all
+     *  @param changes - output, the changes are appended
+     *  @return number of taken changes
+     */
+    size_t TakeChanges(size_t budget, std::vector<LifeChange> & changes);
+
+    /**
+     *	Number of changes not yet taken by the view
+     */
+    size_t GetPendingChangesNumber() const
+    {
+        return mPendingChanges.size();
+    }
+
+    /**
+     *	Set max number of living trees
+     */
+    void SetTreesQuota(size_t quota)
+    {
+        mTreesQuota = quota;
+    }
+
+    size_t GetTreesQuota() const
+    {
+        return mTreesQuota;
+    }
+
+    /**
+     *	Births closer to the world space XZ focus point are preferred when the trees quota is reached
+     */
+    void SetFocus(float x, float z)
+    {
+        mFocusX = x;
+        mFocusZ = z;
+    }
+
+    const LifeGrid & GetField() const
+    {
+        return *mField;
+    }
+
+    size_t GetWidth() const;
+
+    size_t GetHeight() const;
+
+    /**
+     *	World space position of a cell center, the height is the ground height read for the cell
+     */
+    void GetCellPosition(uint32_t x, uint32_t z, float & worldX, float & worldY, float & worldZ) const;
+
+    /**
+     *	Number of field cells computed by the last tick, only cells near the last changes are computed
+     */
+    size_t GetEvaluatedCellsNumber() const;
+
+    /**
+     *	Number of nodes kept by the fast forward between calls
+     */
+    size_t GetFastForwardNodesNumber() const;
+};
+
+
+#endif
@@ -11,10 +11,18 @@
 
 #include "Ground.h"
 
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
 #include <OgreEntity.h>
 #include <OgreTexture.h>
 #include <OgreTextureManager.h>
-#include <OgreManualObject.h>
+#include <OgreMeshManager.h>
+#include <OgreHardwareBufferManager.h>
+#include <OgreLogManager.h>
 #include <OgreSceneManager.h>
 #include <OgreMesh.h>
 #include <OgreSubMesh.h>
@@ -27,6 +35,13 @@
 #include <OgrePass.h>
 #include <OgreSceneNode.h>
 #include <OgreImage.h>
+#include <OgrePlaneBoundedVolume.h>
+#include <OgreTimer.h>
+#include <OgreCamera.h>
+
+#include "HeightFile.h"
+#include "../Common/WorkerPool.h"
+#include "../Common/Profiler.h"
 
 namespace
 {
@@ -58,6 +73,33 @@ const size_t Ground::GROUND_SIZE = 512;
 const size_t Ground::REGION_SIZE = 64;
 const size_t Ground::REGIONS_NUMBER = 10;
 
+const float Ground::VERTEX_STEP = 1.0f;
+const float Ground::HEIGHT_STEP = 8.0f;
+const size_t Ground::VERTEX_SIZE = 3 * sizeof(float) + sizeof(Ogre::uint32) + 2 * sizeof(float);
+
+const size_t Ground::LOD_LEVELS = 4;
+const float Ground::LOD_PIXEL_ERROR = 2.0f;
+
+namespace
+{
+    //mesh cache file, the version has to be changed together with the vertex format
+    static const char GEOMETRY_CACHE_MAGIC[4] = { 'O', 'N', 'G', 'C' };
+    static const uint64_t GEOMETRY_CACHE_VERSION = 1;
+    //64 bits FNV-1a
+    static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+    struct GeometryCacheHeader
+    {
+        char magic[4];
+        uint32_t regions;
+        uint32_t lodLevels;
+        uint32_t reserved;
+        uint64_t key;
+        uint64_t regionVerticesSize;
+    };
+}
+
 
 //-------------------------------------------------------
 Ogre::Material* Ground::CreateGroundMaterialTextured(const std::string & name, const Ogre::Image* texture)
@@ -90,9 +132,8 @@ Ogre::Material* Ground::CreateGroundMaterialTextured(const std::string & name, c
             pass->setFragmentProgram(fprogram->getName());
         }
     }
-#if !NDEBUG
+    //compile shaders now rather than on the first frame
     material->load();
-#endif
     return material.get();
 }
 //-------------------------------------------------------
@@ -105,36 +146,41 @@ std::pair<bool, float> Ground::GetVertexIntersection(const Ogre::Ray & ray, cons
     
     Ogre::HardwareVertexBufferSharedPtr vbuffer = subMesh->vertexData->vertexBufferBinding->getBuffer(posElem->getSource());
 
-    unsigned char* vertexes = reinterpret_cast<unsigned char*>(vbuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
-
     size_t count = subMesh->vertexData->vertexCount;
+    OgreAssert(count == (REGION_SIZE + 1) * (REGION_SIZE + 1), "Wrong buffer size");
 
-    float intersection = -1.0f;
-
-    OgreAssert(count == REGION_SIZE * REGION_SIZE * 4, "Wrong buffer size");
-    float* pReal;
-    for (size_t i = 0; i < REGION_SIZE * REGION_SIZE; ++i)
+    std::vector<Ogre::Vector3> positions(count);
     {
-        Ogre::Vector3 v0, v1, v2, v3;
-        for (auto vp : { &v0, &v1, &v2, &v3 })
+        unsigned char* vertexes = reinterpret_cast<unsigned char*>(vbuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+        float* pReal;
+        for (size_t i = 0; i < count; ++i)
         {
             posElem->baseVertexPointerToElement(vertexes, &pReal);
-            *vp = Ogre::Vector3(pReal[0], pReal[1], pReal[2]);
+            positions[i] = Ogre::Vector3(pReal[0], pReal[1], pReal[2]);
             vertexes += vbuffer->getVertexSize();
         }
+        vbuffer->unlock();
+    }
 
-        auto hit1 = Ogre::Math::intersects(ray, v1, v2, v0, true, false);
-        if (hit1.first && (intersection < 0.0f || hit1.second < intersection))
-        {
-            intersection = hit1.second;
-        }
-        auto hit2 = Ogre::Math::intersects(ray, v3, v2, v1, true, false);
-        if (hit2.first && (intersection < 0.0f || hit2.second < intersection))
+    const Ogre::IndexData* indexData = subMesh->indexData;
+    Ogre::HardwareIndexBufferSharedPtr ibuffer = indexData->indexBuffer;
+    const bool indexes32 = (Ogre::HardwareIndexBuffer::IT_32BIT == ibuffer->getType());
+    const void* indexes = ibuffer->lock(Ogre::HardwareBuffer::HBL_READ_ONLY);
+    auto getIndex = [&](size_t i) -> size_t
+    {
+        return indexes32 ? static_cast<const uint32_t*>(indexes)[indexData->indexStart + i] : static_cast<const uint16_t*>(indexes)[indexData->indexStart + i];
+    };
+
+    float intersection = -1.0f;
+    for (size_t i = 0; i + 2 < indexData->indexCount; i += 3)
+    {
+        auto hit = Ogre::Math::intersects(ray, positions[getIndex(i)], positions[getIndex(i + 1)], positions[getIndex(i + 2)], true, false);
+        if (hit.first && (intersection < 0.0f || hit.second < intersection))
         {
-            intersection = hit2.second;
+            intersection = hit.second;
         }
     }
-    vbuffer->unlock();
+    ibuffer->unlock();
     if (intersection >= 0.0f)
     {
         return std::make_pair(true, intersection);
@@ -142,6 +188,49 @@ std::pair<bool, float> Ground::GetVertexIntersection(const Ogre::Ray & ray, cons
     return std::make_pair(false, -1.0f);
 }
 //-------------------------------------------------------
+void Ground::BuildLodIndexes(size_t step, unsigned stitchedEdges, std::vector<uint16_t> & indexes)
+{
+    const size_t side = REGION_SIZE + 1;
+    auto vertex = [&](size_t x, size_t y) -> uint16_t
+    {
+        if ((0 == x && (stitchedEdges & EDGE_LEFT)) || (REGION_SIZE == x && (stitchedEdges & EDGE_RIGHT)))
+        {
+            y -= y % (2 * step);
+        }
+        else if ((0 == y && (stitchedEdges & EDGE_BOTTOM)) || (REGION_SIZE == y && (stitchedEdges & EDGE_TOP)))
+        {
+            x -= x % (2 * step);
+        }
+        return static_cast<uint16_t>(y * side + x);
+    };
+    //stitching collapses some triangles into segments
+    auto addTriangle = [&](uint16_t a, uint16_t b, uint16_t c)
+    {
+        const ptrdiff_t width = static_cast<ptrdiff_t>(side);
+        ptrdiff_t abx = b % width - a % width, aby = b / width - a / width;
+        ptrdiff_t acx = c % width - a % width, acy = c / width - a / width;
+        if (abx * acy != aby * acx)
+        {
+            indexes.insert(indexes.end(), { a, b, c });
+        }
+    };
+
+    indexes.clear();
+    //two triangles per quad, the same split as in the heightfield
+    for (size_t y = 0; y < REGION_SIZE; y += step)
+    {
+        for (size_t x = 0; x < REGION_SIZE; x += step)
+        {
+            uint16_t v0 = vertex(x, y);
+            uint16_t v1 = vertex(x + step, y);
+            uint16_t v2 = vertex(x, y + step);
+            uint16_t v3 = vertex(x + step, y + step);
+            addTriangle(v1, v2, v0);
+            addTriangle(v3, v2, v1);
+        }
+    }
+}
+//-------------------------------------------------------
 Ground::Ground(const std::string & name, Ogre::SceneManager* sceneManager):
     mName(name), mSceneManager(sceneManager)
 {
@@ -153,81 +242,296 @@ Ground::~Ground()
     mImage.reset();
 }
 //-------------------------------------------------------
-Ogre::MeshPtr Ground::CreateRegion(size_t id, const std::string & material, const Ogre::Box & roi, const Ogre::Vector3 & offset, const Ogre::Vector3 & steps, const Ogre::Vector2 & texOffset)
+void Ground::BuildRegionGeometry(size_t regionX, size_t regionY, const Ogre::Box & roi, const Ogre::Vector2 & texOffset, RegionGeometry & geometry) const
 {
-    assert(mSceneManager != nullptr);
+    const size_t side = REGION_SIZE + 1;
+    const size_t firstX = regionX * REGION_SIZE;
+    const size_t firstY = regionY * REGION_SIZE;
 
-    Ogre::ManualObject* object = mSceneManager->createManualObject();
-    object->begin(material, Ogre::RenderOperation::OT_TRIANGLE_LIST);
+    geometry.vertices.resize(side * side * VERTEX_SIZE);
+    unsigned char* vertex = geometry.vertices.data();
+    for (size_t y = 0; y < side; ++y)
     {
-        size_t lastIdx = 0;
-        for (size_t y = 0; y < REGION_SIZE; ++y)
-        {
-            size_t texY = static_cast<size_t>(static_cast<float>(y) / REGION_SIZE * (roi.getHeight() - 1));
-            size_t texYn = static_cast<size_t>(static_cast<float>(y + 1) / REGION_SIZE * (roi.getHeight() - 1));
+        //Flip texture vertically
+        size_t texY = roi.getHeight() - 1 - static_cast<size_t>(static_cast<float>(y) / REGION_SIZE * (roi.getHeight() - 1));
+        float texCrdT = texOffset[1] + static_cast<float>(texY) / (mImage->getHeight() - 1);
 
-            //Flip texture vertically
-            texY  = roi.getHeight() - 1 - texY;
-            texYn = roi.getHeight() - 1 - texYn;
+        const float* heights = mHeightfield.GetRow(firstY + y) + firstX;
+        float posY = mHeightfield.GetOriginY() + (firstY + y) * VERTEX_STEP;
+        for (size_t x = 0; x < side; ++x)
+        {
+            size_t texX = static_cast<size_t>(static_cast<float>(x) / REGION_SIZE * (roi.getWidth() - 1));
+            float texCrdS = texOffset[0] + static_cast<float>(texX) / (mImage->getWidth() - 1);
+            float h = heights[x] / HEIGHT_STEP;
+
+            float* position = reinterpret_cast<float*>(vertex);
+            position[0] = mHeightfield.GetOriginX() + (firstX + x) * VERTEX_STEP;
+            position[1] = posY;
+            position[2] = heights[x];
+            *reinterpret_cast<Ogre::uint32*>(vertex + 3 * sizeof(float)) = Ogre::VertexElement::convertColourValue(Ogre::ColourValue(h, h, h), mColourType);
+            float* texCoord = reinterpret_cast<float*>(vertex + 3 * sizeof(float) + sizeof(Ogre::uint32));
+            texCoord[0] = texCrdS;
+            texCoord[1] = texCrdT;
+            vertex += VERTEX_SIZE;
+        }
+    }
 
-            float texCrdT = texOffset[1] + static_cast<float>(texY) / (mImage->getHeight() - 1);
-            float texCrdTn = texOffset[1] + static_cast<float>(texYn) / (mImage->getHeight() - 1);
+    //compare full resolution heights with the triangles of every level
+    geometry.lodErrors.assign(LOD_LEVELS, 0.0f);
+    for (size_t level = 1; level < LOD_LEVELS; ++level)
+    {
+        const size_t step = static_cast<size_t>(1) << level;
+        float error = geometry.lodErrors[level - 1];
+        for (size_t y = 0; y < side; ++y)
+        {
+            const size_t y0 = std::min(y / step * step, REGION_SIZE - step);
+            const float v = static_cast<float>(y - y0) / step;
+            const float* row0 = mHeightfield.GetRow(firstY + y0) + firstX;
+            const float* row1 = mHeightfield.GetRow(firstY + y0 + step) + firstX;
+            const float* row = mHeightfield.GetRow(firstY + y) + firstX;
+            for (size_t x = 0; x < side; ++x)
+            {
+                const size_t x0 = std::min(x / step * step, REGION_SIZE - step);
+                const float u = static_cast<float>(x - x0) / step;
+                float h;
+                if (u + v <= 1.0f)
+                {
+                    h = row0[x0] + u * (row0[x0 + step] - row0[x0]) + v * (row1[x0] - row0[x0]);
+                }
+                else
+                {
+                    h = row1[x0 + step] + (1.0f - u) * (row1[x0] - row1[x0 + step]) + (1.0f - v) * (row0[x0 + step] - row1[x0 + step]);
+                }
+                error = std::max(error, std::abs(h - row[x]));
+            }
+        }
+        geometry.lodErrors[level] = error;
+    }
 
-            for (size_t x = 0; x < REGION_SIZE; ++x)
+    HeightPyramid::Bounds heights = mHeightfield.GetPyramid().GetBoundsInRect(firstX, firstY, firstX + REGION_SIZE, firstY + REGION_SIZE);
+    geometry.bounds.setExtents(mHeightfield.GetOriginX() + firstX * VERTEX_STEP, mHeightfield.GetOriginY() + firstY * VERTEX_STEP, heights.min,
+        mHeightfield.GetOriginX() + (firstX + REGION_SIZE) * VERTEX_STEP, mHeightfield.GetOriginY() + (firstY + REGION_SIZE) * VERTEX_STEP, heights.max);
+}
+//-------------------------------------------------------
+uint64_t Ground::GetGeometryCacheKey() const
+{
+    //everything the region vertices depend on
+    uint64_t hash = FNV_OFFSET_BASIS;
+    auto add = [&hash](const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ bytes[i]) * FNV_PRIME;
+        }
+    };
+    const uint64_t constants[] = { GEOMETRY_CACHE_VERSION, GROUND_SIZE, REGION_SIZE, REGIONS_NUMBER, LOD_LEVELS, mImage->getWidth(), mImage->getHeight(), static_cast<uint64_t>(mColourType) };
+    add(constants, sizeof(constants));
+    add(&VERTEX_STEP, sizeof(VERTEX_STEP));
+    add(&HEIGHT_STEP, sizeof(HEIGHT_STEP));
+    for (size_t y = 0; y < mHeightfield.GetHeight(); ++y)
+    {
+        add(mHeightfield.GetRow(y), mHeightfield.GetWidth() * sizeof(float));
+    }
+    return hash;
+}
+//-------------------------------------------------------
+bool Ground::LoadGeometryCache(uint64_t key, std::vector<RegionGeometry> & geometry) const
+{
+    std::ifstream file(mCachePath, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    GeometryCacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file.good() || 0 != std::memcmp(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic)) || key != header.key ||
+        geometry.size() != header.regions || LOD_LEVELS != header.lodLevels)
+    {
+        Ogre::LogManager::getSingleton().logMessage("Ground: mesh cache " + mCachePath + " doesn't match the heights, regenerating");
+        return false;
+    }
+    if ((REGION_SIZE + 1) * (REGION_SIZE + 1) * VERTEX_SIZE != header.regionVerticesSize)
+    {
+        Ogre::LogManager::getSingleton().logMessage("Ground: mesh cache " + mCachePath + " has other vertex format, regenerating");
+        return false;
+    }
+    for (RegionGeometry & region : geometry)
+    {
+        float bounds[6];
+        region.lodErrors.resize(LOD_LEVELS);
+        region.vertices.resize(static_cast<size_t>(header.regionVerticesSize));
+        file.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+        file.read(reinterpret_cast<char*>(region.lodErrors.data()), region.lodErrors.size() * sizeof(float));
+        file.read(reinterpret_cast<char*>(region.vertices.data()), region.vertices.size());
+        region.bounds.setExtents(bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+    }
+    if (!file.good())
+    {
+        Ogre::LogManager::getSingleton().logMessage("Ground: mesh cache " + mCachePath + " is truncated, regenerating");
+        return false;
+    }
+    return true;
+}
+//-------------------------------------------------------
+void Ground::SaveGeometryCache(uint64_t key, const std::vector<RegionGeometry> & geometry) const
+{
+    std::ofstream file(mCachePath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        Ogre::LogManager::getSingleton().logMessage("Ground: can't write mesh cache " + mCachePath);
+        return;
+    }
+    GeometryCacheHeader header;
+    std::memcpy(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic));
+    header.regions = static_cast<uint32_t>(geometry.size());
+    header.lodLevels = static_cast<uint32_t>(LOD_LEVELS);
+    header.reserved = 0;
+    header.key = key;
+    header.regionVerticesSize = geometry.empty() ? 0 : geometry.front().vertices.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const RegionGeometry & region : geometry)
+    {
+        const Ogre::Vector3 & min = region.bounds.getMinimum();
+        const Ogre::Vector3 & max = region.bounds.getMaximum();
+        const float bounds[6] = { min.x, min.y, min.z, max.x, max.y, max.z };
+        file.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+        file.write(reinterpret_cast<const char*>(region.lodErrors.data()), region.lodErrors.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(region.vertices.data()), region.vertices.size());
+    }
+}
+//-------------------------------------------------------
+void Ground::CreateLodIndexBuffers()
+{
+    mLodIndexBuffers.clear();
+    std::vector<uint16_t> indexes;
+    for (size_t level = 0; level < LOD_LEVELS; ++level)
+    {
+        for (unsigned edges = 0; edges < EDGES_COMBINATIONS; ++edges)
+        {
+            //the coarsest level has no coarser neighbours
+            if (level + 1 == LOD_LEVELS && 0 != edges)
             {
-                size_t texX = static_cast<size_t>(static_cast<float>(x) / REGION_SIZE * (roi.getWidth() - 1));
-                size_t texXn = static_cast<size_t>(static_cast<float>(x + 1) / REGION_SIZE * (roi.getWidth() - 1));
-
-                float texCrdS = texOffset[0] + static_cast<float>(texX) / (mImage->getWidth() - 1);
-                float texCrdSn = texOffset[0] + static_cast<float>(texXn) / (mImage->getWidth() - 1);
-
-                float h00 = mImage->getColourAt(roi.left + texX,  roi.top + texY, 0)[0];
-                float h10 = mImage->getColourAt(roi.left + texXn, roi.top + texY, 0)[0];
-                float h01 = mImage->getColourAt(roi.left + texX,  roi.top + texYn, 0)[0];
-                float h11 = mImage->getColourAt(roi.left + texXn, roi.top + texYn, 0)[0];
-
-                object->position(x * steps[0] + offset[0], y * steps[1] + offset[1], h00 * steps[2]);
-                object->textureCoord(texCrdS, texCrdT);
-                object->colour(h00, h00, h00);
-                
-                object->position((x + 1) * steps[0] + offset[0], y * steps[1] + offset[1], h10 * steps[2]);
-                object->textureCoord(texCrdSn, texCrdT);
-                object->colour(h10, h10, h10);
-
-                object->position(x * steps[0] + offset[0], (y + 1) * steps[1] + offset[1], h01 * steps[2]);
-                object->textureCoord(texCrdS, texCrdTn);
-                object->colour(h01, h01, h01);
-
-                object->position((x + 1) * steps[0] + offset[0], (y + 1) * steps[1] + offset[1], h11 * steps[2]);
-                object->textureCoord(texCrdSn, texCrdTn);
-                object->colour(h11, h11, h11);
-
-                object->triangle(lastIdx + 1, lastIdx + 2, lastIdx);
-                object->triangle(lastIdx + 3, lastIdx + 2, lastIdx + 1);
-                lastIdx += 4;
+                mLodIndexBuffers.push_back(mLodIndexBuffers[level * EDGES_COMBINATIONS]);
+                continue;
             }
+            BuildLodIndexes(static_cast<size_t>(1) << level, edges, indexes);
+            Ogre::HardwareIndexBufferSharedPtr ibuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT, indexes.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+            ibuffer->writeData(0, ibuffer->getSizeInBytes(), indexes.data(), true);
+            mIndexDataSize += ibuffer->getSizeInBytes();
+            mLodIndexBuffers.push_back(ibuffer);
+        }
+    }
+}
+//-------------------------------------------------------
+Ogre::MeshPtr Ground::CreateRegion(size_t id, const std::string & material, const RegionGeometry & geometry)
+{
+    const size_t side = REGION_SIZE + 1;
+
+    Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().createManual("Mesh/" + CLASS_NAME + "/" + mName + "/" + std::to_string(id), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    Ogre::SubMesh* subMesh = mesh->createSubMesh();
+    subMesh->useSharedVertices = false;
+    subMesh->setMaterialName(material);
+
+    subMesh->vertexData = OGRE_NEW Ogre::VertexData();
+    subMesh->vertexData->vertexStart = 0;
+    subMesh->vertexData->vertexCount = side * side;
+    Ogre::VertexDeclaration* declaration = subMesh->vertexData->vertexDeclaration;
+    size_t vertexSize = 0;
+    vertexSize += declaration->addElement(0, vertexSize, Ogre::VET_FLOAT3, Ogre::VES_POSITION).getSize();
+    vertexSize += declaration->addElement(0, vertexSize, mColourType, Ogre::VES_DIFFUSE).getSize();
+    vertexSize += declaration->addElement(0, vertexSize, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0).getSize();
+    assert(geometry.vertices.size() == vertexSize * side * side);
+
+    Ogre::HardwareVertexBufferSharedPtr vbuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(vertexSize, side * side, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    vbuffer->writeData(0, vbuffer->getSizeInBytes(), geometry.vertices.data(), true);
+    subMesh->vertexData->vertexBufferBinding->setBinding(0, vbuffer);
+
+    //full resolution until the first UpdateLod
+    subMesh->indexData->indexBuffer = mLodIndexBuffers[0];
+    subMesh->indexData->indexStart = 0;
+    subMesh->indexData->indexCount = mLodIndexBuffers[0]->getNumIndexes();
+
+    mesh->_setBounds(geometry.bounds);
+    mesh->_setBoundingSphereRadius((geometry.bounds.getMaximum() - geometry.bounds.getMinimum()).length() / 2.0f);
+    mesh->load();
+
+    mVertexDataSize += vbuffer->getSizeInBytes();
+    return mesh;
+}
+//-------------------------------------------------------
+void Ground::LoadFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode, WorkerPool* pool)
+{
+    mImage = hmap;
+    mHeightFile.reset();
+    Load(parentNode, pool);
+}
+//-------------------------------------------------------
+void Ground::LoadFromHeightFile(std::shared_ptr<const HeightFile> file, Ogre::SceneNode* parentNode, WorkerPool* pool)
+{
+    OgreAssert(nullptr != file.get() && file->IsOpen(), "Ground[LoadFromHeightFile]: File is not opened");
+
+    //8 bits copy for the texture only, heights are sampled from the file
+    size_t width = file->GetWidth();
+    size_t height = file->GetHeight();
+    Ogre::uchar* pixels = OGRE_ALLOC_T(Ogre::uchar, width * height, Ogre::MEMCATEGORY_GENERAL);
+    auto fillRow = [&](size_t y)
+    {
+        std::vector<float> row(width);
+        file->ReadRow(y, 0, width, row.data());
+        for (size_t x = 0; x < width; ++x)
+        {
+            pixels[y * width + x] = static_cast<Ogre::uchar>(Ogre::Math::Clamp(row[x], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    };
+    if (nullptr != pool)
+    {
+        pool->ParallelFor(height, fillRow);
+    }
+    else
+    {
+        for (size_t y = 0; y < height; ++y)
+        {
+            fillRow(y);
         }
     }
-    object->end();
-    return object->convertToMesh("Mesh/" + CLASS_NAME  + "/" + mName + "/" + std::to_string(id));
+    mImage = std::make_shared<Ogre::Image>();
+    mImage->loadDynamicImage(pixels, width, height, 1, Ogre::PF_L8, true);
+    mHeightFile = file;
+    Load(parentNode, pool);
 }
 //-------------------------------------------------------
-void Ground::LoadFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode)
+void Ground::LoadHeightsFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode, WorkerPool* pool)
 {
+    PROFILE_ZONE("Ground load");
     mImage = hmap;
-    Ogre::Box box = Ogre::Box(0, 0, mImage->getWidth(), mImage->getHeight());
+    mHeightFile.reset();
+    mRootNode = parentNode->createChildSceneNode();
+
+    Ogre::Timer timer;
+    BuildHeightfield(pool);
 
+    //same box as the regions give
+    mGlobalBoundingBox.setExtents(mHeightfield.GetOriginX(), mHeightfield.GetOriginY(), mHeightfield.GetMinHeight(),
+        mHeightfield.GetOriginX() + (mHeightfield.GetWidth() - 1) * mHeightfield.GetStep(),
+        mHeightfield.GetOriginY() + (mHeightfield.GetHeight() - 1) * mHeightfield.GetStep(), mHeightfield.GetMaxHeight());
+    Ogre::LogManager::getSingleton().logMessage("Ground: startup heights only " + std::to_string(timer.getMilliseconds()) + " ms");
+}
+//-------------------------------------------------------
+void Ground::Load(Ogre::SceneNode* parentNode, WorkerPool* pool)
+{
+    PROFILE_ZONE("Ground load");
     mRootNode = parentNode->createChildSceneNode();
     
     mGlobalBoundingBox.setNull();
 
+    Ogre::Timer timer;
     Ogre::Material* groundMaterial = CreateGroundMaterialTextured("Material/" + CLASS_NAME + "/Textured", mImage.get());
-    
-    static const float VERTEX_STEP = 1.0f;
-    static const float HEIGHT_STEP = 8.0f;
+    unsigned long materialTime = timer.getMilliseconds();
 
-    float offsetX = GROUND_SIZE * VERTEX_STEP / 2.0f;
-    float offsetY = GROUND_SIZE * VERTEX_STEP / 2.0f;
+    //regions are built from the heightfield
+    timer.reset();
+    BuildHeightfield(pool);
 
     size_t width  = mImage->getWidth();
     size_t height = mImage->getHeight();
@@ -236,28 +540,226 @@ void Ground::LoadFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNod
 
     size_t texRegionWidth  = static_cast<size_t>(std::ceil(static_cast<float>(width) / REGIONS_NUMBER));
     size_t texRegionHeight = static_cast<size_t>(std::ceil(static_cast<float>(height) / REGIONS_NUMBER));
-    for (size_t y = 0; y < REGIONS_NUMBER; ++y)
+
+    mColourType = Ogre::VertexElement::getBestColourVertexElementType();
+    std::vector<RegionGeometry> geometry(REGIONS_NUMBER * REGIONS_NUMBER);
+    //identical heights give identical regions, so they are read from the cache of the previous run
+    const uint64_t cacheKey = GetGeometryCacheKey();
+    const bool cached = !mCachePath.empty() && LoadGeometryCache(cacheKey, geometry);
+    if (!cached)
     {
-        size_t top = y * texRegionHeight;
-        for (size_t x = 0; x < REGIONS_NUMBER; ++x)
+        auto buildRegion = [&](size_t id)
         {
+            PROFILE_ZONE("Ground region geometry");
+            size_t x = id % REGIONS_NUMBER;
+            size_t y = id / REGIONS_NUMBER;
+            size_t top = y * texRegionHeight;
             size_t left = x * texRegionWidth;
             Ogre::Box roi = Ogre::Box(left, height - std::min(top + texRegionHeight + 1, height), std::min(left + texRegionWidth + 1, width), height - top);
-                
-            Ogre::MeshPtr mesh = CreateRegion(y * REGIONS_NUMBER + x, groundMaterial->getName(), roi,
-                Ogre::Vector3(x * VERTEX_STEP * REGION_SIZE - offsetX, y * VERTEX_STEP * REGION_SIZE - offsetY, 0.0f),
-                Ogre::Vector3(VERTEX_STEP, VERTEX_STEP, HEIGHT_STEP),
-                Ogre::Vector2(x * texStep, 1.0f - (y + 1) * texStep));
+            BuildRegionGeometry(x, y, roi, Ogre::Vector2(x * texStep, 1.0f - (y + 1) * texStep), geometry[id]);
+        };
+        if (nullptr != pool)
+        {
+            pool->ParallelFor(geometry.size(), buildRegion);
+        }
+        else
+        {
+            for (size_t id = 0; id < geometry.size(); ++id)
+            {
+                buildRegion(id);
+            }
+        }
+    }
+    unsigned long geometryTime = timer.getMilliseconds();
+    if (!cached && !mCachePath.empty())
+    {
+        SaveGeometryCache(cacheKey, geometry);
+    }
+
+    //hardware buffers are created on the render thread
+    timer.reset();
+    mVertexDataSize = 0;
+    mIndexDataSize = 0;
+    CreateLodIndexBuffers();
+    mRegionsLod.clear();
+    for (size_t id = 0; id < geometry.size(); ++id)
+    {
+        Ogre::MeshPtr mesh = CreateRegion(id, groundMaterial->getName(), geometry[id]);
 
-            Ogre::Entity* entity = mSceneManager->createEntity(mesh);
+        Ogre::Entity* entity = mSceneManager->createEntity(mesh);
             
-            auto node = mRootNode->createChildSceneNode();
-            node->attachObject(entity);
-            node->showBoundingBox(true);
+        auto node = mRootNode->createChildSceneNode();
+        node->attachObject(entity);
+        node->showBoundingBox(true);
+
+        mGlobalBoundingBox.merge(entity->getBoundingBox());
+
+        mEntities.push_back(entity);
+
+        RegionLod lod;
+        lod.subMesh = mesh->getSubMesh(0);
+        lod.errors = std::move(geometry[id].lodErrors);
+        mRegionsLod.push_back(std::move(lod));
+    }
+    unsigned long uploadTime = timer.getMilliseconds();
+
+    //4 unique vertices and 6 indexes per quad were used before the shared grid
+    size_t vertexSize = mVertexDataSize / (REGIONS_NUMBER * REGIONS_NUMBER * (REGION_SIZE + 1) * (REGION_SIZE + 1));
+    size_t unsharedVertexDataSize = REGIONS_NUMBER * REGIONS_NUMBER * REGION_SIZE * REGION_SIZE * 4 * vertexSize;
+    size_t unsharedIndexDataSize = REGIONS_NUMBER * REGIONS_NUMBER * REGION_SIZE * REGION_SIZE * 6 * sizeof(uint16_t);
+    Ogre::LogManager::getSingleton().logMessage("Ground: vertex data " + std::to_string(mVertexDataSize / 1024) + " KB (unshared quads " + std::to_string(unsharedVertexDataSize / 1024) +
+        " KB), index data " + std::to_string(mIndexDataSize / 1024) + " KB (per region buffers " + std::to_string(unsharedIndexDataSize / 1024) + " KB)");
+    Ogre::LogManager::getSingleton().logMessage("Ground: startup material " + std::to_string(materialTime) + " ms, geometry " + std::to_string(geometryTime) + (cached ? " ms from cache" : " ms") +
+        ", upload " + std::to_string(uploadTime) + " ms");
+}
+//-------------------------------------------------------
+void Ground::BuildHeightfield(WorkerPool* pool)
+{
+    PROFILE_ZONE("Ground heightfield");
+    //Same sampling of the height map as in CreateRegion, so heights match the mesh vertices
+    size_t width  = mImage->getWidth();
+    size_t height = mImage->getHeight();
+
+    size_t texRegionWidth  = static_cast<size_t>(std::ceil(static_cast<float>(width) / REGIONS_NUMBER));
+    size_t texRegionHeight = static_cast<size_t>(std::ceil(static_cast<float>(height) / REGIONS_NUMBER));
+
+    size_t samples = REGIONS_NUMBER * REGION_SIZE + 1;
+    std::vector<size_t> pixelX(samples);
+    std::vector<size_t> pixelY(samples);
+    for (size_t i = 0; i < samples; ++i)
+    {
+        size_t region = std::min(i / REGION_SIZE, REGIONS_NUMBER - 1);
+        size_t v = i - region * REGION_SIZE;
+
+        size_t left = region * texRegionWidth;
+        size_t roiWidth = std::min(left + texRegionWidth + 1, width) - left;
+        pixelX[i] = left + static_cast<size_t>(static_cast<float>(v) / REGION_SIZE * (roiWidth - 1));
+
+        size_t top = region * texRegionHeight;
+        size_t roiTop = height - std::min(top + texRegionHeight + 1, height);
+        size_t roiHeight = (height - top) - roiTop;
+        size_t texY = static_cast<size_t>(static_cast<float>(v) / REGION_SIZE * (roiHeight - 1));
+        pixelY[i] = roiTop + roiHeight - 1 - texY;
+    }
+
+    mHeightfield.Reset(samples, samples, -(GROUND_SIZE * VERTEX_STEP / 2.0f), -(GROUND_SIZE * VERTEX_STEP / 2.0f), VERTEX_STEP);
+    auto fillRow = [&](size_t y)
+    {
+        float* row = mHeightfield.GetRow(y);
+        if (nullptr != mHeightFile.get())
+        {
+            for (size_t x = 0; x < samples; ++x)
+            {
+                row[x] = mHeightFile->GetAt(pixelX[x], pixelY[y]) * HEIGHT_STEP;
+            }
+            return;
+        }
+        for (size_t x = 0; x < samples; ++x)
+        {
+            row[x] = mImage->getColourAt(pixelX[x], pixelY[y], 0)[0] * HEIGHT_STEP;
+        }
+    };
+    if (nullptr != pool)
+    {
+        pool->ParallelFor(samples, fillRow);
+    }
+    else
+    {
+        for (size_t y = 0; y < samples; ++y)
+        {
+            fillRow(y);
+        }
+    }
+    mHeightfield.UpdateBounds();
+}
+//-------------------------------------------------------
+void Ground::UpdateLod(const Ogre::Camera* camera, float viewportHeight)
+{
+    PROFILE_ZONE("Ground LOD");
+    if (mRegionsLod.empty())
+    {
+        return;
+    }
+    const Ogre::Vector3 position = camera->getDerivedPosition();
+    const bool orthographic = (Ogre::PT_ORTHOGRAPHIC == camera->getProjectionType());
+    //pixels per world unit at the unit distance, or at any distance for the orthographic projection
+    const float pixelsPerUnit = orthographic ? viewportHeight / camera->getOrthoWindowHeight() : viewportHeight / (2.0f * std::tan(camera->getFOVy().valueRadians() / 2.0f));
+    //heights go along the local Z
+    const float heightScale = std::abs(mRootNode->_getDerivedScale().z) * pixelsPerUnit;
+
+    for (size_t id = 0; id < mRegionsLod.size(); ++id)
+    {
+        RegionLod & lod = mRegionsLod[id];
+        float distance = orthographic ? 1.0f : mEntities[id]->getWorldBoundingBox(true).distance(position);
+        lod.level = 0;
+        while (lod.level + 1 < LOD_LEVELS && lod.errors[lod.level + 1] * heightScale <= LOD_PIXEL_ERROR * distance)
+        {
+            ++lod.level;
+        }
+    }
+
+    //neighbours in the order of the stitched edges bits
+    const ptrdiff_t neighbours[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    const ptrdiff_t regions = static_cast<ptrdiff_t>(REGIONS_NUMBER);
+    //level of a neighbour, the own level at the ground border
+    auto getNeighbourLevel = [&](size_t x, size_t y, size_t neighbour)
+    {
+        ptrdiff_t nx = static_cast<ptrdiff_t>(x) + neighbours[neighbour][0];
+        ptrdiff_t ny = static_cast<ptrdiff_t>(y) + neighbours[neighbour][1];
+        if (nx < 0 || ny < 0 || nx >= regions || ny >= regions)
+        {
+            return mRegionsLod[y * REGIONS_NUMBER + x].level;
+        }
+        return mRegionsLod[ny * REGIONS_NUMBER + nx].level;
+    };
+
+    //neighbours can differ by one level only, otherwise stitching leaves cracks
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t y = 0; y < REGIONS_NUMBER; ++y)
+        {
+            for (size_t x = 0; x < REGIONS_NUMBER; ++x)
+            {
+                for (size_t neighbour = 0; neighbour < 4; ++neighbour)
+                {
+                    size_t & level = mRegionsLod[y * REGIONS_NUMBER + x].level;
+                    size_t limit = getNeighbourLevel(x, y, neighbour) + 1;
+                    if (level > limit)
+                    {
+                        level = limit;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    mTrianglesNumber = 0;
+    for (size_t y = 0; y < REGIONS_NUMBER; ++y)
+    {
+        for (size_t x = 0; x < REGIONS_NUMBER; ++x)
+        {
+            const size_t id = y * REGIONS_NUMBER + x;
+            const size_t level = mRegionsLod[id].level;
+            unsigned edges = 0;
+            for (size_t neighbour = 0; neighbour < 4; ++neighbour)
+            {
+                if (getNeighbourLevel(x, y, neighbour) > level)
+                {
+                    edges |= 1u << neighbour;
+                }
+            }
 
-            mGlobalBoundingBox.merge(entity->getBoundingBox());
+            Ogre::IndexData* indexData = mRegionsLod[id].subMesh->indexData;
+            indexData->indexBuffer = mLodIndexBuffers[level * EDGES_COMBINATIONS + edges];
+            indexData->indexCount = indexData->indexBuffer->getNumIndexes();
 
-            mEntities.push_back(entity);
+            if (camera->isVisible(mEntities[id]->getWorldBoundingBox(true)))
+            {
+                mTrianglesNumber += indexData->indexCount / 3;
+            }
         }
     }
 }
@@ -270,10 +772,46 @@ float Ground::GetHeightAt(float s, float t) const
     size_t x = static_cast<size_t>(s * (mImage->getWidth() - 1));
     size_t y = static_cast<size_t>(t * (mImage->getHeight() - 1));
 
+    if (nullptr != mHeightFile.get())
+    {
+        return mHeightFile->GetAt(x, y);
+    }
     return mImage->getColourAt(x, y, 0)[0];
 }
 //-------------------------------------------------------
 std::pair<bool, Ogre::Vector3> Ground::GetIntersectionLocalSpace(const Ogre::Ray & ray) const
+{
+    const Ogre::Vector3 & origin = ray.getOrigin();
+    const Ogre::Vector3 & direction = ray.getDirection();
+    auto hit = mHeightfield.Intersect(origin[0], origin[1], origin[2], direction[0], direction[1], direction[2]);
+    if (hit.first)
+    {
+        return std::make_pair(true, ray.getPoint(hit.second));
+    }
+    return std::make_pair(false, Ogre::Vector3::ZERO);
+}
+//-------------------------------------------------------
+void Ground::GetBoxesInVolume(const Ogre::PlaneBoundedVolume & volume, size_t level, std::vector<Ogre::AxisAlignedBox> & boxes) const
+{
+    mHeightfield.GetPyramid().Traverse([&](size_t nodeLevel, size_t x, size_t y, const HeightPyramid::Bounds & bounds)
+    {
+        float x0, y0, x1, y1;
+        mHeightfield.GetNodeRect(nodeLevel, x, y, x0, y0, x1, y1);
+        Ogre::AxisAlignedBox box(x0, y0, bounds.min, x1, y1, bounds.max);
+        if (!volume.intersects(box))
+        {
+            return false;
+        }
+        if (nodeLevel <= level)
+        {
+            boxes.push_back(box);
+            return false;
+        }
+        return true;
+    });
+}
+//-------------------------------------------------------
+std::pair<bool, Ogre::Vector3> Ground::GetIntersectionLocalSpaceMesh(const Ogre::Ray & ray) const
 {
     if (ray.intersects(mGlobalBoundingBox).first)
     {
@@ -12,13 +12,24 @@
 #ifndef _GROUND_H_
 #define _GROUND_H_
 
+#include <cstdint>
+
 #include <OgrePrerequisites.h>
 #include <OgreCommon.h>
 #include <OgreMesh.h>
+#include <OgreVector2.h>
 #include <OgreVector3.h>
 #include <OgreRay.h>
 #include <OgreAxisAlignedBox.h>
 
+#include <OgreHardwareIndexBuffer.h>
+#include <OgreHardwareVertexBuffer.h>
+
+#include "Heightfield.h"
+
+class WorkerPool;
+class HeightFile;
+
 namespace Ogre
 {
     class SceneManager;
@@ -35,33 +46,131 @@ class Ground
     static const size_t GROUND_SIZE;
     static const size_t REGION_SIZE;
     static const size_t REGIONS_NUMBER;
+
+    static const float VERTEX_STEP;
+    static const float HEIGHT_STEP;
+    //bytes of a region vertex: position, colour, texture coordinates
+    static const size_t VERTEX_SIZE;
+
+    //region levels of detail, level n uses every 2^n-th vertex
+    static const size_t LOD_LEVELS;
+    //allowed screen space height error of a region in pixels
+    static const float LOD_PIXEL_ERROR;
+
+    //edges of a region stitched to a coarser neighbour
+    enum StitchedEdges
+    {
+        EDGE_LEFT   = 1,
+        EDGE_RIGHT  = 2,
+        EDGE_BOTTOM = 4,
+        EDGE_TOP    = 8,
+        EDGES_COMBINATIONS = 16
+    };
     //-------------------------------------------------------
 
     static Ogre::Material* CreateGroundMaterialTextured(const std::string & name, const Ogre::Image* texture);
 
     static std::pair<bool, float> GetVertexIntersection(const Ogre::Ray & ray, const Ogre::SubMesh* subMesh);
+
+    /**
+     *	Triangles of a region grid with the given step between vertices.
+     *  Vertices of a stitched edge which are missing in the twice coarser neighbour are moved to the previous even vertex,
+     *  so the edge matches the neighbour's one. Collapsed triangles are skipped.
+     */
+    static void BuildLodIndexes(size_t step, unsigned stitchedEdges, std::vector<uint16_t> & indexes);
     //-------------------------------------------------------
 
     std::string mName;
     Ogre::SceneManager* mSceneManager;
     //Ogre::ManualObject* mObject;
     std::shared_ptr<Ogre::Image> mImage;
+    //mapped heights, replace the image pixels if present
+    std::shared_ptr<const HeightFile> mHeightFile;
 
     std::vector<Ogre::Entity*> mEntities;
     Ogre::SceneNode* mRootNode;
 
     Ogre::AxisAlignedBox mGlobalBoundingBox;
+
+    Heightfield mHeightfield;
+
+    //hardware buffers sizes in bytes
+    size_t mVertexDataSize = 0;
+    size_t mIndexDataSize = 0;
+
+    /**
+     *	CPU copy of a region mesh, ready to be uploaded
+     */
+    struct RegionGeometry
+    {
+        std::vector<unsigned char> vertices;
+        Ogre::AxisAlignedBox bounds;
+        //max height deviation of every level of detail from the full resolution mesh
+        std::vector<float> lodErrors;
+    };
+
+    /**
+     *	Level of detail state of a region
+     */
+    struct RegionLod
+    {
+        Ogre::SubMesh* subMesh = nullptr;
+        std::vector<float> errors;
+        size_t level = 0;
+    };
+
+    std::vector<RegionLod> mRegionsLod;
+    //index buffers shared by all regions, [level * EDGES_COMBINATIONS + stitched edges]
+    std::vector<Ogre::HardwareIndexBufferSharedPtr> mLodIndexBuffers;
+    //triangles of the regions in the camera frustum
+    size_t mTrianglesNumber = 0;
+    Ogre::VertexElementType mColourType = Ogre::VET_COLOUR;
+    //regions geometry cache file, empty to generate regions every time
+    std::string mCachePath;
     //-------------------------------------------------------
 
 
 
     /**
-     *	Create ground submesh for the given area of the height map
-     *  @param pixels - are of the height map
-     *  @param offset - top left vertex position
-     *  @param steps - horizontal and vertical steps between vertex
+     *	Fill vertices of a region of the heightfield, vertices are shared by the quads. Doesn't touch Ogre objects, so can be called from any thread
+     *  @param regionX, regionY - region position in the regions grid
+     *  @param roi - area of the height map used for the texture coordinates
+     */
+    void BuildRegionGeometry(size_t regionX, size_t regionY, const Ogre::Box & roi, const Ogre::Vector2 & texOffset, RegionGeometry & geometry) const;
+
+    /**
+     *	Create 16 bits index buffers of all levels of detail and stitching variants
+     */
+    void CreateLodIndexBuffers();
+
+    /**
+     *	Upload region geometry to the hardware buffers and create the region mesh
+     */
+    Ogre::MeshPtr CreateRegion(size_t id, const std::string & material, const RegionGeometry & geometry);
+
+    /**
+     *	Fill CPU copy of the mesh vertex heights
+     *  @param pool - optional threads to split rows
      */
-    Ogre::MeshPtr CreateRegion(size_t id, const std::string & material, const Ogre::Box & roi, const Ogre::Vector3 & offset, const Ogre::Vector3 & steps, const Ogre::Vector2 & texOffset);
+    void BuildHeightfield(WorkerPool* pool);
+
+    /**
+     *	Hash of the heightfield, the image size and the constants used by the regions generation
+     */
+    uint64_t GetGeometryCacheKey() const;
+
+    /**
+     *	Read regions saved with the same key
+     *  @return false if there is no cache or it was made from other heights
+     */
+    bool LoadGeometryCache(uint64_t key, std::vector<RegionGeometry> & geometry) const;
+
+    void SaveGeometryCache(uint64_t key, const std::vector<RegionGeometry> & geometry) const;
+
+    /**
+     *	Build regions from mImage and mHeightFile
+     */
+    void Load(Ogre::SceneNode* parentNode, WorkerPool* pool);
 
 
     Ground(const Ground&) = delete;
@@ -71,7 +180,32 @@ public:
     Ground(const std::string & name, Ogre::SceneManager* sceneManager);
     ~Ground();
 
-    void LoadFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode);
+    /**
+     *	Save generated regions to the file and read them from it on the next load with the same heights
+     *  @param path - empty path disables the cache
+     */
+    void SetMeshCachePath(const std::string & path)
+    {
+        mCachePath = path;
+    }
+
+    /**
+     *	Build ground regions, geometry is generated on the pool threads and uploaded on the calling thread
+     *  @param pool - optional threads for the geometry generation
+     */
+    void LoadFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode, WorkerPool* pool = nullptr);
+
+    /**
+     *	Same as LoadFromHeightMap, but heights are read from the mapped file directly.
+     *  The file has to stay mapped while the ground exists.
+     */
+    void LoadFromHeightFile(std::shared_ptr<const HeightFile> file, Ogre::SceneNode* parentNode, WorkerPool* pool = nullptr);
+
+    /**
+     *	Build only the heightfield for the queries, no material, texture or regions are created, so no render system is needed.
+     *  Levels of detail and ray casting on the mesh aren't available.
+     */
+    void LoadHeightsFromHeightMap(std::shared_ptr<Ogre::Image> hmap, Ogre::SceneNode* parentNode, WorkerPool* pool = nullptr);
 
     //Ogre::Entity* GetEntity()
     //{
@@ -83,16 +217,85 @@ public:
         return mRootNode;
     }
 
+    const Ogre::SceneNode* GetNode() const
+    {
+        return mRootNode;
+    }
+
+    /**
+     *	Choose regions levels of detail by the screen space error of their heights,
+     *  neighbouring regions differ by one level at most and coarser edges are stitched without cracks.
+     *  @param viewportHeight - height of the camera viewport in pixels
+     */
+    void UpdateLod(const Ogre::Camera* camera, float viewportHeight);
+
+    /**
+     *	Number of triangles submitted by the regions visible from the camera of the last UpdateLod
+     */
+    size_t GetTrianglesNumber() const
+    {
+        return mTrianglesNumber;
+    }
+
     //s, t from [0, 1]
     float GetHeightAt(float s, float t) const;
 
+    /**
+     *	Height of the ground mesh at a local space point
+     *  @param x, y - local space coordinates
+     *  @return false if the point is outside of the ground
+     */
+    std::pair<bool, float> GetHeightLocalSpace(float x, float y) const
+    {
+        return mHeightfield.Sample(x, y);
+    }
+
+    /**
+     *	Batch version of GetHeightLocalSpace
+     *  @param heights - output, points outside of the ground get the outside value
+     */
+    void GetHeightsLocalSpace(const float* xs, const float* ys, float* heights, size_t count, float outside) const
+    {
+        mHeightfield.SamplePoints(xs, ys, heights, count, outside);
+    }
+
+    /**
+     *	CPU copy of the ground mesh heights in the local space
+     */
+    const Heightfield & GetHeightfield() const
+    {
+        return mHeightfield;
+    }
+
+    /**
+     *	Min and max heights of the ground over a local space rectangle
+     *  @return false if the rectangle is outside of the ground
+     */
+    bool GetHeightRangeLocalSpace(const Ogre::Vector2 & min, const Ogre::Vector2 & max, float & minHeight, float & maxHeight) const
+    {
+        return mHeightfield.GetHeightRangeInRect(min[0], min[1], max[0], max[1], minHeight, maxHeight);
+    }
+
+    /**
+     *	Collect local space bounding boxes of the ground areas inside a volume, e.g. camera frustum in the local space
+     *  @param level - size of the areas, an area covers 2^level x 2^level vertex steps
+     */
+    void GetBoxesInVolume(const Ogre::PlaneBoundedVolume & volume, size_t level, std::vector<Ogre::AxisAlignedBox> & boxes) const;
+
     /**
      *	Find intersection of the ground and a ray in local space
+     *  Traces the CPU heightfield, hardware buffers are not touched
      *  @param ray - ray in local space 
      *  @return intersection flag and local space position
      */
     std::pair<bool, Ogre::Vector3> GetIntersectionLocalSpace(const Ogre::Ray & ray) const;
 
+    /**
+     *	Reference version of GetIntersectionLocalSpace, tests all triangles of the regions hit by the ray
+     *  Reads vertices back from the hardware buffers, so it is slow. Uses the current levels of detail
+     */
+    std::pair<bool, Ogre::Vector3> GetIntersectionLocalSpaceMesh(const Ogre::Ray & ray) const;
+
     /**
      *	Get min and max vertex coords of the ground in the local space
      */
@@ -0,0 +1,278 @@
+/**
+* @file HeightFile.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "HeightFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char HeightFile::MAGIC[4] = { 'O', 'N', 'H', 'F' };
+const uint32_t HeightFile::VERSION = 1;
+const size_t HeightFile::DATA_ALIGNMENT = 4096;
+const uint32_t HeightFile::MAX_SIZE = 65536;
+
+namespace
+{
+    size_t GetSampleSize(uint32_t type)
+    {
+        return (HeightFile::SAMPLE_UINT16 == type) ? sizeof(uint16_t) : sizeof(float);
+    }
+}
+
+//-------------------------------------------------------
+HeightFile::~HeightFile()
+{
+    Close();
+}
+//-------------------------------------------------------
+bool HeightFile::Open(const std::string & path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+    mFile = reinterpret_cast<intptr_t>(file);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || 0 == size.QuadPart)
+    {
+        Close();
+        return false;
+    }
+    mMappingSize = static_cast<size_t>(size.QuadPart);
+    mMappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr == mMappingHandle)
+    {
+        Close();
+        return false;
+    }
+    mMapping = static_cast<const unsigned char*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    mFile = file;
+    struct stat info;
+    if (0 != fstat(file, &info) || 0 == info.st_size)
+    {
+        Close();
+        return false;
+    }
+    mMappingSize = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_SHARED, file, 0);
+    mMapping = (MAP_FAILED != mapping) ? static_cast<const unsigned char*>(mapping) : nullptr;
+#endif
+    if (nullptr == mMapping || mMappingSize < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+
+    std::memcpy(&mHeader, mMapping, sizeof(Header));
+    if (!Validate())
+    {
+        Close();
+        return false;
+    }
+    mTilesX = (mHeader.width + mHeader.tileSize - 1) / mHeader.tileSize;
+    mTilesY = (mHeader.height + mHeader.tileSize - 1) / mHeader.tileSize;
+    mTileSamples = static_cast<size_t>(mHeader.tileSize) * mHeader.tileSize;
+    mData = mMapping + mHeader.dataOffset;
+    return true;
+}
+//-------------------------------------------------------
+bool HeightFile::Validate() const
+{
+    if (0 != std::memcmp(mHeader.magic, MAGIC, sizeof(MAGIC)) || VERSION != mHeader.version)
+    {
+        return false;
+    }
+    if ((SAMPLE_UINT16 != mHeader.sampleType && SAMPLE_FLOAT != mHeader.sampleType) || 0 == mHeader.width || 0 == mHeader.height || 0 == mHeader.tileSize)
+    {
+        return false;
+    }
+    if (mHeader.width > MAX_SIZE || mHeader.height > MAX_SIZE || mHeader.tileSize > MAX_SIZE)
+    {
+        return false;
+    }
+    if (0 != mHeader.dataOffset % DATA_ALIGNMENT || mHeader.dataOffset < sizeof(Header) || mHeader.dataOffset > mMappingSize)
+    {
+        return false;
+    }
+    //sizes are bounded, so the counts fit, the data size is checked by divisions to not wrap
+    const uint64_t tilesX = (static_cast<uint64_t>(mHeader.width) + mHeader.tileSize - 1) / mHeader.tileSize;
+    const uint64_t tilesY = (static_cast<uint64_t>(mHeader.height) + mHeader.tileSize - 1) / mHeader.tileSize;
+    const uint64_t tileBytes = static_cast<uint64_t>(mHeader.tileSize) * mHeader.tileSize * GetSampleSize(mHeader.sampleType);
+    const uint64_t available = mMappingSize - mHeader.dataOffset;
+    return tilesX <= available / tileBytes / tilesY;
+}
+//-------------------------------------------------------
+void HeightFile::Close()
+{
+#ifdef _WIN32
+    if (nullptr != mMapping)
+    {
+        UnmapViewOfFile(mMapping);
+    }
+    if (nullptr != mMappingHandle)
+    {
+        CloseHandle(mMappingHandle);
+    }
+    if (-1 != mFile)
+    {
+        CloseHandle(reinterpret_cast<HANDLE>(mFile));
+    }
+#else
+    if (nullptr != mMapping)
+    {
+        munmap(const_cast<unsigned char*>(mMapping), mMappingSize);
+    }
+    if (-1 != mFile)
+    {
+        close(static_cast<int>(mFile));
+    }
+#endif
+    mMapping = nullptr;
+    mMappingHandle = nullptr;
+    mMappingSize = 0;
+    mData = nullptr;
+    mFile = -1;
+}
+//-------------------------------------------------------
+void HeightFile::ReadRow(size_t y, size_t x0, size_t count, float* heights) const
+{
+    //whole runs of a tile row at once
+    const size_t tileSize = mHeader.tileSize;
+    size_t x = x0;
+    while (x < x0 + count)
+    {
+        const size_t run = std::min(tileSize - x % tileSize, x0 + count - x);
+        const size_t first = GetSampleIndex(x, y);
+        if (SAMPLE_UINT16 == mHeader.sampleType)
+        {
+            const uint16_t* samples = reinterpret_cast<const uint16_t*>(mData) + first;
+            const float scale = mHeader.heightScale * (1.0f / 65535.0f);
+            for (size_t i = 0; i < run; ++i)
+            {
+                heights[x - x0 + i] = mHeader.heightOffset + scale * samples[i];
+            }
+        }
+        else
+        {
+            const float* samples = reinterpret_cast<const float*>(mData) + first;
+            for (size_t i = 0; i < run; ++i)
+            {
+                heights[x - x0 + i] = mHeader.heightOffset + mHeader.heightScale * samples[i];
+            }
+        }
+        x += run;
+    }
+}
+//-------------------------------------------------------
+const void* HeightFile::GetTileData(size_t tileX, size_t tileY) const
+{
+    return mData + (tileY * mTilesX + tileX) * mTileSamples * GetSampleSize(mHeader.sampleType);
+}
+//-------------------------------------------------------
+bool HeightFile::Write(const std::string & path, const float* heights, size_t width, size_t height, size_t tileSize, SampleType type)
+{
+    if (0 == width || 0 == height || 0 == tileSize || width > MAX_SIZE || height > MAX_SIZE || tileSize > MAX_SIZE)
+    {
+        return false;
+    }
+
+    //the header is written raw, zeroed padding keeps files of the same heights identical
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sampleType = type;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.tileSize = static_cast<uint32_t>(tileSize);
+    header.heightScale = 1.0f;
+    header.heightOffset = 0.0f;
+    header.dataOffset = (sizeof(Header) + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    if (SAMPLE_UINT16 == type)
+    {
+        //use the whole 16 bits range
+        auto range = std::minmax_element(heights, heights + width * height);
+        header.heightOffset = *range.first;
+        header.heightScale = std::max(*range.second - *range.first, 1e-6f);
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::vector<char> padding(static_cast<size_t>(header.dataOffset) - sizeof(Header), 0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(padding.data(), padding.size());
+
+    const size_t tilesX = (width + tileSize - 1) / tileSize;
+    const size_t tilesY = (height + tileSize - 1) / tileSize;
+    std::vector<uint16_t> tile16(tileSize * tileSize);
+    std::vector<float> tile32(tileSize * tileSize);
+    for (size_t ty = 0; ty < tilesY; ++ty)
+    {
+        for (size_t tx = 0; tx < tilesX; ++tx)
+        {
+            for (size_t y = 0; y < tileSize; ++y)
+            {
+                const size_t sy = std::min(ty * tileSize + y, height - 1);
+                for (size_t x = 0; x < tileSize; ++x)
+                {
+                    const size_t sx = std::min(tx * tileSize + x, width - 1);
+                    const float h = heights[sy * width + sx];
+                    if (SAMPLE_UINT16 == type)
+                    {
+                        float normalized = std::min(std::max((h - header.heightOffset) / header.heightScale, 0.0f), 1.0f);
+                        tile16[y * tileSize + x] = static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+                    }
+                    else
+                    {
+                        tile32[y * tileSize + x] = h;
+                    }
+                }
+            }
+            if (SAMPLE_UINT16 == type)
+            {
+                file.write(reinterpret_cast<const char*>(tile16.data()), tile16.size() * sizeof(uint16_t));
+            }
+            else
+            {
+                file.write(reinterpret_cast<const char*>(tile32.data()), tile32.size() * sizeof(float));
+            }
+        }
+    }
+    return file.good();
+}
+//-------------------------------------------------------
@@ -0,0 +1,152 @@
+/**
+* @file HeightFile.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _HEIGHT_FILE_H_
+#define _HEIGHT_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ *	Raw binary heights, memory mapped for reading without decoding or copying.
+ *  Layout: header, then square tiles starting at a page aligned offset. Tiles go row by row, samples inside a tile go row by row too.
+ *  The grid is padded to whole tiles by repeating the edge samples.
+ *  Sample (x, y) has the same position as the pixel (x, y) of the source image, rows go from top to bottom.
+ */
+class HeightFile
+{
+public:
+    enum SampleType : uint32_t
+    {
+        //normalized to [0, 65535]
+        SAMPLE_UINT16 = 0,
+        SAMPLE_FLOAT  = 1
+    };
+
+    /**
+     *	Height of a sample is offset + scale * value, uint16 values are normalized to [0, 1] first
+     */
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t sampleType;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tileSize;
+        float heightScale;
+        float heightOffset;
+        uint64_t dataOffset;
+    };
+
+    static const char MAGIC[4];
+    static const uint32_t VERSION;
+    static const size_t DATA_ALIGNMENT;
+    //max width, height and tile side in samples
+    static const uint32_t MAX_SIZE;
+
+private:
+    Header mHeader;
+    size_t mTilesX = 0;
+    size_t mTilesY = 0;
+    size_t mTileSamples = 0;
+
+    const unsigned char* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    const unsigned char* mData = nullptr;
+
+    //platform handles
+    intptr_t mFile = -1;
+    void* mMappingHandle = nullptr;
+
+    HeightFile(const HeightFile&) = delete;
+    HeightFile& operator=(const HeightFile&) = delete;
+    //-------------------------------------------------------
+
+    bool Validate() const;
+
+    size_t GetSampleIndex(size_t x, size_t y) const
+    {
+        return ((y / mHeader.tileSize) * mTilesX + x / mHeader.tileSize) * mTileSamples + (y % mHeader.tileSize) * mHeader.tileSize + x % mHeader.tileSize;
+    }
+
+public:
+    HeightFile() = default;
+    ~HeightFile();
+
+    /**
+     *	Map file for reading
+     *  @return false if the file can't be opened or has a wrong format
+     */
+    bool Open(const std::string & path);
+
+    void Close();
+
+    bool IsOpen() const
+    {
+        return nullptr != mMapping;
+    }
+
+    size_t GetWidth() const
+    {
+        return mHeader.width;
+    }
+
+    size_t GetHeight() const
+    {
+        return mHeader.height;
+    }
+
+    size_t GetTileSize() const
+    {
+        return mHeader.tileSize;
+    }
+
+    SampleType GetSampleType() const
+    {
+        return static_cast<SampleType>(mHeader.sampleType);
+    }
+
+    /**
+     *	Height of a sample
+     */
+    float GetAt(size_t x, size_t y) const
+    {
+        const size_t i = GetSampleIndex(x, y);
+        if (SAMPLE_UINT16 == mHeader.sampleType)
+        {
+            return mHeader.heightOffset + mHeader.heightScale * (reinterpret_cast<const uint16_t*>(mData)[i] * (1.0f / 65535.0f));
+        }
+        return mHeader.heightOffset + mHeader.heightScale * reinterpret_cast<const float*>(mData)[i];
+    }
+
+    /**
+     *	Decode samples [x0, x0 + count) of a row
+     */
+    void ReadRow(size_t y, size_t x0, size_t count, float* heights) const;
+
+    /**
+     *	Raw samples of a tile, tileSize x tileSize values of the sample type
+     */
+    const void* GetTileData(size_t tileX, size_t tileY) const;
+
+    /**
+     *	Write heights to a file
+     *  @param heights - width x height values row by row
+     *  @param tileSize - tile side in samples
+     *  @return false if the file can't be written or a size is over MAX_SIZE
+     */
+    static bool Write(const std::string & path, const float* heights, size_t width, size_t height, size_t tileSize, SampleType type);
+};
+
+
+#endif
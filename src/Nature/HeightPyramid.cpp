@@ -0,0 +1,106 @@
+/**
+* @file HeightPyramid.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "HeightPyramid.h"
+
+#include <limits>
+
+//-------------------------------------------------------
+void HeightPyramid::Build(const float* heights, size_t width, size_t height)
+{
+    mLevels.clear();
+    if (width < 2 || height < 2)
+    {
+        return;
+    }
+
+    Level base;
+    base.width = width - 1;
+    base.height = height - 1;
+    base.nodes.resize(base.width * base.height);
+    for (size_t y = 0; y < base.height; ++y)
+    {
+        const float* row0 = heights + y * width;
+        const float* row1 = row0 + width;
+        Bounds* nodes = &base.nodes[y * base.width];
+        for (size_t x = 0; x < base.width; ++x)
+        {
+            nodes[x].min = std::min(std::min(row0[x], row0[x + 1]), std::min(row1[x], row1[x + 1]));
+            nodes[x].max = std::max(std::max(row0[x], row0[x + 1]), std::max(row1[x], row1[x + 1]));
+        }
+    }
+    mLevels.push_back(std::move(base));
+
+    while (mLevels.back().width > 1 || mLevels.back().height > 1)
+    {
+        const Level & prev = mLevels.back();
+        Level next;
+        next.width = (prev.width + 1) / 2;
+        next.height = (prev.height + 1) / 2;
+        next.nodes.resize(next.width * next.height);
+        for (size_t y = 0; y < next.height; ++y)
+        {
+            size_t y0 = 2 * y;
+            size_t y1 = std::min(y0 + 1, prev.height - 1);
+            for (size_t x = 0; x < next.width; ++x)
+            {
+                size_t x0 = 2 * x;
+                size_t x1 = std::min(x0 + 1, prev.width - 1);
+                const Bounds & b00 = prev.nodes[y0 * prev.width + x0];
+                const Bounds & b10 = prev.nodes[y0 * prev.width + x1];
+                const Bounds & b01 = prev.nodes[y1 * prev.width + x0];
+                const Bounds & b11 = prev.nodes[y1 * prev.width + x1];
+                Bounds & b = next.nodes[y * next.width + x];
+                b.min = std::min(std::min(b00.min, b10.min), std::min(b01.min, b11.min));
+                b.max = std::max(std::max(b00.max, b10.max), std::max(b01.max, b11.max));
+            }
+        }
+        mLevels.push_back(std::move(next));
+    }
+}
+//-------------------------------------------------------
+void HeightPyramid::MergeBoundsInRect(size_t level, size_t x, size_t y, size_t x0, size_t y0, size_t x1, size_t y1, Bounds & bounds) const
+{
+    size_t nodeX0 = x << level;
+    size_t nodeY0 = y << level;
+    size_t nodeX1 = (x + 1) << level;
+    size_t nodeY1 = (y + 1) << level;
+    if (nodeX0 >= x1 || nodeY0 >= y1 || nodeX1 <= x0 || nodeY1 <= y0)
+    {
+        return;
+    }
+    if (0 == level || (x0 <= nodeX0 && y0 <= nodeY0 && nodeX1 <= x1 && nodeY1 <= y1))
+    {
+        const Bounds & node = GetBounds(level, x, y);
+        bounds.min = std::min(bounds.min, node.min);
+        bounds.max = std::max(bounds.max, node.max);
+        return;
+    }
+    const Level & children = mLevels[level - 1];
+    for (size_t cy = 2 * y; cy < std::min(2 * y + 2, children.height); ++cy)
+    {
+        for (size_t cx = 2 * x; cx < std::min(2 * x + 2, children.width); ++cx)
+        {
+            MergeBoundsInRect(level - 1, cx, cy, x0, y0, x1, y1, bounds);
+        }
+    }
+}
+//-------------------------------------------------------
+HeightPyramid::Bounds HeightPyramid::GetBoundsInRect(size_t x0, size_t y0, size_t x1, size_t y1) const
+{
+    Bounds bounds = { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+    if (!mLevels.empty())
+    {
+        MergeBoundsInRect(mLevels.size() - 1, 0, 0, x0, y0, std::min(x1, mLevels.front().width), std::min(y1, mLevels.front().height), bounds);
+    }
+    return bounds;
+}
+//-------------------------------------------------------
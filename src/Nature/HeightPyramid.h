@@ -0,0 +1,131 @@
+/**
+* @file HeightPyramid.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _HEIGHT_PYRAMID_H_
+#define _HEIGHT_PYRAMID_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ *	Min/max mip pyramid over the cells of a heights grid.
+ *  Level 0 keeps bounds of every cell (its 4 corner heights), a node of the level k covers 2^k x 2^k cells.
+ *  The last level is a single node covering the whole grid.
+ */
+class HeightPyramid
+{
+public:
+    struct Bounds
+    {
+        float min;
+        float max;
+    };
+
+private:
+    struct Level
+    {
+        size_t width;
+        size_t height;
+        std::vector<Bounds> nodes;
+    };
+
+    std::vector<Level> mLevels;
+    //-------------------------------------------------------
+
+    void MergeBoundsInRect(size_t level, size_t x, size_t y, size_t x0, size_t y0, size_t x1, size_t y1, Bounds & bounds) const;
+
+public:
+    HeightPyramid() = default;
+
+    /**
+     *	Build all levels
+     *  @param heights - vertex heights, row by row
+     *  @param width, height - number of vertices, cells grid is (width - 1) x (height - 1)
+     */
+    void Build(const float* heights, size_t width, size_t height);
+
+    bool IsEmpty() const
+    {
+        return mLevels.empty();
+    }
+
+    size_t GetLevelsNumber() const
+    {
+        return mLevels.size();
+    }
+
+    size_t GetLevelWidth(size_t level) const
+    {
+        return mLevels[level].width;
+    }
+
+    size_t GetLevelHeight(size_t level) const
+    {
+        return mLevels[level].height;
+    }
+
+    /**
+     *	Bounds of the node covering cells [x * 2^level, (x + 1) * 2^level) x [y * 2^level, (y + 1) * 2^level)
+     */
+    const Bounds & GetBounds(size_t level, size_t x, size_t y) const
+    {
+        const Level & l = mLevels[level];
+        return l.nodes[y * l.width + x];
+    }
+
+    /**
+     *	Bounds of the whole grid
+     */
+    const Bounds & GetRootBounds() const
+    {
+        return mLevels.back().nodes.front();
+    }
+
+    /**
+     *	Heights range of the cells [x0, x1) x [y0, y1), visits O(log) nodes per rectangle side
+     */
+    Bounds GetBoundsInRect(size_t x0, size_t y0, size_t x1, size_t y1) const;
+
+    /**
+     *	Visit nodes from the root down
+     *  @param visitor - bool(size_t level, size_t x, size_t y, const Bounds & bounds), returns true to visit the children of the node
+     */
+    template <typename Visitor_>
+    void Traverse(Visitor_ && visitor) const
+    {
+        if (!mLevels.empty())
+        {
+            TraverseNode(visitor, mLevels.size() - 1, 0, 0);
+        }
+    }
+
+private:
+    template <typename Visitor_>
+    void TraverseNode(Visitor_ & visitor, size_t level, size_t x, size_t y) const
+    {
+        if (!visitor(level, x, y, GetBounds(level, x, y)) || 0 == level)
+        {
+            return;
+        }
+        const Level & children = mLevels[level - 1];
+        for (size_t cy = 2 * y; cy < std::min(2 * y + 2, children.height); ++cy)
+        {
+            for (size_t cx = 2 * x; cx < std::min(2 * x + 2, children.width); ++cx)
+            {
+                TraverseNode(visitor, level - 1, cx, cy);
+            }
+        }
+    }
+};
+
+
+#endif
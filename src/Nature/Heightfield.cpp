@@ -0,0 +1,679 @@
+/**
+* @file Heightfield.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTFIELD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+const size_t Heightfield::TILE_LEVEL = 4;
+const size_t Heightfield::LEVEL_STEP = 3;
+
+namespace
+{
+    //tolerance of the intersection tests in the grid units
+    const float INTERSECTION_EPSILON = 1e-4f;
+
+    /**
+     *	State of a grid walk along one axis
+     */
+    struct AxisWalk
+    {
+        ptrdiff_t index;
+        ptrdiff_t step;
+        float tMax;
+        float tDelta;
+
+        /**
+         *	@param p - position at the ray parameter t
+         *  @param d - direction
+         *  @param size - cell size
+         *  @param first, last - range of the cells indexes
+         */
+        AxisWalk(float p, float d, float t, float size, ptrdiff_t first, ptrdiff_t last)
+        {
+            index = std::min(std::max(static_cast<ptrdiff_t>(std::floor(p / size)), first), last);
+            if (d > 0.0f)
+            {
+                step = 1;
+                tMax = t + ((index + 1) * size - p) / d;
+                tDelta = size / d;
+            }
+            else if (d < 0.0f)
+            {
+                step = -1;
+                tMax = t + (index * size - p) / d;
+                tDelta = -size / d;
+            }
+            else
+            {
+                step = 0;
+                tMax = std::numeric_limits<float>::infinity();
+                tDelta = std::numeric_limits<float>::infinity();
+            }
+        }
+    };
+
+    inline bool RangesOverlap(float a0, float a1, float minValue, float maxValue)
+    {
+        return std::max(a0, a1) >= minValue - INTERSECTION_EPSILON && std::min(a0, a1) <= maxValue + INTERSECTION_EPSILON;
+    }
+}
+
+//-------------------------------------------------------
+void Heightfield::Reset(size_t width, size_t height, float originX, float originY, float step)
+{
+    mWidth = width;
+    mHeight = height;
+    mOriginX = originX;
+    mOriginY = originY;
+    mStep = step;
+    mHeights.assign(width * height, 0.0f);
+    UpdateBounds();
+}
+//-------------------------------------------------------
+void Heightfield::UpdateBounds()
+{
+    mPyramid.Build(mHeights.data(), mWidth, mHeight);
+    mMinHeight = mPyramid.IsEmpty() ? 0.0f : mPyramid.GetRootBounds().min;
+    mMaxHeight = mPyramid.IsEmpty() ? 0.0f : mPyramid.GetRootBounds().max;
+}
+//-------------------------------------------------------
+bool Heightfield::Contains(float x, float y) const
+{
+    float fx = (x - mOriginX) / mStep;
+    float fy = (y - mOriginY) / mStep;
+    return mWidth > 1 && mHeight > 1 && fx >= 0.0f && fy >= 0.0f && fx <= static_cast<float>(mWidth - 1) && fy <= static_cast<float>(mHeight - 1);
+}
+//-------------------------------------------------------
+std::pair<bool, float> Heightfield::Sample(float x, float y) const
+{
+    if (!Contains(x, y))
+    {
+        return std::make_pair(false, 0.0f);
+    }
+    float fx = (x - mOriginX) / mStep;
+    float fy = (y - mOriginY) / mStep;
+    size_t ix = std::min(static_cast<size_t>(fx), mWidth - 2);
+    size_t iy = std::min(static_cast<size_t>(fy), mHeight - 2);
+    float tx = fx - ix;
+    float ty = fy - iy;
+
+    const float* row0 = GetRow(iy);
+    const float* row1 = GetRow(iy + 1);
+    float h0 = row0[ix];
+    float h1 = row0[ix + 1];
+    float h2 = row1[ix];
+    float h3 = row1[ix + 1];
+    if (tx + ty <= 1.0f)
+    {
+        return std::make_pair(true, h0 + tx * (h1 - h0) + ty * (h2 - h0));
+    }
+    return std::make_pair(true, h3 + (1.0f - tx) * (h2 - h3) + (1.0f - ty) * (h1 - h3));
+}
+//-------------------------------------------------------
+#ifdef HEIGHTFIELD_SSE2
+namespace
+{
+    /**
+     *	Interpolate 4 points given in grid units, lanes outside of the grid get the outside value
+     */
+    inline __m128 SampleGrid4(const float* heights, size_t width, size_t height, __m128 fx, __m128 fy, float outside)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 maxX = _mm_set1_ps(static_cast<float>(width - 1));
+        const __m128 maxY = _mm_set1_ps(static_cast<float>(height - 1));
+
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(fx, zero), _mm_cmpge_ps(fy, zero)),
+            _mm_and_ps(_mm_cmple_ps(fx, maxX), _mm_cmple_ps(fy, maxY)));
+        //keep gathers in bounds for the outside lanes, NaN lanes become zero
+        fx = _mm_and_ps(inside, fx);
+        fy = _mm_and_ps(inside, fy);
+
+        __m128i ix = _mm_cvttps_epi32(_mm_min_ps(fx, _mm_set1_ps(static_cast<float>(width - 2))));
+        __m128i iy = _mm_cvttps_epi32(_mm_min_ps(fy, _mm_set1_ps(static_cast<float>(height - 2))));
+        __m128 tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(ix));
+        __m128 ty = _mm_sub_ps(fy, _mm_cvtepi32_ps(iy));
+
+        alignas(16) int32_t ixs[4];
+        alignas(16) int32_t iys[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ixs), ix);
+        _mm_store_si128(reinterpret_cast<__m128i*>(iys), iy);
+
+        alignas(16) float h0s[4], h1s[4], h2s[4], h3s[4];
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            const float* row0 = heights + static_cast<size_t>(iys[lane]) * width + ixs[lane];
+            const float* row1 = row0 + width;
+            h0s[lane] = row0[0];
+            h1s[lane] = row0[1];
+            h2s[lane] = row1[0];
+            h3s[lane] = row1[1];
+        }
+        __m128 h0 = _mm_load_ps(h0s);
+        __m128 h1 = _mm_load_ps(h1s);
+        __m128 h2 = _mm_load_ps(h2s);
+        __m128 h3 = _mm_load_ps(h3s);
+
+        //lower triangle (x+1, y), (x, y+1), (x, y)
+        __m128 lower = _mm_add_ps(h0, _mm_add_ps(_mm_mul_ps(tx, _mm_sub_ps(h1, h0)), _mm_mul_ps(ty, _mm_sub_ps(h2, h0))));
+        //upper triangle (x+1, y+1), (x, y+1), (x+1, y)
+        __m128 upper = _mm_add_ps(h3, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, tx), _mm_sub_ps(h2, h3)), _mm_mul_ps(_mm_sub_ps(one, ty), _mm_sub_ps(h1, h3))));
+
+        __m128 isLower = _mm_cmple_ps(_mm_add_ps(tx, ty), one);
+        __m128 result = _mm_or_ps(_mm_and_ps(isLower, lower), _mm_andnot_ps(isLower, upper));
+        return _mm_or_ps(_mm_and_ps(inside, result), _mm_andnot_ps(inside, _mm_set1_ps(outside)));
+    }
+}
+#endif
+//-------------------------------------------------------
+void Heightfield::SamplePoints(const float* xs, const float* ys, float* heights, size_t count, float outside) const
+{
+    size_t i = 0;
+#ifdef HEIGHTFIELD_SSE2
+    if (mWidth > 1 && mHeight > 1)
+    {
+        const __m128 originX = _mm_set1_ps(mOriginX);
+        const __m128 originY = _mm_set1_ps(mOriginY);
+        const __m128 step = _mm_set1_ps(mStep);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 fx = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(xs + i), originX), step);
+            __m128 fy = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(ys + i), originY), step);
+            _mm_storeu_ps(heights + i, SampleGrid4(mHeights.data(), mWidth, mHeight, fx, fy, outside));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        auto h = Sample(xs[i], ys[i]);
+        heights[i] = h.first ? h.second : outside;
+    }
+}
+//-------------------------------------------------------
+void Heightfield::SampleLine(float x0, float y0, float dx, float dy, size_t count, float* heights, float outside) const
+{
+    size_t i = 0;
+#ifdef HEIGHTFIELD_SSE2
+    if (mWidth > 1 && mHeight > 1)
+    {
+        const __m128 originX = _mm_set1_ps(mOriginX);
+        const __m128 originY = _mm_set1_ps(mOriginY);
+        const __m128 step = _mm_set1_ps(mStep);
+        const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 idx = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+            __m128 x = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(idx, _mm_set1_ps(dx)));
+            __m128 y = _mm_add_ps(_mm_set1_ps(y0), _mm_mul_ps(idx, _mm_set1_ps(dy)));
+            __m128 fx = _mm_div_ps(_mm_sub_ps(x, originX), step);
+            __m128 fy = _mm_div_ps(_mm_sub_ps(y, originY), step);
+            _mm_storeu_ps(heights + i, SampleGrid4(mHeights.data(), mWidth, mHeight, fx, fy, outside));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        auto h = Sample(x0 + i * dx, y0 + i * dy);
+        heights[i] = h.first ? h.second : outside;
+    }
+}
+//-------------------------------------------------------
+float Heightfield::IntersectCell(size_t x, size_t y, float gx, float gy, float oz, float gdx, float gdy, float dz) const
+{
+    const float* row0 = GetRow(y) + x;
+    const float* row1 = GetRow(y + 1) + x;
+    const float h0 = row0[0];
+    const float h1 = row0[1];
+    const float h2 = row1[0];
+    const float h3 = row1[1];
+
+    float result = -1.0f;
+    //lower triangle z = h0 + tx * a + ty * b, upper side normal is (-a, -b, 1)
+    {
+        const float a = h1 - h0;
+        const float b = h2 - h0;
+        const float denom = dz - gdx * a - gdy * b;
+        if (denom < 0.0f)
+        {
+            float t = (h0 + gx * a + gy * b - oz) / denom;
+            float tx = gx + t * gdx;
+            float ty = gy + t * gdy;
+            if (t >= 0.0f && tx >= -INTERSECTION_EPSILON && ty >= -INTERSECTION_EPSILON && tx + ty <= 1.0f + INTERSECTION_EPSILON)
+            {
+                result = t;
+            }
+        }
+    }
+    //upper triangle z = h3 + (1 - tx) * c + (1 - ty) * e, upper side normal is (c, e, 1)
+    {
+        const float c = h2 - h3;
+        const float e = h1 - h3;
+        const float denom = dz + gdx * c + gdy * e;
+        if (denom < 0.0f)
+        {
+            float t = (h3 + c + e - gx * c - gy * e - oz) / denom;
+            float tx = gx + t * gdx;
+            float ty = gy + t * gdy;
+            if (t >= 0.0f && tx <= 1.0f + INTERSECTION_EPSILON && ty <= 1.0f + INTERSECTION_EPSILON && tx + ty >= 1.0f - INTERSECTION_EPSILON && (result < 0.0f || t < result))
+            {
+                result = t;
+            }
+        }
+    }
+    return result;
+}
+//-------------------------------------------------------
+bool Heightfield::ClipRay(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance, GridRay & ray, float & tNear, float & tFar) const
+{
+    if (mPyramid.IsEmpty())
+    {
+        return false;
+    }
+    //grid units, the ray parameter stays the same
+    ray.ox = (ox - mOriginX) / mStep;
+    ray.oy = (oy - mOriginY) / mStep;
+    ray.oz = oz;
+    ray.dx = dx / mStep;
+    ray.dy = dy / mStep;
+    ray.dz = dz;
+    ray.maxDistance = maxDistance;
+
+    tNear = 0.0f;
+    tFar = maxDistance;
+    const float origin[3] = { ray.ox, ray.oy, ray.oz };
+    const float direction[3] = { ray.dx, ray.dy, ray.dz };
+    const float lower[3] = { 0.0f, 0.0f, mMinHeight };
+    const float upper[3] = { static_cast<float>(mWidth - 1), static_cast<float>(mHeight - 1), mMaxHeight };
+    for (size_t i = 0; i < 3; ++i)
+    {
+        if (0.0f == direction[i])
+        {
+            if (origin[i] < lower[i] || origin[i] > upper[i])
+            {
+                return false;
+            }
+            continue;
+        }
+        float t0 = (lower[i] - origin[i]) / direction[i];
+        float t1 = (upper[i] - origin[i]) / direction[i];
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+    }
+    return tNear <= tFar;
+}
+//-------------------------------------------------------
+bool Heightfield::WalkNodes(const GridRay & ray, size_t level, size_t levelStep, ptrdiff_t firstX, ptrdiff_t firstY, ptrdiff_t lastX, ptrdiff_t lastY, float tBegin, float tEnd, float & hit) const
+{
+    const size_t childLevel = (level > levelStep) ? level - levelStep : 0;
+    const size_t shift = level - childLevel;
+
+    float t = tBegin;
+    AxisWalk nodeX(ray.ox + t * ray.dx, ray.dx, t, static_cast<float>(1 << level), firstX, lastX);
+    AxisWalk nodeY(ray.oy + t * ray.dy, ray.dy, t, static_cast<float>(1 << level), firstY, lastY);
+    for (;;)
+    {
+        const float nodeEnd = std::min(std::min(nodeX.tMax, nodeY.tMax), tEnd);
+        const size_t x = static_cast<size_t>(nodeX.index);
+        const size_t y = static_cast<size_t>(nodeY.index);
+        const HeightPyramid::Bounds & bounds = mPyramid.GetBounds(level, x, y);
+        if (RangesOverlap(ray.oz + t * ray.dz, ray.oz + nodeEnd * ray.dz, bounds.min, bounds.max))
+        {
+            if (0 == level)
+            {
+                float cellHit = IntersectCell(x, y, ray.ox - x, ray.oy - y, ray.oz, ray.dx, ray.dy, ray.dz);
+                if (cellHit >= 0.0f && cellHit <= ray.maxDistance)
+                {
+                    hit = cellHit;
+                    return true;
+                }
+            }
+            else
+            {
+                const ptrdiff_t childrenX = static_cast<ptrdiff_t>(mPyramid.GetLevelWidth(childLevel));
+                const ptrdiff_t childrenY = static_cast<ptrdiff_t>(mPyramid.GetLevelHeight(childLevel));
+                if (WalkNodes(ray, childLevel, levelStep,
+                    nodeX.index << shift, nodeY.index << shift, std::min((nodeX.index + 1) << shift, childrenX) - 1, std::min((nodeY.index + 1) << shift, childrenY) - 1,
+                    t, nodeEnd, hit))
+                {
+                    return true;
+                }
+            }
+        }
+        if (nodeEnd >= tEnd)
+        {
+            break;
+        }
+        if (nodeX.tMax < nodeY.tMax)
+        {
+            nodeX.index += nodeX.step;
+            t = nodeX.tMax;
+            nodeX.tMax += nodeX.tDelta;
+        }
+        else
+        {
+            nodeY.index += nodeY.step;
+            t = nodeY.tMax;
+            nodeY.tMax += nodeY.tDelta;
+        }
+        if (nodeX.index < firstX || nodeX.index > lastX || nodeY.index < firstY || nodeY.index > lastY)
+        {
+            break;
+        }
+    }
+    return false;
+}
+//-------------------------------------------------------
+std::pair<bool, float> Heightfield::Intersect(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance) const
+{
+    GridRay ray;
+    float tNear, tFar;
+    float hit;
+    if (ClipRay(ox, oy, oz, dx, dy, dz, maxDistance, ray, tNear, tFar) &&
+        WalkNodes(ray, mPyramid.GetLevelsNumber() - 1, LEVEL_STEP, 0, 0, 0, 0, tNear, tFar, hit))
+    {
+        return std::make_pair(true, hit);
+    }
+    return std::make_pair(false, 0.0f);
+}
+//-------------------------------------------------------
+std::pair<bool, float> Heightfield::IntersectWalk(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance) const
+{
+    GridRay ray;
+    float tNear, tFar;
+    float hit;
+    if (ClipRay(ox, oy, oz, dx, dy, dz, maxDistance, ray, tNear, tFar))
+    {
+        const size_t tileLevel = std::min(TILE_LEVEL, mPyramid.GetLevelsNumber() - 1);
+        const ptrdiff_t tilesX = static_cast<ptrdiff_t>(mPyramid.GetLevelWidth(tileLevel));
+        const ptrdiff_t tilesY = static_cast<ptrdiff_t>(mPyramid.GetLevelHeight(tileLevel));
+        if (WalkNodes(ray, tileLevel, tileLevel, 0, 0, tilesX - 1, tilesY - 1, tNear, tFar, hit))
+        {
+            return std::make_pair(true, hit);
+        }
+    }
+    return std::make_pair(false, 0.0f);
+}
+//-------------------------------------------------------
+#ifdef HEIGHTFIELD_SSE2
+namespace
+{
+    /**
+     *	4 rays in the grid units, lane per ray
+     */
+    struct RayPacket
+    {
+        __m128 ox, oy, oz;
+        __m128 dx, dy, dz;
+        __m128 invDx, invDy;
+        __m128 tNear, tFar;
+        //nearest hit, infinity if there is no hit
+        __m128 hit;
+        //children visiting order
+        size_t flipX, flipY;
+    };
+
+    /**
+     *	Test the two triangles of a cell against the active rays
+     */
+    void IntersectPacketCell(const Heightfield & field, RayPacket & packet, size_t x, size_t y, __m128 active)
+    {
+        const float* row0 = field.GetRow(y) + x;
+        const float* row1 = field.GetRow(y + 1) + x;
+        const __m128 h0 = _mm_set1_ps(row0[0]);
+        const __m128 h1 = _mm_set1_ps(row0[1]);
+        const __m128 h2 = _mm_set1_ps(row1[0]);
+        const __m128 h3 = _mm_set1_ps(row1[1]);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 eps = _mm_set1_ps(INTERSECTION_EPSILON);
+        const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+
+        const __m128 gx = _mm_sub_ps(packet.ox, _mm_set1_ps(static_cast<float>(x)));
+        const __m128 gy = _mm_sub_ps(packet.oy, _mm_set1_ps(static_cast<float>(y)));
+
+        //lower triangle z = h0 + tx * a + ty * b
+        __m128 lower;
+        {
+            const __m128 a = _mm_sub_ps(h1, h0);
+            const __m128 b = _mm_sub_ps(h2, h0);
+            const __m128 denom = _mm_sub_ps(packet.dz, _mm_add_ps(_mm_mul_ps(packet.dx, a), _mm_mul_ps(packet.dy, b)));
+            const __m128 t = _mm_div_ps(_mm_sub_ps(_mm_add_ps(h0, _mm_add_ps(_mm_mul_ps(gx, a), _mm_mul_ps(gy, b))), packet.oz), denom);
+            const __m128 tx = _mm_add_ps(gx, _mm_mul_ps(t, packet.dx));
+            const __m128 ty = _mm_add_ps(gy, _mm_mul_ps(t, packet.dy));
+            __m128 valid = _mm_and_ps(_mm_cmplt_ps(denom, zero), _mm_cmpge_ps(t, zero));
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(tx, _mm_sub_ps(zero, eps)), _mm_cmpge_ps(ty, _mm_sub_ps(zero, eps))));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(tx, ty), _mm_add_ps(one, eps)));
+            lower = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, infinity));
+        }
+        //upper triangle z = h3 + (1 - tx) * c + (1 - ty) * e
+        __m128 upper;
+        {
+            const __m128 c = _mm_sub_ps(h2, h3);
+            const __m128 e = _mm_sub_ps(h1, h3);
+            const __m128 denom = _mm_add_ps(packet.dz, _mm_add_ps(_mm_mul_ps(packet.dx, c), _mm_mul_ps(packet.dy, e)));
+            const __m128 t = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(_mm_add_ps(h3, _mm_add_ps(c, e)), _mm_add_ps(_mm_mul_ps(gx, c), _mm_mul_ps(gy, e))), packet.oz), denom);
+            const __m128 tx = _mm_add_ps(gx, _mm_mul_ps(t, packet.dx));
+            const __m128 ty = _mm_add_ps(gy, _mm_mul_ps(t, packet.dy));
+            __m128 valid = _mm_and_ps(_mm_cmplt_ps(denom, zero), _mm_cmpge_ps(t, zero));
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmple_ps(tx, _mm_add_ps(one, eps)), _mm_cmple_ps(ty, _mm_add_ps(one, eps))));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(_mm_add_ps(tx, ty), _mm_sub_ps(one, eps)));
+            upper = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, infinity));
+        }
+        const __m128 nearest = _mm_min_ps(lower, upper);
+        packet.hit = _mm_min_ps(packet.hit, _mm_or_ps(_mm_and_ps(active, nearest), _mm_andnot_ps(active, infinity)));
+    }
+
+    /**
+     *	Descend the min/max pyramid with 4 rays at once, rays leave the packet as soon as they miss a node
+     */
+    void IntersectPacketNode(const Heightfield & field, RayPacket & packet, size_t level, size_t x, size_t y, __m128 active)
+    {
+        const HeightPyramid & pyramid = field.GetPyramid();
+
+        //clip by the node rectangle, the part behind the current hits is skipped
+        const __m128 nodeX0 = _mm_set1_ps(static_cast<float>(x << level));
+        const __m128 nodeY0 = _mm_set1_ps(static_cast<float>(y << level));
+        const __m128 nodeX1 = _mm_set1_ps(static_cast<float>(std::min((x + 1) << level, field.GetWidth() - 1)));
+        const __m128 nodeY1 = _mm_set1_ps(static_cast<float>(std::min((y + 1) << level, field.GetHeight() - 1)));
+        const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(nodeX0, packet.ox), packet.invDx);
+        const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(nodeX1, packet.ox), packet.invDx);
+        const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(nodeY0, packet.oy), packet.invDy);
+        const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(nodeY1, packet.oy), packet.invDy);
+        const __m128 t0 = _mm_max_ps(packet.tNear, _mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)));
+        const __m128 t1 = _mm_min_ps(_mm_min_ps(packet.tFar, packet.hit), _mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)));
+        active = _mm_and_ps(active, _mm_cmple_ps(t0, t1));
+        if (0 == _mm_movemask_ps(active))
+        {
+            return;
+        }
+
+        const HeightPyramid::Bounds & bounds = pyramid.GetBounds(level, x, y);
+        const __m128 z0 = _mm_add_ps(packet.oz, _mm_mul_ps(t0, packet.dz));
+        const __m128 z1 = _mm_add_ps(packet.oz, _mm_mul_ps(t1, packet.dz));
+        const __m128 eps = _mm_set1_ps(INTERSECTION_EPSILON);
+        active = _mm_and_ps(active, _mm_cmpge_ps(_mm_max_ps(z0, z1), _mm_set1_ps(bounds.min - INTERSECTION_EPSILON)));
+        active = _mm_and_ps(active, _mm_cmple_ps(_mm_min_ps(z0, z1), _mm_add_ps(_mm_set1_ps(bounds.max), eps)));
+        if (0 == _mm_movemask_ps(active))
+        {
+            return;
+        }
+
+        if (0 == level)
+        {
+            IntersectPacketCell(field, packet, x, y, active);
+            return;
+        }
+        const size_t childrenWidth = pyramid.GetLevelWidth(level - 1);
+        const size_t childrenHeight = pyramid.GetLevelHeight(level - 1);
+        for (size_t i = 0; i < 4; ++i)
+        {
+            size_t cx = 2 * x + ((i & 1) ^ packet.flipX);
+            size_t cy = 2 * y + ((i >> 1) ^ packet.flipY);
+            if (cx < childrenWidth && cy < childrenHeight)
+            {
+                IntersectPacketNode(field, packet, level - 1, cx, cy, active);
+            }
+        }
+    }
+
+    void IntersectPacket(const Heightfield & field, const float* origins, const float* directions, float maxDistance, float* hits)
+    {
+        alignas(16) float lanes[8][4];
+        float sumDx = 0.0f;
+        float sumDy = 0.0f;
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            const float* o = origins + 3 * lane;
+            const float* d = directions + 3 * lane;
+            lanes[0][lane] = (o[0] - field.GetOriginX()) / field.GetStep();
+            lanes[1][lane] = (o[1] - field.GetOriginY()) / field.GetStep();
+            lanes[2][lane] = o[2];
+            lanes[3][lane] = d[0] / field.GetStep();
+            lanes[4][lane] = d[1] / field.GetStep();
+            lanes[5][lane] = d[2];
+            //huge finite inverse for the axis parallel rays keeps the slabs math free of NaNs
+            lanes[6][lane] = 1.0f / ((0.0f != lanes[3][lane]) ? lanes[3][lane] : 1e-30f);
+            lanes[7][lane] = 1.0f / ((0.0f != lanes[4][lane]) ? lanes[4][lane] : 1e-30f);
+            sumDx += d[0];
+            sumDy += d[1];
+        }
+
+        RayPacket packet;
+        packet.ox = _mm_load_ps(lanes[0]);
+        packet.oy = _mm_load_ps(lanes[1]);
+        packet.oz = _mm_load_ps(lanes[2]);
+        packet.dx = _mm_load_ps(lanes[3]);
+        packet.dy = _mm_load_ps(lanes[4]);
+        packet.dz = _mm_load_ps(lanes[5]);
+        packet.invDx = _mm_load_ps(lanes[6]);
+        packet.invDy = _mm_load_ps(lanes[7]);
+        packet.hit = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        packet.flipX = (sumDx < 0.0f) ? 1 : 0;
+        packet.flipY = (sumDy < 0.0f) ? 1 : 0;
+
+        //clip by the heights range, the rectangle is clipped by the root node
+        const __m128 invDz = _mm_div_ps(_mm_set1_ps(1.0f), packet.dz);
+        const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(field.GetMinHeight()), packet.oz), invDz);
+        const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(field.GetMaxHeight()), packet.oz), invDz);
+        const __m128 flat = _mm_cmpeq_ps(packet.dz, _mm_setzero_ps());
+        packet.tNear = _mm_max_ps(_mm_setzero_ps(), _mm_andnot_ps(flat, _mm_min_ps(tz0, tz1)));
+        packet.tFar = _mm_min_ps(_mm_set1_ps(maxDistance), _mm_or_ps(_mm_andnot_ps(flat, _mm_max_ps(tz0, tz1)), _mm_and_ps(flat, _mm_set1_ps(std::numeric_limits<float>::infinity()))));
+        __m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        //flat rays outside of the heights range miss
+        active = _mm_andnot_ps(_mm_and_ps(flat, _mm_or_ps(_mm_cmplt_ps(packet.oz, _mm_set1_ps(field.GetMinHeight())), _mm_cmpgt_ps(packet.oz, _mm_set1_ps(field.GetMaxHeight())))), active);
+
+        const HeightPyramid & pyramid = field.GetPyramid();
+        IntersectPacketNode(field, packet, pyramid.GetLevelsNumber() - 1, 0, 0, active);
+
+        const __m128 missed = _mm_cmpeq_ps(packet.hit, _mm_set1_ps(std::numeric_limits<float>::infinity()));
+        _mm_storeu_ps(hits, _mm_or_ps(_mm_andnot_ps(missed, packet.hit), _mm_and_ps(missed, _mm_set1_ps(-1.0f))));
+    }
+}
+#endif
+//-------------------------------------------------------
+bool Heightfield::IsCoherentPacket(const float* origins, const float* directions) const
+{
+    //rays going in the same quadrant from close origins visit mostly the same nodes
+    const float maxSpread = static_cast<float>(1 << TILE_LEVEL) * mStep;
+    for (size_t lane = 1; lane < 4; ++lane)
+    {
+        const float* o = origins + 3 * lane;
+        const float* d = directions + 3 * lane;
+        if ((d[0] < 0.0f) != (directions[0] < 0.0f) || (d[1] < 0.0f) != (directions[1] < 0.0f) ||
+            std::abs(o[0] - origins[0]) > maxSpread || std::abs(o[1] - origins[1]) > maxSpread)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+//-------------------------------------------------------
+float Heightfield::IntersectRay(const float* origin, const float* direction, float maxDistance) const
+{
+    auto hit = Intersect(origin[0], origin[1], origin[2], direction[0], direction[1], direction[2], maxDistance);
+    return hit.first ? hit.second : -1.0f;
+}
+//-------------------------------------------------------
+void Heightfield::IntersectRays(const float* origins, const float* directions, size_t count, float* hits, float maxDistance) const
+{
+    size_t i = 0;
+#ifdef HEIGHTFIELD_SSE2
+    if (!mPyramid.IsEmpty())
+    {
+        for (; i + 4 <= count; i += 4)
+        {
+            if (IsCoherentPacket(origins + 3 * i, directions + 3 * i))
+            {
+                IntersectPacket(*this, origins + 3 * i, directions + 3 * i, maxDistance, hits + i);
+            }
+            else
+            {
+                for (size_t j = i; j < i + 4; ++j)
+                {
+                    hits[j] = IntersectRay(origins + 3 * j, directions + 3 * j, maxDistance);
+                }
+            }
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        hits[i] = IntersectRay(origins + 3 * i, directions + 3 * i, maxDistance);
+    }
+}
+//-------------------------------------------------------
+void Heightfield::GetNodeRect(size_t level, size_t x, size_t y, float & x0, float & y0, float & x1, float & y1) const
+{
+    x0 = mOriginX + (x << level) * mStep;
+    y0 = mOriginY + (y << level) * mStep;
+    x1 = mOriginX + std::min((x + 1) << level, mWidth - 1) * mStep;
+    y1 = mOriginY + std::min((y + 1) << level, mHeight - 1) * mStep;
+}
+//-------------------------------------------------------
+bool Heightfield::GetHeightRangeInRect(float x0, float y0, float x1, float y1, float & minHeight, float & maxHeight) const
+{
+    if (mPyramid.IsEmpty())
+    {
+        return false;
+    }
+    const float cellsX = static_cast<float>(mWidth - 1);
+    const float cellsY = static_cast<float>(mHeight - 1);
+    float fx0 = std::max((std::min(x0, x1) - mOriginX) / mStep, 0.0f);
+    float fy0 = std::max((std::min(y0, y1) - mOriginY) / mStep, 0.0f);
+    float fx1 = std::min((std::max(x0, x1) - mOriginX) / mStep, cellsX);
+    float fy1 = std::min((std::max(y0, y1) - mOriginY) / mStep, cellsY);
+    if (fx0 > fx1 || fy0 > fy1)
+    {
+        return false;
+    }
+    //cells touching the rectangle, a degenerate rectangle still covers a cell
+    size_t cx0 = std::min(static_cast<size_t>(fx0), mWidth - 2);
+    size_t cy0 = std::min(static_cast<size_t>(fy0), mHeight - 2);
+    size_t cx1 = std::max(static_cast<size_t>(std::ceil(fx1)), cx0 + 1);
+    size_t cy1 = std::max(static_cast<size_t>(std::ceil(fy1)), cy0 + 1);
+    HeightPyramid::Bounds bounds = mPyramid.GetBoundsInRect(cx0, cy0, cx1, cy1);
+    minHeight = bounds.min;
+    maxHeight = bounds.max;
+    return true;
+}
+//-------------------------------------------------------
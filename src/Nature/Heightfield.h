@@ -0,0 +1,234 @@
+/**
+* @file Heightfield.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _HEIGHTFIELD_H_
+#define _HEIGHTFIELD_H_
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "HeightPyramid.h"
+
+/**
+ *	Regular grid of heights in the ground local space.
+ *  Grid lies in the XY plane, heights go along Z.
+ *  Every cell is split into triangles (x+1, y), (x, y+1), (x, y) and (x+1, y+1), (x, y+1), (x+1, y), the same way as the ground mesh.
+ */
+class Heightfield
+{
+    //pyramid level used as tiles by the grid walk
+    static const size_t TILE_LEVEL;
+    //pyramid levels skipped by the hierarchical ray cast when it goes down to the children of a node
+    static const size_t LEVEL_STEP;
+
+    size_t mWidth = 0;
+    size_t mHeight = 0;
+    float mOriginX = 0.0f;
+    float mOriginY = 0.0f;
+    float mStep = 1.0f;
+
+    std::vector<float> mHeights;
+
+    HeightPyramid mPyramid;
+    float mMinHeight = 0.0f;
+    float mMaxHeight = 0.0f;
+    //-------------------------------------------------------
+
+    /**
+     *	Ray in the grid units
+     */
+    struct GridRay
+    {
+        float ox, oy, oz;
+        float dx, dy, dz;
+        float maxDistance;
+    };
+
+    /**
+     *	Intersect ray with the two triangles of a cell
+     *  @param gx, gy - ray origin in the grid units relative to the cell corner
+     *  @return ray parameter or negative value if there is no hit
+     */
+    float IntersectCell(size_t x, size_t y, float gx, float gy, float oz, float gdx, float gdy, float dz) const;
+
+    /**
+     *	Convert a local space ray to the grid units and clip it by the grid bounds
+     *  @return false if the ray misses the bounds
+     */
+    bool ClipRay(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance, GridRay & ray, float & tNear, float & tFar) const;
+
+    /**
+     *	Check if 4 rays are worth tracing as a packet
+     */
+    bool IsCoherentPacket(const float* origins, const float* directions) const;
+
+    /**
+     *	Intersect for x, y, z triples
+     *  @return ray parameter or negative value if there is no hit
+     */
+    float IntersectRay(const float* origin, const float* direction, float maxDistance) const;
+
+    /**
+     *	Walk the pyramid nodes [firstX, lastX] x [firstY, lastY] of a level along the ray,
+     *  nodes which can be crossed by the ray are walked recursively on the level - levelStep.
+     *  @param tBegin, tEnd - part of the ray inside the nodes
+     */
+    bool WalkNodes(const GridRay & ray, size_t level, size_t levelStep, ptrdiff_t firstX, ptrdiff_t firstY, ptrdiff_t lastX, ptrdiff_t lastY, float tBegin, float tEnd, float & hit) const;
+
+public:
+    Heightfield() = default;
+
+    /**
+     *	Allocate grid filled with zero heights
+     *  @param width, height - number of samples
+     *  @param originX, originY - local position of the sample (0, 0)
+     *  @param step - distance between samples
+     */
+    void Reset(size_t width, size_t height, float originX, float originY, float step);
+
+    /**
+     *	Rebuild min/max pyramid, has to be called after heights were changed
+     */
+    void UpdateBounds();
+
+    bool IsEmpty() const
+    {
+        return mHeights.empty();
+    }
+
+    size_t GetWidth() const
+    {
+        return mWidth;
+    }
+
+    size_t GetHeight() const
+    {
+        return mHeight;
+    }
+
+    float GetOriginX() const
+    {
+        return mOriginX;
+    }
+
+    float GetOriginY() const
+    {
+        return mOriginY;
+    }
+
+    float GetStep() const
+    {
+        return mStep;
+    }
+
+    float GetAt(size_t x, size_t y) const
+    {
+        return mHeights[y * mWidth + x];
+    }
+
+    void SetAt(size_t x, size_t y, float h)
+    {
+        mHeights[y * mWidth + x] = h;
+    }
+
+    const float* GetRow(size_t y) const
+    {
+        return &mHeights[y * mWidth];
+    }
+
+    float* GetRow(size_t y)
+    {
+        return &mHeights[y * mWidth];
+    }
+
+    /**
+     *	Check if a local space point is over the grid
+     */
+    bool Contains(float x, float y) const;
+
+    /**
+     *	Height of the triangulated surface at a local space point
+     *  @return false if the point is outside of the grid
+     */
+    std::pair<bool, float> Sample(float x, float y) const;
+
+    /**
+     *	Sample many local space points
+     *  @param xs, ys - coordinates of the points
+     *  @param heights - output, points outside of the grid get the outside value
+     */
+    void SamplePoints(const float* xs, const float* ys, float* heights, size_t count, float outside) const;
+
+    /**
+     *	Sample points (x0 + i * dx, y0 + i * dy), i from [0, count)
+     *  @param heights - output, points outside of the grid get the outside value
+     */
+    void SampleLine(float x0, float y0, float dx, float dy, size_t count, float* heights, float outside) const;
+
+    float GetMinHeight() const
+    {
+        return mMinHeight;
+    }
+
+    float GetMaxHeight() const
+    {
+        return mMaxHeight;
+    }
+
+    /**
+     *	Min/max pyramid over the cells
+     */
+    const HeightPyramid & GetPyramid() const
+    {
+        return mPyramid;
+    }
+
+    /**
+     *	Local space rectangle covered by a pyramid node
+     */
+    void GetNodeRect(size_t level, size_t x, size_t y, float & x0, float & y0, float & x1, float & y1) const;
+
+    /**
+     *	Heights range of the cells overlapping a local space rectangle
+     *  @return false if the rectangle is outside of the grid
+     */
+    bool GetHeightRangeInRect(float x0, float y0, float x1, float y1, float & minHeight, float & maxHeight) const;
+
+    /**
+     *	Find the nearest intersection of a local space ray with the upper side of the surface.
+     *  Walks the min/max pyramid nodes along the ray from the top level down, 
+     *  nodes which are above or below the ray are skipped with all their cells.
+     *  @param ox, oy, oz - ray origin
+     *  @param dx, dy, dz - ray direction, doesn't have to be normalized
+     *  @param maxDistance - max value of the ray parameter
+     *  @return intersection flag and the ray parameter
+     */
+    std::pair<bool, float> Intersect(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+    /**
+     *	Intersect many rays, rays go through the pyramid by packets of 4 with SIMD across the rays.
+     *  Packets of diverging rays are traced one by one, so neighbouring rays should be close to each other.
+     *  @param origins, directions - x, y, z triples
+     *  @param hits - output ray parameters, negative value if the ray misses the surface
+     */
+    void IntersectRays(const float* origins, const float* directions, size_t count, float* hits, float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+    /**
+     *	Same as Intersect, but walks the 16x16 cells tiles along the ray, skipping tiles which are above or below the ray, 
+     *  then walks the cells of the remaining tiles.
+     */
+    std::pair<bool, float> IntersectWalk(float ox, float oy, float oz, float dx, float dy, float dz, float maxDistance = std::numeric_limits<float>::infinity()) const;
+};
+
+
+#endif
@@ -0,0 +1,65 @@
+/**
+* @file ImageTileSource.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "ImageTileSource.h"
+
+#include <fstream>
+
+#include <OgreImage.h>
+#include <OgreDataStream.h>
+#include <OgreException.h>
+#include <OgreLogManager.h>
+
+//-------------------------------------------------------
+ImageTileSource::ImageTileSource(const std::string & directory, const std::string & extension, size_t tileSize, float heightScale):
+    mDirectory(directory), mExtension(extension), mTileSize(tileSize), mHeightScale(heightScale)
+{
+    OgreAssert(mTileSize > 0, "ImageTileSource: tile size must be positive");
+}
+//-------------------------------------------------------
+bool ImageTileSource::LoadTile(int32_t tileX, int32_t tileZ, float* heights)
+{
+    const std::string path = mDirectory + "/tile_" + std::to_string(tileX) + "_" + std::to_string(tileZ) + "." + mExtension;
+    std::ifstream* file = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file->is_open())
+    {
+        OGRE_DELETE_T(file, basic_ifstream, Ogre::MEMCATEGORY_GENERAL);
+        return false;
+    }
+
+    Ogre::Image image;
+    try
+    {
+        Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(path, file, true));
+        image.load(stream, mExtension);
+    }
+    catch (const Ogre::Exception & e)
+    {
+        Ogre::LogManager::getSingleton().logMessage("ImageTileSource: failed to load " + path + ": " + e.getDescription());
+        return false;
+    }
+
+    const size_t samples = mTileSize + 1;
+    const size_t width = image.getWidth();
+    const size_t height = image.getHeight();
+    for (size_t z = 0; z < samples; ++z)
+    {
+        //images rows go from top to bottom, tiles rows go along Z
+        size_t pixelY = (height - 1) - z * (height - 1) / mTileSize;
+        for (size_t x = 0; x < samples; ++x)
+        {
+            size_t pixelX = x * (width - 1) / mTileSize;
+            heights[z * samples + x] = image.getColourAt(pixelX, pixelY, 0)[0] * mHeightScale;
+        }
+    }
+    return true;
+}
+//-------------------------------------------------------
@@ -0,0 +1,53 @@
+/**
+* @file ImageTileSource.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _IMAGE_TILE_SOURCE_H_
+#define _IMAGE_TILE_SOURCE_H_
+
+#include <string>
+
+#include "TerrainTileSource.h"
+
+/**
+ *	Tiles stored as separate grayscale images <directory>/tile_<x>_<z>.<extension>, e.g. tile_-1_0.png
+ *  Images are resampled to the tile size, the red channel is the height.
+ *  Files are opened directly, not through the resource system, so loading is safe on the loader thread.
+ */
+class ImageTileSource
+    : public TerrainTileSource
+{
+    std::string mDirectory;
+    std::string mExtension;
+    size_t mTileSize;
+    float mHeightScale;
+
+public:
+    /**
+     *	@param tileSize - number of quads along a tile side
+     *  @param heightScale - height of the white pixel
+     */
+    ImageTileSource(const std::string & directory, const std::string & extension, size_t tileSize, float heightScale);
+
+    size_t GetTileSize() const override
+    {
+        return mTileSize;
+    }
+
+    float GetMaxHeight() const override
+    {
+        return mHeightScale;
+    }
+
+    bool LoadTile(int32_t tileX, int32_t tileZ, float* heights) override;
+};
+
+
+#endif
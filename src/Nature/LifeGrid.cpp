@@ -0,0 +1,324 @@
+/**
+* @file LifeGrid.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "LifeGrid.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "../Common/WorkerPool.h"
+#include "../Common/Profiler.h"
+
+const size_t LifeGrid::CHUNK_SIZE;
+const size_t LifeGrid::CHUNK_STRIDE;
+
+//kernels overwrite the row up to the alignment, it has to stay inside of the chunk row
+static_assert(0 == LifeGrid::CHUNK_SIZE % LifeKernel::ROW_ALIGNMENT, "Chunk rows have to be aligned for the kernels");
+
+//-------------------------------------------------------
+LifeGrid::LifeGrid(size_t width, size_t height):
+    mWidth(width), mHeight(height)
+{
+    mChunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    mChunksZ = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    mChunks.resize(mChunksX * mChunksZ);
+    mActive.resize(mChunks.size(), 0);
+    mDirty.resize(mChunks.size(), 0);
+}
+//-------------------------------------------------------
+size_t LifeGrid::GetAllocatedChunksNumber() const
+{
+    return static_cast<size_t>(std::count_if(mChunks.cbegin(), mChunks.cend(), [](const std::unique_ptr<Chunk> & chunk) { return nullptr != chunk.get(); }));
+}
+//-------------------------------------------------------
+size_t LifeGrid::GetMemorySize() const
+{
+    return mChunks.size() * (sizeof(std::unique_ptr<Chunk>) + sizeof(uint8_t)) + GetAllocatedChunksNumber() * (sizeof(Chunk) + (3 * sizeof(uint8_t) + sizeof(float)) * CHUNK_STRIDE * CHUNK_STRIDE);
+}
+//-------------------------------------------------------
+void LifeGrid::MarkDirty()
+{
+    std::fill(mDirty.begin(), mDirty.end(), 1);
+}
+//-------------------------------------------------------
+void LifeGrid::SetFree(size_t x, size_t z, bool free, float height)
+{
+    std::unique_ptr<Chunk> & chunk = mChunks[GetChunkIndex(x, z)];
+    if (nullptr == chunk.get())
+    {
+        if (!free)
+        {
+            return;
+        }
+        chunk = std::make_unique<Chunk>();
+        chunk->cells.assign(CHUNK_STRIDE * CHUNK_STRIDE, 0);
+        chunk->cellsNext.assign(CHUNK_STRIDE * CHUNK_STRIDE, 0);
+        chunk->free.assign(CHUNK_STRIDE * CHUNK_STRIDE, 0);
+        chunk->heights.assign(CHUNK_STRIDE * CHUNK_STRIDE, 0.0f);
+    }
+    if (!free)
+    {
+        SetAlive(x, z, false);
+    }
+    chunk->heights[Offset(x, z)] = free ? height : 0.0f;
+    uint8_t & cell = chunk->free[Offset(x, z)];
+    if ((0 != cell) != free)
+    {
+        mDirty[GetChunkIndex(x, z)] = 1;
+        cell = free ? 0xFF : 0x00;
+        if (free)
+        {
+            ++chunk->freeCount;
+        }
+        else if (0 == --chunk->freeCount)
+        {
+            chunk.reset();
+        }
+    }
+}
+//-------------------------------------------------------
+bool LifeGrid::SetAlive(size_t x, size_t z, bool alive)
+{
+    Chunk* chunk = GetChunk(x, z);
+    if (nullptr == chunk)
+    {
+        return false;
+    }
+    uint8_t & cell = chunk->cells[Offset(x, z)];
+    if ((0 != cell) == alive || (alive && 0 == chunk->free[Offset(x, z)]))
+    {
+        return false;
+    }
+    cell = alive ? 1 : 0;
+    mDirty[GetChunkIndex(x, z)] = 1;
+    if (alive)
+    {
+        ++chunk->aliveCount;
+        ++mAliveCount;
+    }
+    else
+    {
+        --chunk->aliveCount;
+        --mAliveCount;
+    }
+    return true;
+}
+//-------------------------------------------------------
+void LifeGrid::UpdateHalo(size_t chunkX, size_t chunkZ)
+{
+    uint8_t* cells = mChunks[chunkZ * mChunksX + chunkX]->cells.data();
+    //neighbour cells or zeros if the neighbour is missing
+    auto neighbour = [this, chunkX, chunkZ](ptrdiff_t dx, ptrdiff_t dz) -> const uint8_t*
+    {
+        ptrdiff_t x = static_cast<ptrdiff_t>(chunkX) + dx;
+        ptrdiff_t z = static_cast<ptrdiff_t>(chunkZ) + dz;
+        if (x < 0 || z < 0 || x >= static_cast<ptrdiff_t>(mChunksX) || z >= static_cast<ptrdiff_t>(mChunksZ))
+        {
+            return nullptr;
+        }
+        const Chunk* chunk = mChunks[z * mChunksX + x].get();
+        return (nullptr != chunk) ? chunk->cells.data() : nullptr;
+    };
+    auto copyRow = [](uint8_t* dst, const uint8_t* src)
+    {
+        if (nullptr != src)
+        {
+            std::copy(src + 1, src + 1 + CHUNK_SIZE, dst + 1);
+        }
+        else
+        {
+            std::fill(dst + 1, dst + 1 + CHUNK_SIZE, 0);
+        }
+    };
+    auto copyCell = [](uint8_t* dst, const uint8_t* src, size_t offset)
+    {
+        *dst = (nullptr != src) ? src[offset] : 0;
+    };
+
+    const size_t last = CHUNK_SIZE;
+    copyRow(cells, neighbour(0, -1) ? neighbour(0, -1) + last * CHUNK_STRIDE : nullptr);
+    copyRow(cells + (CHUNK_SIZE + 1) * CHUNK_STRIDE, neighbour(0, 1) ? neighbour(0, 1) + CHUNK_STRIDE : nullptr);
+    const uint8_t* left = neighbour(-1, 0);
+    const uint8_t* right = neighbour(1, 0);
+    for (size_t z = 1; z <= CHUNK_SIZE; ++z)
+    {
+        copyCell(cells + z * CHUNK_STRIDE, left, z * CHUNK_STRIDE + last);
+        copyCell(cells + z * CHUNK_STRIDE + CHUNK_SIZE + 1, right, z * CHUNK_STRIDE + 1);
+    }
+    copyCell(cells, neighbour(-1, -1), last * CHUNK_STRIDE + last);
+    copyCell(cells + CHUNK_SIZE + 1, neighbour(1, -1), last * CHUNK_STRIDE + 1);
+    copyCell(cells + (CHUNK_SIZE + 1) * CHUNK_STRIDE, neighbour(-1, 1), CHUNK_STRIDE + last);
+    copyCell(cells + (CHUNK_SIZE + 1) * CHUNK_STRIDE + CHUNK_SIZE + 1, neighbour(1, 1), CHUNK_STRIDE + 1);
+}
+//-------------------------------------------------------
+void LifeGrid::StepBand(size_t chunkZ, std::vector<LifeChange> & changes)
+{
+    for (size_t chunkX = 0; chunkX < mChunksX; ++chunkX)
+    {
+        if (0 != mActive[chunkZ * mChunksX + chunkX])
+        {
+            UpdateHalo(chunkX, chunkZ);
+        }
+    }
+
+    //rows go across the chunks, so changes are collected in ascending cell order
+    const size_t zEnd = std::min(mHeight, (chunkZ + 1) * CHUNK_SIZE);
+    for (size_t z = chunkZ * CHUNK_SIZE; z < zEnd; ++z)
+    {
+        for (size_t chunkX = 0; chunkX < mChunksX; ++chunkX)
+        {
+            if (0 == mActive[chunkZ * mChunksX + chunkX])
+            {
+                continue;
+            }
+            Chunk & chunk = *mChunks[chunkZ * mChunksX + chunkX];
+            const size_t offset = Offset(0, z);
+            const uint8_t* row = &chunk.cells[offset];
+            uint8_t* next = &chunk.cellsNext[offset];
+            LifeKernel::StepRow(row - CHUNK_STRIDE, row, row + CHUNK_STRIDE, &chunk.free[offset], next, CHUNK_SIZE);
+
+            const size_t first = changes.size();
+            LifeKernel::CollectChanges(row, next, CHUNK_SIZE, GetCellIndex(chunkX * CHUNK_SIZE, z), changes);
+            if (first != changes.size())
+            {
+                mDirty[chunkZ * mChunksX + chunkX] = 1;
+            }
+            for (size_t i = first; i < changes.size(); ++i)
+            {
+                if (LifeChange::BORN == changes[i].type)
+                {
+                    ++chunk.aliveCount;
+                }
+                else
+                {
+                    --chunk.aliveCount;
+                }
+            }
+        }
+    }
+}
+//-------------------------------------------------------
+void LifeGrid::Step(std::vector<LifeChange> & changes, WorkerPool* pool)
+{
+    //cells can change only next to the last changes, and trees can appear only next to other trees
+    size_t activeChunks = 0;
+    for (size_t chunkZ = 0; chunkZ < mChunksZ; ++chunkZ)
+    {
+        for (size_t chunkX = 0; chunkX < mChunksX; ++chunkX)
+        {
+            bool dirty = false;
+            bool alive = false;
+            if (nullptr != mChunks[chunkZ * mChunksX + chunkX].get())
+            {
+                for (size_t z = (chunkZ > 0 ? chunkZ - 1 : 0); z <= std::min(chunkZ + 1, mChunksZ - 1); ++z)
+                {
+                    for (size_t x = (chunkX > 0 ? chunkX - 1 : 0); x <= std::min(chunkX + 1, mChunksX - 1); ++x)
+                    {
+                        const Chunk* neighbour = mChunks[z * mChunksX + x].get();
+                        dirty = dirty || 0 != mDirty[z * mChunksX + x];
+                        alive = alive || (nullptr != neighbour && neighbour->aliveCount > 0);
+                    }
+                }
+            }
+            mActive[chunkZ * mChunksX + chunkX] = (dirty && alive) ? 1 : 0;
+            activeChunks += (dirty && alive) ? 1 : 0;
+        }
+    }
+    std::fill(mDirty.begin(), mDirty.end(), 0);
+    mEvaluatedCells = activeChunks * CHUNK_SIZE * CHUNK_SIZE;
+
+    //every band writes only its own chunks and its own changes list, halos are read from the current generation
+    if (nullptr == pool || 1 == pool->GetThreadsNumber() || 1 == mChunksZ)
+    {
+        changes.clear();
+        for (size_t chunkZ = 0; chunkZ < mChunksZ; ++chunkZ)
+        {
+            StepBand(chunkZ, changes);
+        }
+    }
+    else
+    {
+        mBandChanges.resize(mChunksZ);
+        pool->ParallelFor(mChunksZ, [this](size_t chunkZ)
+        {
+            PROFILE_ZONE("Life band");
+            mBandChanges[chunkZ].clear();
+            StepBand(chunkZ, mBandChanges[chunkZ]);
+        });
+
+        //merge in band order
+        size_t total = 0;
+        for (const auto & bandChanges : mBandChanges)
+        {
+            total += bandChanges.size();
+        }
+        changes.clear();
+        changes.reserve(total);
+        for (const auto & bandChanges : mBandChanges)
+        {
+            changes.insert(changes.end(), bandChanges.cbegin(), bandChanges.cend());
+        }
+    }
+
+    //neighbour bands read the current generation until all of them are done
+    mAliveCount = 0;
+    for (size_t i = 0; i < mChunks.size(); ++i)
+    {
+        if (0 != mActive[i])
+        {
+            std::swap(mChunks[i]->cells, mChunks[i]->cellsNext);
+        }
+        if (nullptr != mChunks[i].get())
+        {
+            mAliveCount += mChunks[i]->aliveCount;
+        }
+    }
+}
+//-------------------------------------------------------
+size_t LifeGrid::LimitPopulation(std::vector<LifeChange> & changes, size_t maxAlive, float focusX, float focusZ)
+{
+    if (mAliveCount <= maxAlive)
+    {
+        return 0;
+    }
+
+    mBirthPriorities.clear();
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        if (LifeChange::BORN == changes[i].type)
+        {
+            float dx = static_cast<float>(changes[i].cell % mWidth) - focusX;
+            float dz = static_cast<float>(changes[i].cell / mWidth) - focusZ;
+            mBirthPriorities.emplace_back(dx * dx + dz * dz, static_cast<uint32_t>(i));
+        }
+    }
+
+    size_t rejected = std::min(mAliveCount - maxAlive, mBirthPriorities.size());
+    size_t accepted = mBirthPriorities.size() - rejected;
+    //pairs are unique because of the index, so the selection is deterministic
+    std::nth_element(mBirthPriorities.begin(), mBirthPriorities.begin() + accepted, mBirthPriorities.end());
+    for (auto it = mBirthPriorities.cbegin() + accepted; it != mBirthPriorities.cend(); ++it)
+    {
+        LifeChange & change = changes[it->second];
+        const size_t x = change.cell % mWidth;
+        const size_t z = change.cell / mWidth;
+        Chunk* chunk = GetChunk(x, z);
+        chunk->cells[Offset(x, z)] = 0;
+        --chunk->aliveCount;
+        mDirty[GetChunkIndex(x, z)] = 1;
+        change.type = 0;
+    }
+    mAliveCount -= rejected;
+
+    changes.erase(std::remove_if(changes.begin(), changes.end(), [](const LifeChange & change) { return 0 == change.type; }), changes.end());
+    return rejected;
+}
+//-------------------------------------------------------
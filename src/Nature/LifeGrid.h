@@ -0,0 +1,214 @@
+/**
+* @file LifeGrid.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _LIFE_GRID_H_
+#define _LIFE_GRID_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "LifeKernel.h"
+
+class WorkerPool;
+
+/**
+ *	Forest field stored by square chunks of parallel planes: alive and free bytes, which the life rule reads, and cached ground heights.
+ *  All planes of a chunk share the same padded layout, so one offset addresses a cell in every plane.
+ *  Chunks are allocated only where free cells exist, cells of missing chunks are blocked.
+ *  Cells outside of the grid are blocked and never alive.
+ */
+class LifeGrid
+{
+public:
+    static const size_t CHUNK_SIZE = 64;
+
+private:
+    //chunk planes have one halo cell around the chunk cells
+    static const size_t CHUNK_STRIDE = CHUNK_SIZE + 2;
+
+    struct Chunk
+    {
+        std::vector<uint8_t> cells;
+        std::vector<uint8_t> cellsNext;
+        std::vector<uint8_t> free;
+        //not read by the steps, the halo is unused
+        std::vector<float> heights;
+        size_t freeCount = 0;
+        size_t aliveCount = 0;
+    };
+
+    size_t mWidth;
+    size_t mHeight;
+    size_t mChunksX;
+    size_t mChunksZ;
+
+    std::vector<std::unique_ptr<Chunk> > mChunks;
+    //chunks computed by the current step
+    std::vector<uint8_t> mActive;
+    //chunks where cells changed since the previous step, only they and their neighbours can change in the next one
+    std::vector<uint8_t> mDirty;
+
+    size_t mAliveCount = 0;
+    size_t mEvaluatedCells = 0;
+
+    std::vector<std::vector<LifeChange> > mBandChanges;
+    std::vector<std::pair<float, uint32_t> > mBirthPriorities;
+    //-------------------------------------------------------
+
+    static size_t Offset(size_t x, size_t z)
+    {
+        return (z % CHUNK_SIZE + 1) * CHUNK_STRIDE + x % CHUNK_SIZE + 1;
+    }
+
+    size_t GetChunkIndex(size_t x, size_t z) const
+    {
+        return (z / CHUNK_SIZE) * mChunksX + x / CHUNK_SIZE;
+    }
+
+    Chunk* GetChunk(size_t x, size_t z) const
+    {
+        return mChunks[GetChunkIndex(x, z)].get();
+    }
+
+    /**
+     *	Copy border cells of the neighbours into the halo of a chunk
+     */
+    void UpdateHalo(size_t chunkX, size_t chunkZ);
+
+    /**
+     *	Compute chunk row band of the next generation, reads only the current generation
+     */
+    void StepBand(size_t chunkZ, std::vector<LifeChange> & changes);
+
+public:
+    /**
+     *	Create grid where all cells are empty and blocked
+     */
+    LifeGrid(size_t width, size_t height);
+
+    size_t GetWidth() const
+    {
+        return mWidth;
+    }
+
+    size_t GetHeight() const
+    {
+        return mHeight;
+    }
+
+    size_t GetAliveCount() const
+    {
+        return mAliveCount;
+    }
+
+    uint32_t GetCellIndex(size_t x, size_t z) const
+    {
+        return static_cast<uint32_t>(z * mWidth + x);
+    }
+
+    bool IsFree(size_t x, size_t z) const
+    {
+        const Chunk* chunk = GetChunk(x, z);
+        return nullptr != chunk && 0 != chunk->free[Offset(x, z)];
+    }
+
+    bool IsAlive(size_t x, size_t z) const
+    {
+        const Chunk* chunk = GetChunk(x, z);
+        return nullptr != chunk && 0 != chunk->cells[Offset(x, z)];
+    }
+
+    /**
+     *	Ground height set for a free cell, 0 for blocked cells
+     */
+    float GetCellHeight(size_t x, size_t z) const
+    {
+        const Chunk* chunk = GetChunk(x, z);
+        return (nullptr != chunk) ? chunk->heights[Offset(x, z)] : 0.0f;
+    }
+
+    /**
+     *	Check if the chunk of a cell has free cells
+     */
+    bool HasChunk(size_t x, size_t z) const
+    {
+        return nullptr != GetChunk(x, z);
+    }
+
+    /**
+     *	Compute all chunks in the next step, e.g. after the cells were set to a state several generations ahead
+     */
+    void MarkDirty();
+
+    /**
+     *	Number of cells computed by the last step
+     */
+    size_t GetEvaluatedCellsNumber() const
+    {
+        return mEvaluatedCells;
+    }
+
+    /**
+     *	Number of chunks covering the grid
+     */
+    size_t GetChunksNumber() const
+    {
+        return mChunks.size();
+    }
+
+    /**
+     *	Number of chunks having free cells
+     */
+    size_t GetAllocatedChunksNumber() const;
+
+    /**
+     *	Memory used by the cells in bytes
+     */
+    size_t GetMemorySize() const;
+
+    /**
+     *	Mark cell as free or blocked, blocked cell loses its tree.
+     *  The chunk is allocated by its first free cell and released by its last one.
+     *  @param height - ground height of a free cell
+     */
+    void SetFree(size_t x, size_t z, bool free, float height = 0.0f);
+
+    /**
+     *	Plant or remove a tree, trees can be planted only in free cells
+     *  @return true if the cell state was changed
+     */
+    bool SetAlive(size_t x, size_t z, bool alive);
+
+    /**
+     *	Advance one generation, only chunks with changed cells around and trees around are computed.
+     *  Rows of chunks are processed by the pool, the result doesn't depend on the number of threads
+     *  @param changes - births and deaths in ascending cell order
+     *  @param pool - optional worker pool
+     */
+    void Step(std::vector<LifeChange> & changes, WorkerPool* pool = nullptr);
+
+    /**
+     *	Reject births of the last step exceeding the population limit, rejected cells stay empty.
+     *  Births closer to the focus point win, ties are resolved by the cell index.
+     *  Deaths are never rejected, so the population can stay above the limit only if it was there before the step.
+     *  @param changes - changes of the last step, rejected births are removed
+     *  @param maxAlive - population limit
+     *  @param focusX, focusZ - focus point in cells
+     *  @return number of rejected births
+     */
+    size_t LimitPopulation(std::vector<LifeChange> & changes, size_t maxAlive, float focusX, float focusZ);
+};
+
+
+#endif
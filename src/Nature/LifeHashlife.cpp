@@ -0,0 +1,357 @@
+/**
+* @file LifeHashlife.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "LifeHashlife.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "LifeGrid.h"
+
+const LifeHashlife::NodeId LifeHashlife::INVALID_NODE = std::numeric_limits<LifeHashlife::NodeId>::max();
+const size_t LifeHashlife::MAX_NODES = 1 << 22;
+const uint32_t LifeHashlife::MAX_STEP = 10;
+const uint32_t LifeHashlife::CHAOS_MIN_STEP = 2;
+const size_t LifeHashlife::CHAOS_CELLS_PER_NODE = 256;
+const size_t LifeHashlife::NOISE_CELLS_PER_NODE = 32;
+
+//-------------------------------------------------------
+LifeHashlife::LifeHashlife()
+{
+    Reset();
+}
+//-------------------------------------------------------
+void LifeHashlife::Reset()
+{
+    mNodes.clear();
+    mJoins.clear();
+    mSteps.clear();
+    mBlocked.clear();
+    //cells are the nodes of level 0, their ids are the cell states
+    mNodes.assign(CELL_ALIVE + 1, { INVALID_NODE, INVALID_NODE, INVALID_NODE, INVALID_NODE, INVALID_NODE, 0 });
+    mBlocked.push_back(CELL_BLOCKED);
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::Join(NodeId nw, NodeId ne, NodeId sw, NodeId se)
+{
+    const std::pair<uint64_t, uint64_t> key((static_cast<uint64_t>(nw) << 32) | ne, (static_cast<uint64_t>(sw) << 32) | se);
+    auto it = mJoins.find(key);
+    if (it != mJoins.end())
+    {
+        return it->second;
+    }
+    assert(mNodes[nw].level == mNodes[ne].level && mNodes[nw].level == mNodes[sw].level && mNodes[nw].level == mNodes[se].level);
+    const NodeId id = static_cast<NodeId>(mNodes.size());
+    mNodes.push_back({ nw, ne, sw, se, INVALID_NODE, mNodes[nw].level + 1 });
+    mJoins.emplace(key, id);
+    return id;
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::GetBlocked(uint32_t level)
+{
+    while (mBlocked.size() <= level)
+    {
+        const NodeId child = mBlocked.back();
+        mBlocked.push_back(Join(child, child, child, child));
+    }
+    return mBlocked[level];
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::Expand(NodeId node)
+{
+    const Node n = mNodes[node];
+    const NodeId blocked = GetBlocked(n.level - 1);
+    return Join(Join(blocked, blocked, blocked, n.nw), Join(blocked, blocked, n.ne, blocked),
+        Join(blocked, n.sw, blocked, blocked), Join(n.se, blocked, blocked, blocked));
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::StepLeaf(NodeId node)
+{
+    //4x4 cells, row by row from the north-west corner
+    NodeId cells[4][4];
+    const Node & n = mNodes[node];
+    const NodeId quadrants[4] = { n.nw, n.ne, n.sw, n.se };
+    for (size_t q = 0; q < 4; ++q)
+    {
+        const Node & quadrant = mNodes[quadrants[q]];
+        const size_t x = (q % 2) * 2;
+        const size_t z = (q / 2) * 2;
+        cells[z][x] = quadrant.nw;
+        cells[z][x + 1] = quadrant.ne;
+        cells[z + 1][x] = quadrant.sw;
+        cells[z + 1][x + 1] = quadrant.se;
+    }
+
+    NodeId next[2][2];
+    for (size_t z = 1; z < 3; ++z)
+    {
+        for (size_t x = 1; x < 3; ++x)
+        {
+            NodeId state = cells[z][x];
+            if (CELL_BLOCKED != state)
+            {
+                size_t sum = 0;
+                for (size_t dz = 0; dz < 3; ++dz)
+                {
+                    for (size_t dx = 0; dx < 3; ++dx)
+                    {
+                        sum += (CELL_ALIVE == cells[z + dz - 1][x + dx - 1]) ? 1 : 0;
+                    }
+                }
+                sum -= (CELL_ALIVE == state) ? 1 : 0;
+                state = (sum >= 3 && sum <= 4) ? CELL_ALIVE : CELL_FREE;
+            }
+            next[z - 1][x - 1] = state;
+        }
+    }
+    return Join(next[0][0], next[0][1], next[1][0], next[1][1]);
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::Successor(NodeId node, uint32_t step)
+{
+    const uint32_t level = mNodes[node].level;
+    assert(level >= 2 && step <= level - 2);
+    const bool fullStep = (step == level - 2);
+    if (fullStep && INVALID_NODE != mNodes[node].result)
+    {
+        return mNodes[node].result;
+    }
+    const uint64_t stepKey = (static_cast<uint64_t>(node) << 8) | step;
+    if (!fullStep)
+    {
+        auto it = mSteps.find(stepKey);
+        if (it != mSteps.end())
+        {
+            return it->second;
+        }
+    }
+
+    NodeId result;
+    if (2 == level)
+    {
+        result = StepLeaf(node);
+    }
+    else
+    {
+        //9 overlapping sub-nodes of the half size, advanced by the first half of the time (or the whole time for the small steps)
+        const uint32_t subStep = fullStep ? level - 3 : step;
+        const Node n = mNodes[node];
+        const Node nw = mNodes[n.nw];
+        const Node ne = mNodes[n.ne];
+        const Node sw = mNodes[n.sw];
+        const Node se = mNodes[n.se];
+        const NodeId c[9] = {
+            Successor(n.nw, subStep), Successor(Join(nw.ne, ne.nw, nw.se, ne.sw), subStep), Successor(n.ne, subStep),
+            Successor(Join(nw.sw, nw.se, sw.nw, sw.ne), subStep), Successor(Join(nw.se, ne.sw, sw.ne, se.nw), subStep), Successor(Join(ne.sw, ne.se, se.nw, se.ne), subStep),
+            Successor(n.sw, subStep), Successor(Join(sw.ne, se.nw, sw.se, se.sw), subStep), Successor(n.se, subStep)
+        };
+        if (fullStep)
+        {
+            //second half of the time
+            result = Join(Successor(Join(c[0], c[1], c[3], c[4]), subStep), Successor(Join(c[1], c[2], c[4], c[5]), subStep),
+                Successor(Join(c[3], c[4], c[6], c[7]), subStep), Successor(Join(c[4], c[5], c[7], c[8]), subStep));
+        }
+        else
+        {
+            //centers of the sub-nodes without advancing
+            auto center = [this, &c](size_t i0, size_t i1, size_t i2, size_t i3)
+            {
+                return Join(mNodes[c[i0]].se, mNodes[c[i1]].sw, mNodes[c[i2]].ne, mNodes[c[i3]].nw);
+            };
+            result = Join(center(0, 1, 3, 4), center(1, 2, 4, 5), center(3, 4, 6, 7), center(4, 5, 7, 8));
+        }
+    }
+
+    if (fullStep)
+    {
+        mNodes[node].result = result;
+    }
+    else
+    {
+        mSteps.emplace(stepKey, result);
+    }
+    return result;
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::Build(const LifeGrid & grid, size_t x, size_t z, uint32_t level)
+{
+    const size_t size = static_cast<size_t>(1) << level;
+    if (x >= grid.GetWidth() || z >= grid.GetHeight())
+    {
+        return GetBlocked(level);
+    }
+    if (0 == level)
+    {
+        return grid.IsAlive(x, z) ? CELL_ALIVE : (grid.IsFree(x, z) ? CELL_FREE : CELL_BLOCKED);
+    }
+    //missing chunks have no free cells
+    if (size == LifeGrid::CHUNK_SIZE && !grid.HasChunk(x, z))
+    {
+        return GetBlocked(level);
+    }
+    const size_t half = size / 2;
+    return Join(Build(grid, x, z, level - 1), Build(grid, x + half, z, level - 1), Build(grid, x, z + half, level - 1), Build(grid, x + half, z + half, level - 1));
+}
+//-------------------------------------------------------
+void LifeHashlife::Diff(const LifeGrid & grid, NodeId before, NodeId after, size_t x, size_t z, std::vector<LifeChange> & changes) const
+{
+    if (before == after || x >= grid.GetWidth() || z >= grid.GetHeight())
+    {
+        return;
+    }
+    const Node & b = mNodes[before];
+    if (0 == b.level)
+    {
+        changes.push_back({ grid.GetCellIndex(x, z), (CELL_ALIVE == after) ? LifeChange::BORN : LifeChange::DIED });
+        return;
+    }
+    const Node & a = mNodes[after];
+    const size_t half = static_cast<size_t>(1) << (b.level - 1);
+    Diff(grid, b.nw, a.nw, x, z, changes);
+    Diff(grid, b.ne, a.ne, x + half, z, changes);
+    Diff(grid, b.sw, a.sw, x, z + half, changes);
+    Diff(grid, b.se, a.se, x + half, z + half, changes);
+}
+//-------------------------------------------------------
+LifeHashlife::NodeId LifeHashlife::Import(const std::vector<Node> & nodes, NodeId node, std::unordered_map<NodeId, NodeId> & imported)
+{
+    if (node <= CELL_ALIVE)
+    {
+        return node;
+    }
+    auto it = imported.find(node);
+    if (it != imported.end())
+    {
+        return it->second;
+    }
+    const Node & n = nodes[node];
+    const NodeId id = Join(Import(nodes, n.nw, imported), Import(nodes, n.ne, imported), Import(nodes, n.sw, imported), Import(nodes, n.se, imported));
+    imported.emplace(node, id);
+    return id;
+}
+//-------------------------------------------------------
+void LifeHashlife::Compact(NodeId & first, NodeId & second)
+{
+    std::vector<Node> nodes;
+    nodes.swap(mNodes);
+    Reset();
+    std::unordered_map<NodeId, NodeId> imported;
+    first = Import(nodes, first, imported);
+    second = Import(nodes, second, imported);
+}
+//-------------------------------------------------------
+void LifeHashlife::GetChanges(const LifeGrid & grid, NodeId before, NodeId after, std::vector<LifeChange> & changes) const
+{
+    changes.clear();
+    Diff(grid, before, after, 0, 0, changes);
+    //quadrants order differs from the rows order
+    std::sort(changes.begin(), changes.end(), [](const LifeChange & lhs, const LifeChange & rhs) { return lhs.cell < rhs.cell; });
+}
+//-------------------------------------------------------
+void LifeHashlife::Apply(LifeGrid & grid, NodeId before, NodeId after, std::vector<LifeChange> & changes) const
+{
+    GetChanges(grid, before, after, changes);
+    for (const LifeChange & change : changes)
+    {
+        grid.SetAlive(change.cell % grid.GetWidth(), change.cell / grid.GetWidth(), LifeChange::BORN == change.type);
+    }
+}
+//-------------------------------------------------------
+void LifeHashlife::FinishBySteps(LifeGrid & grid, NodeId initial, NodeId field, uint32_t level, uint64_t generations, std::vector<LifeChange> & changes)
+{
+    Apply(grid, initial, field, changes);
+    grid.MarkDirty();
+    std::vector<LifeChange> stepChanges;
+    for (uint64_t generation = 0; generation < generations; ++generation)
+    {
+        grid.Step(stepChanges);
+    }
+    GetChanges(grid, initial, Build(grid, 0, 0, level), changes);
+    Reset();
+}
+//-------------------------------------------------------
+void LifeHashlife::Advance(LifeGrid & grid, uint64_t generations, std::vector<LifeChange> & changes)
+{
+    changes.clear();
+    if (0 == generations || 0 == grid.GetWidth() || 0 == grid.GetHeight())
+    {
+        return;
+    }
+
+    //a generation filling the memo and a short step detecting the fields which don't repeat go first,
+    //then the bits of the rest up to the max step and the max steps
+    std::vector<uint32_t> steps;
+    uint64_t rest = generations;
+    for (uint32_t step : { 0u, CHAOS_MIN_STEP })
+    {
+        if (rest >= (static_cast<uint64_t>(1) << step))
+        {
+            steps.push_back(step);
+            rest -= static_cast<uint64_t>(1) << step;
+        }
+    }
+    for (uint32_t step = 0; step < MAX_STEP; ++step)
+    {
+        if (0 != (rest & (static_cast<uint64_t>(1) << step)))
+        {
+            steps.push_back(step);
+        }
+    }
+    steps.insert(steps.end(), static_cast<size_t>(rest >> MAX_STEP), MAX_STEP);
+
+    //the field node has to be big enough for the largest step
+    uint32_t level = *std::max_element(steps.begin(), steps.end()) + 1;
+    while ((static_cast<size_t>(1) << level) < std::max(grid.GetWidth(), grid.GetHeight()))
+    {
+        ++level;
+    }
+    const size_t cells = grid.GetAllocatedChunksNumber() * LifeGrid::CHUNK_SIZE * LifeGrid::CHUNK_SIZE;
+
+    //expanded node has the field in its center, center of the successor is the field again
+    NodeId initial = Build(grid, 0, 0, level);
+    if (mNodes.size() > cells / NOISE_CELLS_PER_NODE)
+    {
+        //nothing repeats even in the initial field, e.g. a noisy free mask, the first hashlife steps would cost more than the plain ones
+        FinishBySteps(grid, initial, initial, level, generations, changes);
+        return;
+    }
+    NodeId field = initial;
+    uint64_t done = 0;
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        const size_t before = mNodes.size();
+        field = Successor(Expand(field), steps[i]);
+        done += static_cast<uint64_t>(1) << steps[i];
+        const size_t created = mNodes.size() - before;
+
+        //the first step fills the memo, so it creates many nodes anyway
+        if (i > 0 && steps[i] >= CHAOS_MIN_STEP && created > ((cells / CHAOS_CELLS_PER_NODE) << steps[i]))
+        {
+            //almost every node is new, the field is boiling and the plain steps are faster
+            FinishBySteps(grid, initial, field, level, generations - done, changes);
+            return;
+        }
+        if (mNodes.size() > MAX_NODES)
+        {
+            Compact(initial, field);
+        }
+    }
+
+    Apply(grid, initial, field, changes);
+    //cells which look unchanged after the jump can still change in the next generation
+    grid.MarkDirty();
+    if (mNodes.size() > MAX_NODES)
+    {
+        Reset();
+    }
+}
+//-------------------------------------------------------
@@ -0,0 +1,158 @@
+/**
+* @file LifeHashlife.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _LIFE_HASHLIFE_H_
+#define _LIFE_HASHLIFE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "LifeKernel.h"
+
+class LifeGrid;
+
+/**
+ *	Fast forward of the forest life rule by the Hashlife algorithm.
+ *  The field is a quadtree of unique nodes, a cell is blocked, free or alive, so the free mask is a part of the nodes.
+ *  Future of the node center is memoized, so repeating and blocked parts of the field are computed once.
+ *  Cells outside of the grid are blocked, nothing grows there.
+ */
+class LifeHashlife
+{
+public:
+    using NodeId = uint32_t;
+
+private:
+    static const NodeId INVALID_NODE;
+    //nodes limit, unused nodes are dropped when there are more of them
+    static const size_t MAX_NODES;
+    //largest step is 2^MAX_STEP generations, longer runs are split, so the nodes can be compacted between the steps
+    static const uint32_t MAX_STEP;
+    //a step of 2^CHAOS_MIN_STEP generations or longer creating a node per CHAOS_CELLS_PER_NODE free cells per generation
+    //means the field doesn't repeat, it is finished by the plain steps
+    static const uint32_t CHAOS_MIN_STEP;
+    static const size_t CHAOS_CELLS_PER_NODE;
+    //an initial field with a node per NOISE_CELLS_PER_NODE cells is stepped without hashlife
+    static const size_t NOISE_CELLS_PER_NODE;
+
+    enum CellState : NodeId
+    {
+        CELL_BLOCKED = 0,
+        CELL_FREE = 1,
+        CELL_ALIVE = 2
+    };
+
+    struct Node
+    {
+        //children quadrants: north-west, north-east, south-west, south-east, north has smaller z
+        NodeId nw, ne, sw, se;
+        //center after 2^(level - 2) generations
+        NodeId result;
+        uint32_t level;
+    };
+
+    struct ChildrenHash
+    {
+        size_t operator()(const std::pair<uint64_t, uint64_t> & key) const
+        {
+            return static_cast<size_t>((key.first * 0x9E3779B97F4A7C15ULL) ^ (key.second + 0x632BE59BD9B4E019ULL + (key.first >> 7)));
+        }
+    };
+
+    std::vector<Node> mNodes;
+    std::unordered_map<std::pair<uint64_t, uint64_t>, NodeId, ChildrenHash> mJoins;
+    //center after 2^step generations for steps smaller than the node result step, key is (node, step)
+    std::unordered_map<uint64_t, NodeId> mSteps;
+    //fully blocked node of every level
+    std::vector<NodeId> mBlocked;
+    //-------------------------------------------------------
+
+    void Reset();
+
+    NodeId Join(NodeId nw, NodeId ne, NodeId sw, NodeId se);
+
+    NodeId GetBlocked(uint32_t level);
+
+    /**
+     *	Same node surrounded by blocked cells, one level up
+     */
+    NodeId Expand(NodeId node);
+
+    /**
+     *	One generation of the 2x2 center of a level 2 node
+     */
+    NodeId StepLeaf(NodeId node);
+
+    /**
+     *	Center of a node after 2^step generations, step <= level - 2
+     */
+    NodeId Successor(NodeId node, uint32_t step);
+
+    /**
+     *	Quadtree node of the grid area [x, x + 2^level) x [z, z + 2^level)
+     */
+    NodeId Build(const LifeGrid & grid, size_t x, size_t z, uint32_t level);
+
+    /**
+     *	Append cells which differ in two nodes of the same area
+     */
+    void Diff(const LifeGrid & grid, NodeId before, NodeId after, size_t x, size_t z, std::vector<LifeChange> & changes) const;
+
+    /**
+     *	Cells which differ in two nodes of the whole grid in ascending cell order
+     */
+    void GetChanges(const LifeGrid & grid, NodeId before, NodeId after, std::vector<LifeChange> & changes) const;
+
+    /**
+     *	Set grid cells from the after node
+     *  @param changes - difference in ascending cell order
+     */
+    void Apply(LifeGrid & grid, NodeId before, NodeId after, std::vector<LifeChange> & changes) const;
+
+    /**
+     *	Set the grid to the field node and make the rest of generations by LifeGrid::Step, the memo is dropped
+     *  @param changes - difference between the initial node and the final state
+     */
+    void FinishBySteps(LifeGrid & grid, NodeId initial, NodeId field, uint32_t level, uint64_t generations, std::vector<LifeChange> & changes);
+
+    /**
+     *	Copy a node of another table into this one
+     */
+    NodeId Import(const std::vector<Node> & nodes, NodeId node, std::unordered_map<NodeId, NodeId> & imported);
+
+    /**
+     *	Drop all nodes and memo except of two nodes, ids are updated
+     */
+    void Compact(NodeId & first, NodeId & second);
+
+public:
+    LifeHashlife();
+
+    /**
+     *	Advance the grid by a number of generations, the same result as calling LifeGrid::Step for every generation.
+     *  Fields which don't repeat are finished by LifeGrid::Step after the first steps.
+     *  @param changes - difference between the initial and the final state in ascending cell order
+     */
+    void Advance(LifeGrid & grid, uint64_t generations, std::vector<LifeChange> & changes);
+
+    /**
+     *	Number of unique nodes kept for the next calls
+     */
+    size_t GetNodesNumber() const
+    {
+        return mNodes.size();
+    }
+};
+
+
+#endif
@@ -0,0 +1,278 @@
+/**
+* @file LifeKernel.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "LifeKernel.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LIFE_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#define LIFE_KERNEL_TARGET_AVX2
+#else
+#define LIFE_KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+    typedef void(*StepRowFunc)(const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, size_t);
+    typedef void(*CollectChangesFunc)(const uint8_t*, const uint8_t*, size_t, uint32_t, std::vector<LifeChange>&);
+
+    inline uint32_t CountTrailingZeros(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return static_cast<uint32_t>(idx);
+#else
+        return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+    }
+
+    inline void EmitChanges(uint32_t mask, const uint8_t* next, size_t x, uint32_t firstCell, std::vector<LifeChange> & changes)
+    {
+        while (0 != mask)
+        {
+            size_t i = x + CountTrailingZeros(mask);
+            changes.push_back({ firstCell + static_cast<uint32_t>(i), next[i] ? LifeChange::BORN : LifeChange::DIED });
+            mask &= mask - 1;
+        }
+    }
+    //-------------------------------------------------------
+
+    void StepRowScalar(const uint8_t* above, const uint8_t* row, const uint8_t* below, const uint8_t* free, uint8_t* next, size_t count)
+    {
+        for (size_t x = 0; x < count; ++x)
+        {
+            uint8_t sum = above[x - 1] + above[x] + above[x + 1] + row[x - 1] + row[x + 1] + below[x - 1] + below[x] + below[x + 1];
+            next[x] = (free[x] && sum >= 3 && sum <= 4) ? 1 : 0;
+        }
+    }
+
+    void CollectChangesScalar(const uint8_t* row, const uint8_t* next, size_t count, uint32_t firstCell, std::vector<LifeChange> & changes)
+    {
+        for (size_t x = 0; x < count; ++x)
+        {
+            if (row[x] != next[x])
+            {
+                changes.push_back({ firstCell + static_cast<uint32_t>(x), next[x] ? LifeChange::BORN : LifeChange::DIED });
+            }
+        }
+    }
+    //-------------------------------------------------------
+
+#ifdef LIFE_KERNEL_X86
+    inline __m128i Load128(const uint8_t* ptr)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    }
+
+    void StepRowSse2(const uint8_t* above, const uint8_t* row, const uint8_t* below, const uint8_t* free, uint8_t* next, size_t count)
+    {
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i three = _mm_set1_epi8(3);
+        for (size_t x = 0; x < count; x += 16)
+        {
+            __m128i sum = _mm_add_epi8(Load128(above + x - 1), Load128(above + x));
+            sum = _mm_add_epi8(sum, Load128(above + x + 1));
+            sum = _mm_add_epi8(sum, Load128(row + x - 1));
+            sum = _mm_add_epi8(sum, Load128(row + x + 1));
+            sum = _mm_add_epi8(sum, Load128(below + x - 1));
+            sum = _mm_add_epi8(sum, Load128(below + x));
+            sum = _mm_add_epi8(sum, Load128(below + x + 1));
+            //3 and 4 are mapped to 0 and 1, everything else wraps to larger unsigned values
+            __m128i shifted = _mm_sub_epi8(sum, three);
+            __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(shifted, one), shifted);
+            __m128i alive = _mm_and_si128(_mm_and_si128(inRange, Load128(free + x)), one);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(next + x), alive);
+        }
+    }
+
+    void CollectChangesSse2(const uint8_t* row, const uint8_t* next, size_t count, uint32_t firstCell, std::vector<LifeChange> & changes)
+    {
+        for (size_t x = 0; x < count; x += 16)
+        {
+            __m128i same = _mm_cmpeq_epi8(Load128(row + x), Load128(next + x));
+            uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(same)) & 0xFFFFu;
+            if (count - x < 16)
+            {
+                mask &= (1u << (count - x)) - 1;
+            }
+            EmitChanges(mask, next, x, firstCell, changes);
+        }
+    }
+    //-------------------------------------------------------
+
+    LIFE_KERNEL_TARGET_AVX2
+    inline __m256i Load256(const uint8_t* ptr)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    }
+
+    LIFE_KERNEL_TARGET_AVX2
+    void StepRowAvx2(const uint8_t* above, const uint8_t* row, const uint8_t* below, const uint8_t* free, uint8_t* next, size_t count)
+    {
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i three = _mm256_set1_epi8(3);
+        for (size_t x = 0; x < count; x += 32)
+        {
+            __m256i sum = _mm256_add_epi8(Load256(above + x - 1), Load256(above + x));
+            sum = _mm256_add_epi8(sum, Load256(above + x + 1));
+            sum = _mm256_add_epi8(sum, Load256(row + x - 1));
+            sum = _mm256_add_epi8(sum, Load256(row + x + 1));
+            sum = _mm256_add_epi8(sum, Load256(below + x - 1));
+            sum = _mm256_add_epi8(sum, Load256(below + x));
+            sum = _mm256_add_epi8(sum, Load256(below + x + 1));
+            __m256i shifted = _mm256_sub_epi8(sum, three);
+            __m256i inRange = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, one), shifted);
+            __m256i alive = _mm256_and_si256(_mm256_and_si256(inRange, Load256(free + x)), one);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(next + x), alive);
+        }
+    }
+
+    LIFE_KERNEL_TARGET_AVX2
+    void CollectChangesAvx2(const uint8_t* row, const uint8_t* next, size_t count, uint32_t firstCell, std::vector<LifeChange> & changes)
+    {
+        for (size_t x = 0; x < count; x += 32)
+        {
+            __m256i same = _mm256_cmpeq_epi8(Load256(row + x), Load256(next + x));
+            uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(same));
+            if (count - x < 32)
+            {
+                mask &= (1u << (count - x)) - 1;
+            }
+            EmitChanges(mask, next, x, firstCell, changes);
+        }
+    }
+    //-------------------------------------------------------
+
+    bool CpuHasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        __cpuid(info, 1);
+        const bool osxsave = 0 != (info[2] & (1 << 27));
+        const bool avx = 0 != (info[2] & (1 << 28));
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return 0 != (info[1] & (1 << 5));
+#else
+        __builtin_cpu_init();
+        return 0 != __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+    //-------------------------------------------------------
+
+    LifeKernel::Isa DetectIsa()
+    {
+#ifdef LIFE_KERNEL_X86
+        return CpuHasAvx2() ? LifeKernel::ISA_AVX2 : LifeKernel::ISA_SSE2;
+#else
+        return LifeKernel::ISA_SCALAR;
+#endif
+    }
+
+    struct Dispatch
+    {
+        LifeKernel::Isa isa;
+        StepRowFunc stepRow;
+        CollectChangesFunc collectChanges;
+
+        void Select(LifeKernel::Isa required)
+        {
+            isa = required;
+            switch (isa)
+            {
+#ifdef LIFE_KERNEL_X86
+            case LifeKernel::ISA_AVX2:
+                stepRow = &StepRowAvx2;
+                collectChanges = &CollectChangesAvx2;
+                break;
+            case LifeKernel::ISA_SSE2:
+                stepRow = &StepRowSse2;
+                collectChanges = &CollectChangesSse2;
+                break;
+#endif
+            default:
+                isa = LifeKernel::ISA_SCALAR;
+                stepRow = &StepRowScalar;
+                collectChanges = &CollectChangesScalar;
+                break;
+            }
+        }
+    };
+
+    const LifeKernel::Isa gBestIsa = DetectIsa();
+
+    Dispatch MakeDispatch()
+    {
+        Dispatch dispatch;
+        dispatch.Select(gBestIsa);
+        return dispatch;
+    }
+
+    Dispatch gDispatch = MakeDispatch();
+}
+
+//-------------------------------------------------------
+LifeKernel::Isa LifeKernel::GetBestIsa()
+{
+    return gBestIsa;
+}
+//-------------------------------------------------------
+LifeKernel::Isa LifeKernel::GetIsa()
+{
+    return gDispatch.isa;
+}
+//-------------------------------------------------------
+void LifeKernel::SetIsa(Isa isa)
+{
+    gDispatch.Select(std::min(isa, gBestIsa));
+}
+//-------------------------------------------------------
+const char* LifeKernel::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case ISA_AVX2:
+        return "AVX2";
+    case ISA_SSE2:
+        return "SSE2";
+    default:
+        return "Scalar";
+    }
+}
+//-------------------------------------------------------
+void LifeKernel::StepRow(const uint8_t* above, const uint8_t* row, const uint8_t* below, const uint8_t* free, uint8_t* next, size_t count)
+{
+    gDispatch.stepRow(above, row, below, free, next, count);
+}
+//-------------------------------------------------------
+void LifeKernel::CollectChanges(const uint8_t* row, const uint8_t* next, size_t count, uint32_t firstCell, std::vector<LifeChange> & changes)
+{
+    gDispatch.collectChanges(row, next, count, firstCell, changes);
+}
+//-------------------------------------------------------
@@ -0,0 +1,87 @@
+/**
+* @file LifeKernel.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _LIFE_KERNEL_H_
+#define _LIFE_KERNEL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ *	Single cell change produced by a generation step
+ */
+struct LifeChange
+{
+    enum Type : uint8_t
+    {
+        BORN = 1,
+        DIED = 2
+    };
+
+    uint32_t cell;
+    uint8_t type;
+};
+
+/**
+ *	Row kernels of the forest life rule.
+ *  A cell is alive in the next generation if it is free and has 3 or 4 alive neighbours.
+ *  Rows are byte planes: alive cells are 1, free cells of the mask are 0xFF.
+ */
+class LifeKernel
+{
+public:
+    enum Isa : uint8_t
+    {
+        ISA_SCALAR = 0,
+        ISA_SSE2,
+        ISA_AVX2
+    };
+
+    /**
+     *	Rows have to be readable in [-1, RoundUp(count, ROW_ALIGNMENT) + 1)
+     */
+    static const size_t ROW_ALIGNMENT = 32;
+
+    /**
+     *	Best instruction set supported by the CPU
+     */
+    static Isa GetBestIsa();
+
+    /**
+     *	Instruction set used by StepRow and CollectChanges
+     */
+    static Isa GetIsa();
+
+    /**
+     *	Force instruction set, it is clamped by GetBestIsa()
+     */
+    static void SetIsa(Isa isa);
+
+    static const char* GetIsaName(Isa isa);
+
+    /**
+     *	Compute next generation of a row
+     *  @param above, row, below - alive planes of the current generation
+     *  @param free - mask of cells where trees can grow
+     *  @param next - output row, padding up to RoundUp(count, ROW_ALIGNMENT) is overwritten
+     */
+    static void StepRow(const uint8_t* above, const uint8_t* row, const uint8_t* below, const uint8_t* free, uint8_t* next, size_t count);
+
+    /**
+     *	Append births and deaths of a row in ascending cell order
+     *  @param firstCell - index of the first cell of the row
+     */
+    static void CollectChanges(const uint8_t* row, const uint8_t* next, size_t count, uint32_t firstCell, std::vector<LifeChange> & changes);
+};
+
+
+#endif
@@ -0,0 +1,414 @@
+/**
+* @file TerrainPager.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "TerrainPager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreEntity.h>
+#include <OgreMesh.h>
+#include <OgreSubMesh.h>
+#include <OgreMeshManager.h>
+#include <OgreHardwareBufferManager.h>
+#include <OgreVertexIndexData.h>
+#include <OgreMaterialManager.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+#include <OgreHighLevelGpuProgram.h>
+#include <OgreHighLevelGpuProgramManager.h>
+#include <OgreLogManager.h>
+
+#include "TerrainTileSource.h"
+#include "../Common/Profiler.h"
+
+namespace
+{
+    static const char Shader_GL_VertexColour_V[] = ""
+        "#version 120                                                              \n"
+        "                                                                          \n"
+        "void main()                                                               \n"
+        "{                                                                         \n"
+        "    gl_FrontColor = gl_Color;                                             \n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;               \n"
+        "}                                                                         \n"
+        "";
+
+    static const char Shader_GL_VertexColour_F[] = ""
+        "#version 120                                                   \n"
+        "                                                               \n"
+        "void main()                                                    \n"
+        "{                                                              \n"
+        "    gl_FragColor = gl_Color;                                   \n"
+        "}                                                              \n"
+        "";
+}
+
+const std::string TerrainPager::CLASS_NAME = "TerrainPager";
+const size_t TerrainPager::UPLOADS_PER_FRAME = 4;
+
+//-------------------------------------------------------
+TerrainPager::TerrainPager(Ogre::SceneManager* sceneManager, Ogre::SceneNode* parentNode, std::shared_ptr<TerrainTileSource> source, float vertexStep, float viewDistance, size_t memoryBudget):
+    mSceneManager(sceneManager), mSource(source), mTileSize(source->GetTileSize()), mVertexStep(vertexStep), mViewDistance(viewDistance), mMemoryBudget(memoryBudget)
+{
+    OgreAssert((mTileSize + 1) * (mTileSize + 1) <= std::numeric_limits<uint16_t>::max() + 1u, "TerrainPager: tile is too large for 16 bits indexes");
+
+    mRootNode = parentNode->createChildSceneNode();
+    mColourType = Ogre::VertexElement::getBestColourVertexElementType();
+    CreateMaterial();
+    CreateIndexBuffer();
+
+    mLoader = std::thread(&TerrainPager::LoaderLoop, this);
+}
+//-------------------------------------------------------
+TerrainPager::~TerrainPager()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mShutDown = true;
+    }
+    mWakeUp.notify_all();
+    mLoader.join();
+
+    for (auto & tile : mTiles)
+    {
+        DestroyTile(*tile.second);
+    }
+    mSceneManager->destroySceneNode(mRootNode);
+}
+//-------------------------------------------------------
+void TerrainPager::CreateMaterial()
+{
+    mMaterialName = "Material/" + CLASS_NAME + "/VertexColour";
+    Ogre::MaterialManager & materialManager = Ogre::MaterialManager::getSingleton();
+    if (materialManager.resourceExists(mMaterialName))
+    {
+        return;
+    }
+
+    Ogre::MaterialPtr material = materialManager.create(mMaterialName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    Ogre::Pass* pass = material->getTechnique(0)->getPass(0);
+    {
+        auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/" + CLASS_NAME + "/GL/VertexColour/V",
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
+        vprogram->setSource(Shader_GL_VertexColour_V);
+        pass->setVertexProgram(vprogram->getName());
+    }
+    {
+        auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/" + CLASS_NAME + "/GL/VertexColour/F",
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
+        fprogram->setSource(Shader_GL_VertexColour_F);
+        pass->setFragmentProgram(fprogram->getName());
+    }
+    material->load();
+}
+//-------------------------------------------------------
+void TerrainPager::CreateIndexBuffer()
+{
+    //same split as in the heightfield, counter clockwise when seen from +Y
+    const size_t side = mTileSize + 1;
+    std::vector<uint16_t> indexes;
+    indexes.reserve(mTileSize * mTileSize * 6);
+    for (size_t z = 0; z < mTileSize; ++z)
+    {
+        for (size_t x = 0; x < mTileSize; ++x)
+        {
+            uint16_t v0 = static_cast<uint16_t>(z * side + x);
+            uint16_t v1 = v0 + 1;
+            uint16_t v2 = static_cast<uint16_t>(v0 + side);
+            uint16_t v3 = v2 + 1;
+            indexes.insert(indexes.end(), { v0, v2, v1, v1, v2, v3 });
+        }
+    }
+    mIndexBuffer = Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT, indexes.size(), Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    mIndexBuffer->writeData(0, mIndexBuffer->getSizeInBytes(), indexes.data(), true);
+}
+//-------------------------------------------------------
+void TerrainPager::LoaderLoop()
+{
+    Profiler::GetInstance().SetThreadName("TerrainLoader");
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mWakeUp.wait(lock, [this]() { return mShutDown || !mRequests.empty(); });
+        if (mShutDown)
+        {
+            break;
+        }
+        LoadedTile tile;
+        tile.x = mRequests.front().first;
+        tile.z = mRequests.front().second;
+        mRequests.pop_front();
+        mLoading = true;
+        mLoadingKey = GetKey(tile.x, tile.z);
+
+        lock.unlock();
+        PrepareTile(tile);
+        lock.lock();
+
+        mLoading = false;
+        mLoaded.push_back(std::move(tile));
+    }
+}
+//-------------------------------------------------------
+void TerrainPager::PrepareTile(LoadedTile & tile) const
+{
+    PROFILE_ZONE("Terrain tile prepare");
+    const size_t samples = mTileSize + 1;
+    tile.heights.resize(samples * samples);
+    tile.exists = mSource->LoadTile(tile.x, tile.z, tile.heights.data());
+    if (!tile.exists)
+    {
+        tile.heights.clear();
+        return;
+    }
+
+    //position in the tile node space, colour
+    const size_t vertexSize = 3 * sizeof(float) + sizeof(Ogre::uint32);
+    const float maxHeight = std::max(mSource->GetMaxHeight(), std::numeric_limits<float>::epsilon());
+    tile.vertices.resize(samples * samples * vertexSize);
+    unsigned char* vertex = tile.vertices.data();
+    for (size_t z = 0; z < samples; ++z)
+    {
+        for (size_t x = 0; x < samples; ++x)
+        {
+            float h = tile.heights[z * samples + x];
+            float* position = reinterpret_cast<float*>(vertex);
+            position[0] = x * mVertexStep;
+            position[1] = h;
+            position[2] = z * mVertexStep;
+            float c = std::min(std::max(h / maxHeight, 0.0f), 1.0f);
+            *reinterpret_cast<Ogre::uint32*>(vertex + 3 * sizeof(float)) = Ogre::VertexElement::convertColourValue(Ogre::ColourValue(c, c, c), mColourType);
+            vertex += vertexSize;
+        }
+    }
+}
+//-------------------------------------------------------
+void TerrainPager::CreateTile(LoadedTile & loaded)
+{
+    PROFILE_ZONE("Terrain tile create");
+    const size_t samples = mTileSize + 1;
+    const float originX = loaded.x * GetTileWorldSize();
+    const float originZ = loaded.z * GetTileWorldSize();
+
+    std::unique_ptr<Tile> tile = std::make_unique<Tile>();
+    tile->x = loaded.x;
+    tile->z = loaded.z;
+    //heightfield grid lies in the world XZ plane
+    tile->heights.Reset(samples, samples, originX, originZ, mVertexStep);
+    std::copy(loaded.heights.cbegin(), loaded.heights.cend(), tile->heights.GetRow(0));
+    tile->heights.UpdateBounds();
+
+    tile->mesh = Ogre::MeshManager::getSingleton().createManual("Mesh/" + CLASS_NAME + "/" + std::to_string(loaded.x) + "_" + std::to_string(loaded.z), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    Ogre::SubMesh* subMesh = tile->mesh->createSubMesh();
+    subMesh->useSharedVertices = false;
+    subMesh->setMaterialName(mMaterialName);
+
+    subMesh->vertexData = OGRE_NEW Ogre::VertexData();
+    subMesh->vertexData->vertexStart = 0;
+    subMesh->vertexData->vertexCount = samples * samples;
+    Ogre::VertexDeclaration* declaration = subMesh->vertexData->vertexDeclaration;
+    size_t vertexSize = 0;
+    vertexSize += declaration->addElement(0, vertexSize, Ogre::VET_FLOAT3, Ogre::VES_POSITION).getSize();
+    vertexSize += declaration->addElement(0, vertexSize, mColourType, Ogre::VES_DIFFUSE).getSize();
+
+    Ogre::HardwareVertexBufferSharedPtr vbuffer = Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(vertexSize, samples * samples, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+    vbuffer->writeData(0, vbuffer->getSizeInBytes(), loaded.vertices.data(), true);
+    subMesh->vertexData->vertexBufferBinding->setBinding(0, vbuffer);
+
+    subMesh->indexData->indexBuffer = mIndexBuffer;
+    subMesh->indexData->indexStart = 0;
+    subMesh->indexData->indexCount = mIndexBuffer->getNumIndexes();
+
+    Ogre::AxisAlignedBox localBounds(0.0f, tile->heights.GetMinHeight(), 0.0f, GetTileWorldSize(), tile->heights.GetMaxHeight(), GetTileWorldSize());
+    tile->mesh->_setBounds(localBounds);
+    tile->mesh->_setBoundingSphereRadius((localBounds.getMaximum() - localBounds.getMinimum()).length() / 2.0f);
+    tile->mesh->load();
+
+    tile->entity = mSceneManager->createEntity(tile->mesh);
+    tile->node = mRootNode->createChildSceneNode(Ogre::Vector3(originX, 0.0f, originZ));
+    tile->node->attachObject(tile->entity);
+    tile->bounds = Ogre::AxisAlignedBox(localBounds.getMinimum() + tile->node->getPosition(), localBounds.getMaximum() + tile->node->getPosition());
+
+    tile->memorySize = loaded.heights.size() * sizeof(float) + vbuffer->getSizeInBytes();
+    tile->lastUsedFrame = mFrame;
+    mMemoryUsed += tile->memorySize;
+
+    mTiles[GetKey(loaded.x, loaded.z)] = std::move(tile);
+}
+//-------------------------------------------------------
+void TerrainPager::DestroyTile(Tile & tile)
+{
+    tile.node->detachAllObjects();
+    mSceneManager->destroyEntity(tile.entity);
+    mSceneManager->destroySceneNode(tile.node);
+    Ogre::MeshManager::getSingleton().remove(tile.mesh->getHandle());
+    tile.mesh.setNull();
+    mMemoryUsed -= tile.memorySize;
+}
+//-------------------------------------------------------
+void TerrainPager::NotifyListener(int32_t x, int32_t z) const
+{
+    if (mListener)
+    {
+        const float size = GetTileWorldSize();
+        mListener(x * size, z * size, (x + 1) * size, (z + 1) * size);
+    }
+}
+//-------------------------------------------------------
+void TerrainPager::Update(const Ogre::Vector3 & focus)
+{
+    PROFILE_ZONE("Terrain pager update");
+    ++mFrame;
+
+    //tiles in the view distance, nearest first
+    const float size = GetTileWorldSize();
+    const int32_t radius = static_cast<int32_t>(std::ceil(mViewDistance / size));
+    const int32_t centerX = static_cast<int32_t>(std::floor(focus.x / size));
+    const int32_t centerZ = static_cast<int32_t>(std::floor(focus.z / size));
+    std::vector<std::pair<float, std::pair<int32_t, int32_t> > > requests;
+    for (int32_t z = centerZ - radius; z <= centerZ + radius; ++z)
+    {
+        for (int32_t x = centerX - radius; x <= centerX + radius; ++x)
+        {
+            float dx = std::max(0.0f, std::max(x * size - focus.x, focus.x - (x + 1) * size));
+            float dz = std::max(0.0f, std::max(z * size - focus.z, focus.z - (z + 1) * size));
+            float distance = std::sqrt(dx * dx + dz * dz);
+            if (distance > mViewDistance)
+            {
+                continue;
+            }
+            const uint64_t key = GetKey(x, z);
+            auto it = mTiles.find(key);
+            if (it != mTiles.end())
+            {
+                it->second->lastUsedFrame = mFrame;
+            }
+            else if (0 == mMissingTiles.count(key))
+            {
+                requests.push_back(std::make_pair(distance, std::make_pair(x, z)));
+            }
+        }
+    }
+    std::sort(requests.begin(), requests.end(), [](const std::pair<float, std::pair<int32_t, int32_t> > & a, const std::pair<float, std::pair<int32_t, int32_t> > & b) { return a.first < b.first; });
+
+    //replace the queue, tiles which went out of the view before loading are dropped
+    std::vector<LoadedTile> loaded;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mRequests.clear();
+        for (const auto & request : requests)
+        {
+            const uint64_t key = GetKey(request.second.first, request.second.second);
+            bool inProgress = (mLoading && key == mLoadingKey) || std::any_of(mLoaded.cbegin(), mLoaded.cend(), [&](const LoadedTile & tile) { return GetKey(tile.x, tile.z) == key; });
+            if (!inProgress)
+            {
+                mRequests.push_back(request.second);
+            }
+        }
+        const size_t uploads = std::min(UPLOADS_PER_FRAME, mLoaded.size());
+        std::move(mLoaded.begin(), mLoaded.begin() + uploads, std::back_inserter(loaded));
+        mLoaded.erase(mLoaded.begin(), mLoaded.begin() + uploads);
+    }
+    mWakeUp.notify_one();
+
+    for (LoadedTile & tile : loaded)
+    {
+        if (!tile.exists)
+        {
+            mMissingTiles.insert(GetKey(tile.x, tile.z));
+            continue;
+        }
+        if (0 == mTiles.count(GetKey(tile.x, tile.z)))
+        {
+            CreateTile(tile);
+            NotifyListener(tile.x, tile.z);
+        }
+    }
+
+    //least recently used tiles out of the view go first
+    if (mMemoryUsed > mMemoryBudget)
+    {
+        std::vector<Tile*> candidates;
+        for (auto & tile : mTiles)
+        {
+            if (mFrame != tile.second->lastUsedFrame)
+            {
+                candidates.push_back(tile.second.get());
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Tile* a, const Tile* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+        for (size_t i = 0; i < candidates.size() && mMemoryUsed > mMemoryBudget; ++i)
+        {
+            const int32_t x = candidates[i]->x;
+            const int32_t z = candidates[i]->z;
+            DestroyTile(*candidates[i]);
+            mTiles.erase(GetKey(x, z));
+            NotifyListener(x, z);
+        }
+    }
+}
+//-------------------------------------------------------
+size_t TerrainPager::GetPendingTilesNumber() const
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mRequests.size() + mLoaded.size() + (mLoading ? 1 : 0);
+}
+//-------------------------------------------------------
+const TerrainPager::Tile* TerrainPager::FindTile(float x, float z) const
+{
+    const float size = GetTileWorldSize();
+    auto it = mTiles.find(GetKey(static_cast<int32_t>(std::floor(x / size)), static_cast<int32_t>(std::floor(z / size))));
+    return (it != mTiles.end()) ? it->second.get() : nullptr;
+}
+//-------------------------------------------------------
+std::pair<bool, float> TerrainPager::GetHeightAt(float x, float z) const
+{
+    const Tile* tile = FindTile(x, z);
+    if (nullptr == tile)
+    {
+        return std::make_pair(false, 0.0f);
+    }
+    return tile->heights.Sample(x, z);
+}
+//-------------------------------------------------------
+std::pair<bool, Ogre::Vector3> TerrainPager::GetIntersection(const Ogre::Ray & ray) const
+{
+    PROFILE_ZONE("Terrain ray cast");
+    const Ogre::Vector3 & o = ray.getOrigin();
+    const Ogre::Vector3 & d = ray.getDirection();
+    float nearest = std::numeric_limits<float>::infinity();
+    for (const auto & it : mTiles)
+    {
+        const Tile & tile = *it.second;
+        auto boxHit = ray.intersects(tile.bounds);
+        if (!boxHit.first || boxHit.second >= nearest)
+        {
+            continue;
+        }
+        //heightfield Y is the world Z
+        auto hit = tile.heights.Intersect(o.x, o.z, o.y, d.x, d.z, d.y, nearest);
+        if (hit.first && hit.second < nearest)
+        {
+            nearest = hit.second;
+        }
+    }
+    if (nearest < std::numeric_limits<float>::infinity())
+    {
+        return std::make_pair(true, ray.getPoint(nearest));
+    }
+    return std::make_pair(false, Ogre::Vector3::ZERO);
+}
+//-------------------------------------------------------
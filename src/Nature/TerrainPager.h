@@ -0,0 +1,218 @@
+/**
+* @file TerrainPager.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _TERRAIN_PAGER_H_
+#define _TERRAIN_PAGER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <OgrePrerequisites.h>
+#include <OgreAxisAlignedBox.h>
+#include <OgreHardwareIndexBuffer.h>
+#include <OgreHardwareVertexBuffer.h>
+#include <OgreMesh.h>
+#include <OgreRay.h>
+#include <OgreVector3.h>
+
+#include "Heightfield.h"
+
+class TerrainTileSource;
+
+/**
+ *	Terrain of unlimited size made of tiles loaded on demand around a focus point.
+ *  Tiles lie in the world XZ plane, tile (i, j) starts at (i * size * step, j * size * step), heights go along Y.
+ *  Heights are read and meshes are built on a background thread, the render thread only uploads them.
+ *  Tiles out of the view radius stay in the scene and are evicted in the least recently used order when the memory budget is exceeded,
+ *  so the rendered ground, the height queries, the ray casts and the tile listener all see the same resident tiles.
+ */
+class TerrainPager
+{
+public:
+    /**
+     *	Called when a tile was added or removed, area is the world space XZ rectangle of the tile
+     */
+    using TileListener = std::function<void(float minX, float minZ, float maxX, float maxZ)>;
+
+private:
+    static const std::string CLASS_NAME;
+    static const size_t UPLOADS_PER_FRAME;
+
+    /**
+     *	Tile prepared by the loader thread
+     */
+    struct LoadedTile
+    {
+        int32_t x;
+        int32_t z;
+        bool exists = false;
+        std::vector<float> heights;
+        std::vector<unsigned char> vertices;
+    };
+
+    /**
+     *	Resident tile
+     */
+    struct Tile
+    {
+        int32_t x;
+        int32_t z;
+        Heightfield heights;
+        Ogre::MeshPtr mesh;
+        Ogre::Entity* entity = nullptr;
+        Ogre::SceneNode* node = nullptr;
+        Ogre::AxisAlignedBox bounds;
+        size_t memorySize = 0;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    Ogre::SceneManager* mSceneManager;
+    Ogre::SceneNode* mRootNode;
+    std::shared_ptr<TerrainTileSource> mSource;
+    const size_t mTileSize;
+    const float mVertexStep;
+
+    float mViewDistance;
+    size_t mMemoryBudget;
+    size_t mMemoryUsed = 0;
+    uint64_t mFrame = 0;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Tile> > mTiles;
+    //tiles the source doesn't have
+    std::unordered_set<uint64_t> mMissingTiles;
+    TileListener mListener;
+
+    std::string mMaterialName;
+    Ogre::HardwareIndexBufferSharedPtr mIndexBuffer;
+    Ogre::VertexElementType mColourType;
+
+    //loader thread state, guarded by mMutex
+    std::thread mLoader;
+    mutable std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::deque<std::pair<int32_t, int32_t> > mRequests;
+    std::vector<LoadedTile> mLoaded;
+    bool mLoading = false;
+    uint64_t mLoadingKey = 0;
+    bool mShutDown = false;
+
+    TerrainPager(const TerrainPager&) = delete;
+    TerrainPager& operator=(const TerrainPager&) = delete;
+    //-------------------------------------------------------
+
+    static uint64_t GetKey(int32_t x, int32_t z)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+    }
+
+    void LoaderLoop();
+
+    /**
+     *	Read heights and fill vertices, runs on the loader thread
+     */
+    void PrepareTile(LoadedTile & tile) const;
+
+    void CreateMaterial();
+    void CreateIndexBuffer();
+
+    /**
+     *	Upload a prepared tile and add it to the scene
+     */
+    void CreateTile(LoadedTile & loaded);
+    void DestroyTile(Tile & tile);
+
+    void NotifyListener(int32_t x, int32_t z) const;
+
+    const Tile* FindTile(float x, float z) const;
+
+public:
+    /**
+     *	Create pager and start the loader thread
+     *  @param vertexStep - distance between the neighbouring heights
+     *  @param viewDistance - tiles closer to the focus are kept loaded
+     *  @param memoryBudget - max size of the resident tiles in bytes, tiles in the view distance are never evicted
+     */
+    TerrainPager(Ogre::SceneManager* sceneManager, Ogre::SceneNode* parentNode, std::shared_ptr<TerrainTileSource> source, float vertexStep, float viewDistance, size_t memoryBudget);
+    ~TerrainPager();
+
+    /**
+     *	Request tiles around the focus, upload loaded tiles and evict old ones. Called every frame on the render thread
+     */
+    void Update(const Ogre::Vector3 & focus);
+
+    void SetViewDistance(float distance)
+    {
+        mViewDistance = distance;
+    }
+
+    void SetMemoryBudget(size_t bytes)
+    {
+        mMemoryBudget = bytes;
+    }
+
+    /**
+     *	Listener is called on the render thread from Update
+     */
+    void SetTileListener(const TileListener & listener)
+    {
+        mListener = listener;
+    }
+
+    /**
+     *	World size of a tile side
+     */
+    float GetTileWorldSize() const
+    {
+        return mTileSize * mVertexStep;
+    }
+
+    size_t GetTilesNumber() const
+    {
+        return mTiles.size();
+    }
+
+    /**
+     *	Size of the resident tiles: CPU heights and hardware vertex buffers
+     */
+    size_t GetMemoryUsed() const
+    {
+        return mMemoryUsed;
+    }
+
+    /**
+     *	Number of tiles waiting for the loader thread or for the upload
+     */
+    size_t GetPendingTilesNumber() const;
+
+    /**
+     *	Height of the resident terrain at a world point
+     *  @return false if the tile is not loaded
+     */
+    std::pair<bool, float> GetHeightAt(float x, float z) const;
+
+    /**
+     *	Find intersection of a world space ray with the resident tiles
+     *  @return intersection flag and world space position
+     */
+    std::pair<bool, Ogre::Vector3> GetIntersection(const Ogre::Ray & ray) const;
+};
+
+
+#endif
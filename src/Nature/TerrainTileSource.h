@@ -0,0 +1,47 @@
+/**
+* @file TerrainTileSource.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _TERRAIN_TILE_SOURCE_H_
+#define _TERRAIN_TILE_SOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *	Provider of tiled height data for the paged terrain.
+ *  A tile of size N has (N + 1) x (N + 1) heights, edge heights are shared with the neighbouring tiles.
+ *  Tiles are addressed by integer coordinates, so the world can grow in all directions.
+ */
+class TerrainTileSource
+{
+public:
+    virtual ~TerrainTileSource() = default;
+
+    /**
+     *	Number of quads along a tile side
+     */
+    virtual size_t GetTileSize() const = 0;
+
+    /**
+     *	Upper bound of the heights, used for shading
+     */
+    virtual float GetMaxHeight() const = 0;
+
+    /**
+     *	Read heights of a tile, is called from the loader thread only
+     *  @param heights - output, (size + 1) x (size + 1) values row by row along X
+     *  @return false if there is no such tile
+     */
+    virtual bool LoadTile(int32_t tileX, int32_t tileZ, float* heights) = 0;
+};
+
+
+#endif
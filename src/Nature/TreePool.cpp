@@ -0,0 +1,337 @@
+/**
+* @file TreePool.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#include "TreePool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <OgreRoot.h>
+#include <OgreRenderSystem.h>
+#include <OgreRenderSystemCapabilities.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreEntity.h>
+#include <OgreMesh.h>
+#include <OgreSubMesh.h>
+#include <OgreMeshManager.h>
+#include <OgreInstanceManager.h>
+#include <OgreInstancedEntity.h>
+#include <OgreMaterialManager.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+#include <OgreVector4.h>
+#include <OgreHighLevelGpuProgram.h>
+#include <OgreHighLevelGpuProgramManager.h>
+
+namespace
+{
+    //HWInstancingBasic passes 3x4 world matrix in the texture coordinates 1-3.
+    //Lighting matches the fixed function base pass: scene colour and diffuse of the first light per vertex, fog distance is passed to the fragment.
+    static const char Shader_GL_Instanced_V[] = ""
+        "#version 120                                                                                                                 \n"
+        "                                                                                                                             \n"
+        "attribute vec4 vertex;                                                                                                       \n"
+        "attribute vec3 normal;                                                                                                       \n"
+        "attribute vec4 uv0;                                                                                                          \n"
+        "attribute vec4 uv1;                                                                                                          \n"
+        "attribute vec4 uv2;                                                                                                          \n"
+        "attribute vec4 uv3;                                                                                                          \n"
+        "                                                                                                                             \n"
+        "uniform mat4 viewProjMatrix;                                                                                                 \n"
+        "uniform vec4 cameraPosition;                                                                                                 \n"
+        "uniform vec4 sceneColour;                                                                                                    \n"
+        "uniform vec4 lightDiffuse;                                                                                                   \n"
+        "uniform vec4 lightPosition;                                                                                                  \n"
+        "                                                                                                                             \n"
+        "void main()                                                                                                                  \n"
+        "{                                                                                                                            \n"
+        "    mat4 worldMatrix;                                                                                                        \n"
+        "    worldMatrix[0] = uv1;                                                                                                    \n"
+        "    worldMatrix[1] = uv2;                                                                                                    \n"
+        "    worldMatrix[2] = uv3;                                                                                                    \n"
+        "    worldMatrix[3] = vec4(0.0, 0.0, 0.0, 1.0);                                                                               \n"
+        "                                                                                                                             \n"
+        "    vec4 worldPosition = vertex * worldMatrix;                                                                               \n"
+        "    vec3 worldNormal = normalize((vec4(normal, 0.0) * worldMatrix).xyz);                                                     \n"
+        "    vec3 lightDirection = normalize(lightPosition.xyz - worldPosition.xyz * lightPosition.w);                                \n"
+        "                                                                                                                             \n"
+        "    gl_TexCoord[0] = uv0;                                                                                                    \n"
+        "    gl_FrontColor = vec4(sceneColour.rgb + lightDiffuse.rgb * max(dot(worldNormal, lightDirection), 0.0), sceneColour.a);    \n"
+        "    gl_FogFragCoord = length(worldPosition.xyz - cameraPosition.xyz);                                                        \n"
+        "    gl_Position = viewProjMatrix * worldPosition;                                                                            \n"
+        "}                                                                                                                            \n"
+        "";
+
+    //linear fog, fogParams.w is 0 if the fog is off
+    static const char Shader_GL_Instanced_F[] = ""
+        "#version 120                                                                       \n"
+        "                                                                                   \n"
+        "uniform sampler2D texture;                                                         \n"
+        "uniform vec4 fogColour;                                                            \n"
+        "uniform vec4 fogParams;                                                            \n"
+        "                                                                                   \n"
+        "void main()                                                                        \n"
+        "{                                                                                  \n"
+        "    vec4 colour = gl_Color * texture2D(texture, gl_TexCoord[0].st);                \n"
+        "    float fog = clamp((gl_FogFragCoord - fogParams.y) * fogParams.w, 0.0, 1.0);    \n"
+        "    gl_FragColor = vec4(mix(colour.rgb, fogColour.rgb, fog), colour.a);            \n"
+        "}                                                                                  \n"
+        "";
+}
+
+const TreePool::Handle TreePool::INVALID_HANDLE = std::numeric_limits<TreePool::Handle>::max();
+
+const std::string TreePool::CLASS_NAME = "TreePool";
+const size_t TreePool::INSTANCES_PER_BATCH = 4096;
+
+//-------------------------------------------------------
+bool TreePool::IsInstancingSupported()
+{
+    const Ogre::RenderSystem* renderSystem = Ogre::Root::getSingleton().getRenderSystem();
+    return nullptr != renderSystem && nullptr != renderSystem->getCapabilities() &&
+        renderSystem->getCapabilities()->hasCapability(Ogre::RSC_VERTEX_BUFFER_INSTANCE_DATA) &&
+        Ogre::HighLevelGpuProgramManager::getSingleton().isLanguageSupported("glsl");
+}
+//-------------------------------------------------------
+std::string TreePool::CreateInstancedMaterial(const Ogre::SceneManager* sceneManager, const std::string & baseMaterial)
+{
+    const std::string name = "Material/" + CLASS_NAME + "/Instanced/" + baseMaterial;
+    Ogre::MaterialManager & materialManager = Ogre::MaterialManager::getSingleton();
+    Ogre::MaterialPtr material = materialManager.getByName(name);
+    if (material.isNull())
+    {
+        const std::string vprogramName = "Shader/" + CLASS_NAME + "/GL/Instanced/V";
+        const std::string fprogramName = "Shader/" + CLASS_NAME + "/GL/Instanced/F";
+        Ogre::HighLevelGpuProgramManager & programManager = Ogre::HighLevelGpuProgramManager::getSingleton();
+        if (!programManager.resourceExists(vprogramName))
+        {
+            auto vprogram = programManager.createProgram(vprogramName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
+            vprogram->setSource(Shader_GL_Instanced_V);
+            auto fprogram = programManager.createProgram(fprogramName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
+            fprogram->setSource(Shader_GL_Instanced_F);
+        }
+
+        Ogre::MaterialPtr base = materialManager.getByName(baseMaterial);
+        if (base.isNull())
+        {
+            base = materialManager.getByName("BaseWhiteNoLighting");
+        }
+        material = base->clone(name);
+        for (unsigned short t = 0; t < material->getNumTechniques(); ++t)
+        {
+            Ogre::Technique* technique = material->getTechnique(t);
+            for (unsigned short p = 0; p < technique->getNumPasses(); ++p)
+            {
+                Ogre::Pass* pass = technique->getPass(p);
+                pass->setVertexProgram(vprogramName);
+                Ogre::GpuProgramParametersSharedPtr vparams = pass->getVertexProgramParameters();
+                vparams->setNamedAutoConstant("viewProjMatrix", Ogre::GpuProgramParameters::ACT_VIEWPROJ_MATRIX);
+                vparams->setNamedAutoConstant("cameraPosition", Ogre::GpuProgramParameters::ACT_CAMERA_POSITION);
+                if (pass->getLightingEnabled())
+                {
+                    vparams->setNamedAutoConstant("sceneColour", Ogre::GpuProgramParameters::ACT_DERIVED_SCENE_COLOUR);
+                    vparams->setNamedAutoConstant("lightDiffuse", Ogre::GpuProgramParameters::ACT_DERIVED_LIGHT_DIFFUSE_COLOUR, 0);
+                    vparams->setNamedAutoConstant("lightPosition", Ogre::GpuProgramParameters::ACT_LIGHT_POSITION, 0);
+                }
+                else
+                {
+                    //unlit pass shows the texture as is
+                    vparams->setNamedConstant("sceneColour", Ogre::ColourValue::White);
+                    vparams->setNamedConstant("lightDiffuse", Ogre::ColourValue::ZERO);
+                    vparams->setNamedConstant("lightPosition", Ogre::Vector4(0.0f, 1.0f, 0.0f, 0.0f));
+                }
+                //passes without textures keep the fixed function fragment stage, which applies the fog by gl_FogFragCoord
+                if (pass->getNumTextureUnitStates() > 0)
+                {
+                    pass->setFragmentProgram(fprogramName);
+                    pass->getFragmentProgramParameters()->setNamedAutoConstant("fogColour", Ogre::GpuProgramParameters::ACT_FOG_COLOUR);
+                }
+            }
+        }
+    }
+
+    //fog parameters don't tell the fog mode, so the mode of the pass or the scene is checked now
+    for (unsigned short t = 0; t < material->getNumTechniques(); ++t)
+    {
+        Ogre::Technique* technique = material->getTechnique(t);
+        for (unsigned short p = 0; p < technique->getNumPasses(); ++p)
+        {
+            Ogre::Pass* pass = technique->getPass(p);
+            if (!pass->hasFragmentProgram())
+            {
+                continue;
+            }
+            Ogre::FogMode fogMode = pass->getFogOverride() ? pass->getFogMode() : sceneManager->getFogMode();
+            Ogre::GpuProgramParametersSharedPtr fparams = pass->getFragmentProgramParameters();
+            if (Ogre::FOG_LINEAR == fogMode)
+            {
+                fparams->setNamedAutoConstant("fogParams", Ogre::GpuProgramParameters::ACT_FOG_PARAMS);
+            }
+            else
+            {
+                fparams->clearNamedAutoConstant("fogParams");
+                fparams->setNamedConstant("fogParams", Ogre::Vector4::ZERO);
+            }
+        }
+    }
+    material->load();
+    return name;
+}
+//-------------------------------------------------------
+TreePool::TreePool(Ogre::SceneManager* sceneManager, const std::string & meshName, const Ogre::Vector3 & scale, Ogre::SceneNode* parent, size_t size, Mode mode):
+    mSceneManager(sceneManager), mMeshName(meshName), mScale(scale), mParent(parent), mMode(mode)
+{
+    if (MODE_INSTANCED == mMode && !IsInstancingSupported())
+    {
+        mMode = MODE_NODES;
+    }
+    if (MODE_INSTANCED == mMode)
+    {
+        CreateInstanceManagers();
+    }
+
+    mFreeList.reserve(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        mFreeList.push_back(CreateTree());
+    }
+    //keep the first trees on top of the free list
+    std::reverse(mFreeList.begin(), mFreeList.end());
+}
+//-------------------------------------------------------
+TreePool::~TreePool()
+{
+    for (const auto & tree : mTrees)
+    {
+        if (nullptr != tree.node->getParent())
+        {
+            tree.node->getParent()->removeChild(tree.node);
+        }
+        tree.node->detachAllObjects();
+        mSceneManager->destroyEntity(tree.entity);
+        mSceneManager->destroySceneNode(tree.node);
+    }
+    for (auto instance : mInstances)
+    {
+        mSceneManager->destroyInstancedEntity(instance);
+    }
+    for (auto manager : mManagers)
+    {
+        mSceneManager->destroyInstanceManager(manager);
+    }
+}
+//-------------------------------------------------------
+void TreePool::CreateInstanceManagers()
+{
+    const std::string & group = Ogre::ResourceGroupManager::AUTODETECT_RESOURCE_GROUP_NAME;
+    Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().load(mMeshName, group);
+
+    //instance manager draws a single submesh
+    for (unsigned short i = 0; i < mesh->getNumSubMeshes(); ++i)
+    {
+        std::string managerName = CLASS_NAME + "/" + mMeshName + "/" + std::to_string(i);
+        mManagers.push_back(mSceneManager->createInstanceManager(managerName, mMeshName, group, Ogre::InstanceManager::HWInstancingBasic, INSTANCES_PER_BATCH, 0, i));
+        mInstancedMaterials.push_back(CreateInstancedMaterial(mSceneManager, mesh->getSubMesh(i)->getMaterialName()));
+    }
+}
+//-------------------------------------------------------
+TreePool::Handle TreePool::CreateTree()
+{
+    if (MODE_INSTANCED == mMode)
+    {
+        for (size_t i = 0; i < mManagers.size(); ++i)
+        {
+            Ogre::InstancedEntity* instance = mSceneManager->createInstancedEntity(mInstancedMaterials[i], mManagers[i]->getName());
+            instance->setScale(mScale);
+            instance->setInUse(false);
+            mInstances.push_back(instance);
+        }
+    }
+    else
+    {
+        Tree tree;
+        tree.entity = mSceneManager->createEntity(mMeshName);
+        tree.node = mSceneManager->createSceneNode();
+        tree.node->setScale(mScale);
+        tree.node->attachObject(tree.entity);
+        mTrees.push_back(tree);
+    }
+    return static_cast<Handle>(mTreesNumber++);
+}
+//-------------------------------------------------------
+TreePool::Handle TreePool::Acquire(const Ogre::Vector3 & position)
+{
+    Handle handle;
+    if (mFreeList.empty())
+    {
+        handle = CreateTree();
+        ++mMisses;
+    }
+    else
+    {
+        handle = mFreeList.back();
+        mFreeList.pop_back();
+    }
+
+    if (MODE_INSTANCED == mMode)
+    {
+        for (size_t i = 0; i < mManagers.size(); ++i)
+        {
+            Ogre::InstancedEntity* instance = mInstances[handle * mManagers.size() + i];
+            instance->setPosition(position);
+            instance->setInUse(true);
+        }
+    }
+    else
+    {
+        Ogre::SceneNode* node = mTrees[handle].node;
+        node->setPosition(position);
+        mParent->addChild(node);
+    }
+
+    mHighWaterMark = std::max(mHighWaterMark, GetUsed());
+    return handle;
+}
+//-------------------------------------------------------
+void TreePool::Release(Handle handle)
+{
+    assert(handle < mTreesNumber);
+    if (MODE_INSTANCED == mMode)
+    {
+        for (size_t i = 0; i < mManagers.size(); ++i)
+        {
+            mInstances[handle * mManagers.size() + i]->setInUse(false);
+        }
+    }
+    else
+    {
+        mParent->removeChild(mTrees[handle].node);
+    }
+    mFreeList.push_back(handle);
+}
+//-------------------------------------------------------
+size_t TreePool::GetBatchesNumber() const
+{
+    size_t batches = 0;
+    for (size_t i = 0; i < mManagers.size(); ++i)
+    {
+        auto it = mManagers[i]->getInstanceBatchIterator(mInstancedMaterials[i]);
+        while (it.hasMoreElements())
+        {
+            it.getNext();
+            ++batches;
+        }
+    }
+    return batches;
+}
+//-------------------------------------------------------
@@ -0,0 +1,148 @@
+/**
+* @file TreePool.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+
+#ifndef _TREE_POOL_H_
+#define _TREE_POOL_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <OgrePrerequisites.h>
+#include <OgreVector3.h>
+
+/**
+ *	Free list of pre-created trees.
+ *  In the nodes mode every tree is an entity attached to its own scene node, released trees are detached from the parent.
+ *  In the instanced mode every tree is a set of hardware instanced entities (one per submesh), released trees are marked unused.
+ */
+class TreePool
+{
+public:
+    using Handle = uint32_t;
+    static const Handle INVALID_HANDLE;
+
+    enum Mode
+    {
+        MODE_NODES,
+        //hardware instancing, the instanced programs apply the ambient, the first light and the linear fog like the base pass
+        MODE_INSTANCED
+    };
+
+private:
+    static const std::string CLASS_NAME;
+    static const size_t INSTANCES_PER_BATCH;
+
+    struct Tree
+    {
+        Ogre::SceneNode* node = nullptr;
+        Ogre::Entity* entity = nullptr;
+    };
+
+    Ogre::SceneManager* mSceneManager;
+    std::string mMeshName;
+    Ogre::Vector3 mScale;
+    Ogre::SceneNode* mParent;
+    Mode mMode;
+
+    std::vector<Tree> mTrees;
+    //instanced mode: mInstances[handle * mManagers.size() + submesh]
+    std::vector<Ogre::InstancedEntity*> mInstances;
+    std::vector<Ogre::InstanceManager*> mManagers;
+    std::vector<std::string> mInstancedMaterials;
+    size_t mTreesNumber = 0;
+
+    std::vector<Handle> mFreeList;
+
+    size_t mHighWaterMark = 0;
+    size_t mMisses = 0;
+
+    TreePool(const TreePool&) = delete;
+    TreePool& operator=(const TreePool&) = delete;
+    //-------------------------------------------------------
+
+    /**
+     *	Clone of the base material drawn by the instanced programs, linear fog is enabled if the pass or the scene has it now
+     */
+    static std::string CreateInstancedMaterial(const Ogre::SceneManager* sceneManager, const std::string & baseMaterial);
+
+    void CreateInstanceManagers();
+    Handle CreateTree();
+
+public:
+    /**
+     *	Check if the render system can draw trees with hardware instancing
+     */
+    static bool IsInstancingSupported();
+
+    /**
+     *	Create pool
+     *  @param size - number of trees created beforehand
+     *  @param mode - MODE_INSTANCED falls back to MODE_NODES if it is not supported
+     */
+    TreePool(Ogre::SceneManager* sceneManager, const std::string & meshName, const Ogre::Vector3 & scale, Ogre::SceneNode* parent, size_t size, Mode mode = MODE_NODES);
+    ~TreePool();
+
+    Mode GetMode() const
+    {
+        return mMode;
+    }
+
+    /**
+     *	Take a tree from the pool and show it, creates a new one if the pool is empty
+     */
+    Handle Acquire(const Ogre::Vector3 & position);
+
+    /**
+     *	Hide tree and return it to the pool
+     */
+    void Release(Handle handle);
+
+    /**
+     *	Number of created trees
+     */
+    size_t GetSize() const
+    {
+        return mTreesNumber;
+    }
+
+    /**
+     *	Number of trees in the scene
+     */
+    size_t GetUsed() const
+    {
+        return mTreesNumber - mFreeList.size();
+    }
+
+    /**
+     *	Max number of trees used simultaneously
+     */
+    size_t GetHighWaterMark() const
+    {
+        return mHighWaterMark;
+    }
+
+    /**
+     *	Number of acquisitions which had to create a new tree
+     */
+    size_t GetMisses() const
+    {
+        return mMisses;
+    }
+
+    /**
+     *	Number of instance batches, 0 in the nodes mode
+     */
+    size_t GetBatchesNumber() const;
+};
+
+
+#endif
@@ -10,6 +10,10 @@
 
 #include "World.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <OgreSceneManager.h>
 #include <OgreTexture.h>
 #include <OgreTextureManager.h>
@@ -17,11 +21,54 @@
 #include <OgreEntity.h>
 #include <OgreMatrix3.h>
 #include <OgreMatrix4.h>
+#include <OgreTimer.h>
+#include <OgreArchive.h>
+#include <OgreResourceGroupManager.h>
 
 #include "Ground.h"
 #include "EternalForest.h"
+#include "TerrainPager.h"
+#include "TerrainTileSource.h"
+#include "HeightFile.h"
+#include "../Common/WorkerPool.h"
+#include "../Common/Profiler.h"
 
 #include <OgreSubEntity.h>
+#include <OgreLogManager.h>
+
+//batch queries are processed by chunks of points, chunks are shared between threads
+static const size_t HEIGHTS_CHUNK_SIZE = 1024;
+static const size_t RAYS_CHUNK_SIZE = 256;
+
+//paged terrain
+static const float PAGED_VERTEX_STEP = 1.0f;
+static const float PAGED_VIEW_DISTANCE = 300.0f;
+static const size_t PAGED_MEMORY_BUDGET = 64 * 1024 * 1024;
+//side of the square forest area around the origin
+static const float PAGED_FOREST_SIZE = 512.0f;
+
+//ground heights, the binary file is made from the image by HeightConvert
+static const char HEIGHT_MAP_NAME[] = "terrain.jpg";
+static const char HEIGHT_FILE_NAME[] = "terrain.hf";
+//generated ground regions, written next to the log files
+static const char GROUND_MESH_CACHE_NAME[] = "Ground.meshcache";
+
+/**
+ *	Path of a resource lying in a file system location, files inside of archives can't be mapped
+ *  @return empty string if there is no such file
+ */
+static std::string FindResourceFile(const std::string & name)
+{
+    Ogre::FileInfoListPtr files = Ogre::ResourceGroupManager::getSingleton().findResourceFileInfo(Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, name);
+    for (const auto & info : *files)
+    {
+        if (nullptr != info.archive && "FileSystem" == info.archive->getType())
+        {
+            return info.archive->getName() + "/" + info.filename;
+        }
+    }
+    return std::string();
+}
 
 static Ogre::AxisAlignedBox TransformBox(const Ogre::AxisAlignedBox & box, const Ogre::Vector3 & translate, const Ogre::Vector3 & scale, const Ogre::Quaternion & rotation)
 {
@@ -39,16 +86,78 @@ static Ogre::AxisAlignedBox TransformBox(const Ogre::AxisAlignedBox & box, const
 }
 
 
-World::World(const std::string & name, Ogre::SceneManager* sceneManager):
+World::World(const std::string & name, Ogre::SceneManager* sceneManager, std::shared_ptr<TerrainTileSource> tiles):
     mName(name), mSceneManager(sceneManager)
 {
+    mWorkerPool = std::make_unique<WorkerPool>();
 
-    std::shared_ptr<Ogre::Image> heightMapImage = std::make_shared<Ogre::Image>();
-    heightMapImage->load("terrain.jpg", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    if (nullptr != tiles.get())
+    {
+        mPager = std::make_unique<TerrainPager>(mSceneManager, mSceneManager->getRootSceneNode(), tiles, PAGED_VERTEX_STEP, PAGED_VIEW_DISTANCE, PAGED_MEMORY_BUDGET);
+
+        //trees grow on the same part of the heights range as on the fixed ground
+        const float half = PAGED_FOREST_SIZE / 2.0f;
+        Ogre::AxisAlignedBox borders(-half, tiles->GetMaxHeight() / 8.0f, -half, half, tiles->GetMaxHeight() / 4.0f, half);
+        mForest = std::make_unique<EternalForest>(mSceneManager, this, nullptr, borders);
+        //forest cells follow the resident terrain
+        mPager->SetTileListener([this](float minX, float minZ, float maxX, float maxZ)
+        {
+            mForest->RefreshArea(minX, minZ, maxX, maxZ);
+        });
+        return;
+    }
 
     mGround = std::make_unique<Ground>("Ground", mSceneManager);
-    mGround->LoadFromHeightMap(heightMapImage, mSceneManager->getRootSceneNode());
+    mGround->SetMeshCachePath(GROUND_MESH_CACHE_NAME);
 
+    //converted heights are mapped without decoding, the image is the fallback
+    Ogre::Timer timer;
+    std::shared_ptr<HeightFile> heightFile;
+    std::string heightFilePath = FindResourceFile(HEIGHT_FILE_NAME);
+    if (!heightFilePath.empty())
+    {
+        heightFile = std::make_shared<HeightFile>();
+        if (!heightFile->Open(heightFilePath))
+        {
+            Ogre::LogManager::getSingleton().logMessage("World: " + heightFilePath + " has a wrong format, using the height map image");
+            heightFile.reset();
+        }
+    }
+    if (nullptr != heightFile.get())
+    {
+        Ogre::LogManager::getSingleton().logMessage("World: startup height file map " + std::to_string(timer.getMilliseconds()) + " ms");
+        mGround->LoadFromHeightFile(heightFile, mSceneManager->getRootSceneNode(), mWorkerPool.get());
+    }
+    else
+    {
+        std::shared_ptr<Ogre::Image> heightMapImage = std::make_shared<Ogre::Image>();
+        heightMapImage->load(HEIGHT_MAP_NAME, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::LogManager::getSingleton().logMessage("World: startup image decode " + std::to_string(timer.getMilliseconds()) + " ms");
+        mGround->LoadFromHeightMap(heightMapImage, mSceneManager->getRootSceneNode(), mWorkerPool.get());
+    }
+    SetupGround(true);
+}
+//-------------------------------------------------------
+World::World(const std::string & name, Ogre::SceneManager* sceneManager, std::shared_ptr<Ogre::Image> heightMap, bool heightsOnly):
+    mName(name), mSceneManager(sceneManager)
+{
+    OgreAssert(nullptr != heightMap.get(), "World: height map is null");
+    mWorkerPool = std::make_unique<WorkerPool>();
+
+    mGround = std::make_unique<Ground>("Ground", mSceneManager);
+    if (heightsOnly)
+    {
+        mGround->LoadHeightsFromHeightMap(heightMap, mSceneManager->getRootSceneNode(), mWorkerPool.get());
+    }
+    else
+    {
+        mGround->LoadFromHeightMap(heightMap, mSceneManager->getRootSceneNode(), mWorkerPool.get());
+    }
+    SetupGround(!heightsOnly);
+}
+//-------------------------------------------------------
+void World::SetupGround(bool createForest)
+{
     Ogre::Vector3 groundScale = Ogre::Vector3(0.27f, 0.27f, 1.0f);
     Ogre::Quaternion groundOrientation;
     groundOrientation.FromAngleAxis(Ogre::Radian(Ogre::Degree(-90)), Ogre::Vector3::UNIT_X);
@@ -56,13 +165,28 @@ World::World(const std::string & name, Ogre::SceneManager* sceneManager):
     mGroundNode = mGround->GetNode();
     mGroundNode->setScale(groundScale);
     mGroundNode->setOrientation(groundOrientation);
+    UpdateGroundTransform();
 
+    if (!createForest)
+    {
+        return;
+    }
     Ogre::AxisAlignedBox bounds = mGround->GetLocalSpaceBounds();
     bounds.setMinimumZ(1.0f);
     bounds.setMaximumZ(2.0f);
     mForest = std::make_unique<EternalForest>(mSceneManager, this, mGround.get(), TransformBox(bounds, Ogre::Vector3::ZERO, groundScale, groundOrientation));
 }
 //-------------------------------------------------------
+void World::UpdateGroundTransform()
+{
+    mGroundWorldMat.makeTransform(mGroundNode->getPosition(), mGroundNode->getScale(), mGroundNode->getOrientation());
+    mGroundInvWorldMat.makeInverseTransform(mGroundNode->getPosition(), mGroundNode->getScale(), mGroundNode->getOrientation());
+    mGroundInvWorldMatNoTrans.makeInverseTransform(Ogre::Vector3::ZERO, mGroundNode->getScale(), mGroundNode->getOrientation());
+
+    Ogre::Vector3 localDown = mGroundInvWorldMatNoTrans.transformAffine(Ogre::Vector3::NEGATIVE_UNIT_Y).normalisedCopy();
+    mGroundIsLevel = localDown.positionEquals(Ogre::Vector3::NEGATIVE_UNIT_Z, 1e-5f);
+}
+//-------------------------------------------------------
 World::~World()
 {
     //empty
@@ -70,40 +194,229 @@ World::~World()
 //-------------------------------------------------------
 std::tuple<bool, Ogre::Vector3, Ogre::Entity*> World::GetIntersection(const Ogre::Ray & ray) const
 {
-    //transform world space to local space
-    Ogre::Matrix4 groundInvWorldMat;
-    groundInvWorldMat.makeInverseTransform(mGroundNode->getPosition(), mGroundNode->getScale(), mGroundNode->getOrientation());
-    Ogre::Matrix4 groundInvWorldMatNoTrans;
-    groundInvWorldMatNoTrans.makeInverseTransform(Ogre::Vector3::ZERO, mGroundNode->getScale(), mGroundNode->getOrientation());
+    PROFILE_ZONE("Ray cast");
+    if (nullptr != mPager.get())
+    {
+        auto hit = mPager->GetIntersection(ray);
+        return std::make_tuple(hit.first, hit.second, nullptr);
+    }
 
+    //transform world space to local space
     Ogre::Ray localSpaceRay;
-    localSpaceRay.setOrigin(groundInvWorldMat.transformAffine(ray.getOrigin()));
-    localSpaceRay.setDirection(groundInvWorldMatNoTrans.transformAffine(ray.getDirection()).normalisedCopy());
+    localSpaceRay.setOrigin(mGroundInvWorldMat.transformAffine(ray.getOrigin()));
+    localSpaceRay.setDirection(mGroundInvWorldMatNoTrans.transformAffine(ray.getDirection()).normalisedCopy());
 
     auto hit = mGround->GetIntersectionLocalSpace(localSpaceRay);
     if (hit.first)
     {
-        Ogre::Matrix4 groundWorldMat;
-        groundWorldMat.makeTransform(mGroundNode->getPosition(), mGroundNode->getScale(), mGroundNode->getOrientation());
-
-        return std::make_tuple(true, groundWorldMat.transformAffine(hit.second), nullptr);
+        return std::make_tuple(true, mGroundWorldMat.transformAffine(hit.second), nullptr);
     }
     return std::make_tuple(false, Ogre::Vector3::ZERO, nullptr);
 }
 //-------------------------------------------------------
+void World::GetIntersections(const Ogre::Ray* rays, size_t count, std::tuple<bool, Ogre::Vector3, Ogre::Entity*>* results, WorkerPool* pool) const
+{
+    PROFILE_ZONE("Ray casts batch");
+    if (nullptr != mPager.get())
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            results[i] = GetIntersection(rays[i]);
+        }
+        return;
+    }
+
+    auto processChunk = [&](size_t chunk)
+    {
+        float origins[3 * RAYS_CHUNK_SIZE];
+        float directions[3 * RAYS_CHUNK_SIZE];
+        float hits[RAYS_CHUNK_SIZE];
+        const size_t first = chunk * RAYS_CHUNK_SIZE;
+        const size_t size = std::min(RAYS_CHUNK_SIZE, count - first);
+        for (size_t i = 0; i < size; ++i)
+        {
+            Ogre::Vector3 origin = mGroundInvWorldMat.transformAffine(rays[first + i].getOrigin());
+            Ogre::Vector3 direction = mGroundInvWorldMatNoTrans.transformAffine(rays[first + i].getDirection()).normalisedCopy();
+            std::copy(origin.ptr(), origin.ptr() + 3, origins + 3 * i);
+            std::copy(direction.ptr(), direction.ptr() + 3, directions + 3 * i);
+        }
+        mGround->GetHeightfield().IntersectRays(origins, directions, size, hits);
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (hits[i] >= 0.0f)
+            {
+                Ogre::Vector3 local(origins[3 * i] + hits[i] * directions[3 * i], origins[3 * i + 1] + hits[i] * directions[3 * i + 1], origins[3 * i + 2] + hits[i] * directions[3 * i + 2]);
+                results[first + i] = std::make_tuple(true, mGroundWorldMat.transformAffine(local), nullptr);
+            }
+            else
+            {
+                results[first + i] = std::make_tuple(false, Ogre::Vector3::ZERO, nullptr);
+            }
+        }
+    };
+
+    const size_t chunks = (count + RAYS_CHUNK_SIZE - 1) / RAYS_CHUNK_SIZE;
+    if (nullptr != pool && chunks > 1)
+    {
+        pool->ParallelFor(chunks, processChunk);
+    }
+    else
+    {
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            processChunk(chunk);
+        }
+    }
+}
+//-------------------------------------------------------
 void World::Update(float time)
 {
+    if (nullptr != mPager.get())
+    {
+        mPager->Update(mObserverPosition);
+    }
     if (nullptr != mForest.get())
     {
         mForest->Update(time);
     }
 }
 //-------------------------------------------------------
+void World::SetObserverPosition(const Ogre::Vector3 & position)
+{
+    mObserverPosition = position;
+    if (nullptr != mForest.get())
+    {
+        mForest->SetFocus(position);
+    }
+}
+//-------------------------------------------------------
+void World::UpdateGroundLod(const Ogre::Camera* camera, float viewportHeight)
+{
+    if (nullptr != mGround.get())
+    {
+        mGround->UpdateLod(camera, viewportHeight);
+    }
+}
+//-------------------------------------------------------
 float World::GetGroundHeightAt(float x, float z) const
 {
+    if (nullptr != mPager.get())
+    {
+        auto h = mPager->GetHeightAt(x, z);
+        return h.first ? h.second : std::numeric_limits<float>::infinity();
+    }
+
+    if (mGroundIsLevel)
+    {
+        Ogre::Vector3 local = mGroundInvWorldMat.transformAffine(Ogre::Vector3(x, 0.0f, z));
+        auto h = mGround->GetHeightLocalSpace(local[0], local[1]);
+        if (!h.first)
+        {
+            return std::numeric_limits<float>::infinity();
+        }
+        return mGroundWorldMat.transformAffine(Ogre::Vector3(local[0], local[1], h.second))[1];
+    }
+
     Ogre::Ray ray;
     ray.setOrigin(Ogre::Vector3(x, 1000.0f, z));
     ray.setDirection(Ogre::Vector3(0.0f, -1.0f, 0.0f));
     auto hit = GetIntersection(ray);
     return std::get<0>(hit) ? std::get<1>(hit)[1] : std::numeric_limits<float>::infinity();
-}
\ No newline at end of file
+}
+//-------------------------------------------------------
+void World::GetGroundHeightsAt(const float* xs, const float* zs, float* heights, size_t count, WorkerPool* pool) const
+{
+    PROFILE_ZONE("Ground heights batch");
+    if (!mGroundIsLevel)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            heights[i] = GetGroundHeightAt(xs[i], zs[i]);
+        }
+        return;
+    }
+
+    //level ground: local (x, y) and world height are affine functions of world (x, z) and local height
+    const Ogre::Matrix4 & inv = mGroundInvWorldMat;
+    const Ogre::Matrix4 & mat = mGroundWorldMat;
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    auto processChunk = [&](size_t chunk)
+    {
+        float localX[HEIGHTS_CHUNK_SIZE];
+        float localY[HEIGHTS_CHUNK_SIZE];
+        const size_t first = chunk * HEIGHTS_CHUNK_SIZE;
+        const size_t size = std::min(HEIGHTS_CHUNK_SIZE, count - first);
+        for (size_t i = 0; i < size; ++i)
+        {
+            localX[i] = inv[0][0] * xs[first + i] + inv[0][2] * zs[first + i] + inv[0][3];
+            localY[i] = inv[1][0] * xs[first + i] + inv[1][2] * zs[first + i] + inv[1][3];
+        }
+        float* out = heights + first;
+        mGround->GetHeightsLocalSpace(localX, localY, out, size, infinity);
+        for (size_t i = 0; i < size; ++i)
+        {
+            out[i] = (infinity != out[i]) ? mat[1][0] * localX[i] + mat[1][1] * localY[i] + mat[1][2] * out[i] + mat[1][3] : infinity;
+        }
+    };
+
+    const size_t chunks = (count + HEIGHTS_CHUNK_SIZE - 1) / HEIGHTS_CHUNK_SIZE;
+    if (nullptr != pool && chunks > 1)
+    {
+        pool->ParallelFor(chunks, processChunk);
+    }
+    else
+    {
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            processChunk(chunk);
+        }
+    }
+}
+//-------------------------------------------------------
+void World::GetGroundHeightsOnGrid(float x0, float z0, float dx, float dz, size_t countX, size_t countZ, float* heights, WorkerPool* pool) const
+{
+    PROFILE_ZONE("Ground heights grid");
+    if (!mGroundIsLevel)
+    {
+        for (size_t j = 0; j < countZ; ++j)
+        {
+            for (size_t i = 0; i < countX; ++i)
+            {
+                heights[j * countX + i] = GetGroundHeightAt(x0 + i * dx, z0 + j * dz);
+            }
+        }
+        return;
+    }
+
+    //every grid row is a line in the ground local space
+    const Ogre::Vector3 localStep = mGroundInvWorldMatNoTrans.transformAffine(Ogre::Vector3(dx, 0.0f, 0.0f));
+    const Ogre::Matrix4 & mat = mGroundWorldMat;
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    auto processRow = [&](size_t j)
+    {
+        const Ogre::Vector3 localStart = mGroundInvWorldMat.transformAffine(Ogre::Vector3(x0, 0.0f, z0 + j * dz));
+        float* out = heights + j * countX;
+        mGround->GetHeightfield().SampleLine(localStart[0], localStart[1], localStep[0], localStep[1], countX, out, infinity);
+
+        const float rowBase = mat[1][0] * localStart[0] + mat[1][1] * localStart[1] + mat[1][3];
+        const float rowStep = mat[1][0] * localStep[0] + mat[1][1] * localStep[1];
+        for (size_t i = 0; i < countX; ++i)
+        {
+            out[i] = (infinity != out[i]) ? rowBase + i * rowStep + mat[1][2] * out[i] : infinity;
+        }
+    };
+
+    if (nullptr != pool && countZ > 1)
+    {
+        pool->ParallelFor(countZ, processRow);
+    }
+    else
+    {
+        for (size_t j = 0; j < countZ; ++j)
+        {
+            processRow(j);
+        }
+    }
+}
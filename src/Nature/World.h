@@ -16,6 +16,7 @@
 #include <OgrePrerequisites.h>
 #include <OgreVector3.h>
 #include <OgreRay.h>
+#include <OgreMatrix4.h>
 
 namespace Ogre
 {
@@ -26,6 +27,9 @@ namespace Ogre
 
 class Ground;
 class EternalForest;
+class WorkerPool;
+class TerrainPager;
+class TerrainTileSource;
 
 class World
 {
@@ -34,23 +38,67 @@ class World
     Ogre::SceneManager* mSceneManager;
 
     std::unique_ptr<Ground> mGround;
-    Ogre::SceneNode* mGroundNode;
+    Ogre::SceneNode* mGroundNode = nullptr;
+
+    //paged terrain replaces the ground
+    std::unique_ptr<TerrainPager> mPager;
+    Ogre::Vector3 mObserverPosition = Ogre::Vector3::ZERO;
+
+    //cached ground transforms
+    Ogre::Matrix4 mGroundWorldMat;
+    Ogre::Matrix4 mGroundInvWorldMat;
+    Ogre::Matrix4 mGroundInvWorldMatNoTrans;
+    //world space down direction is the local -Z
+    bool mGroundIsLevel = false;
 
     std::unique_ptr<EternalForest> mForest;
 
+    std::unique_ptr<WorkerPool> mWorkerPool;
+
     //-------------------------------------------------------
 
     World(const World&) = delete;
     World& operator=(const World&) = delete;
     //-------------------------------------------------------
 
+    /**
+     *	Recompute cached transforms after the ground node was moved
+     */
+    void UpdateGroundTransform();
+
+    /**
+     *	Place the loaded ground into the world
+     *  @param createForest - the forest needs the ground meshes to be loaded
+     */
+    void SetupGround(bool createForest);
+
 public:
-    World(const std::string & name, Ogre::SceneManager* sceneManager);
+    /**
+     *	Create world
+     *  @param tiles - optional source of the paged terrain, the fixed ground from terrain.jpg is used if it is null
+     */
+    World(const std::string & name, Ogre::SceneManager* sceneManager, std::shared_ptr<TerrainTileSource> tiles = nullptr);
+    /**
+     *	Create world with the fixed ground from a height map
+     *  @param heightsOnly - load only the ground heights for the queries, without meshes and forest, no render system is needed then
+     */
+    World(const std::string & name, Ogre::SceneManager* sceneManager, std::shared_ptr<Ogre::Image> heightMap, bool heightsOnly);
     ~World();
     /**
      *	Update world's state
      */
     void Update(float time);
+
+    /**
+     *	Set position of the viewer, simulation prefers to spend its budget near it
+     */
+    void SetObserverPosition(const Ogre::Vector3 & position);
+
+    /**
+     *	Choose ground levels of detail for a camera, has to be called every frame
+     *  @param viewportHeight - height of the camera viewport in pixels
+     */
+    void UpdateGroundLod(const Ogre::Camera* camera, float viewportHeight);
     /**
      *	Find intersection with a ray
      *  @param ray - a ray in world space
@@ -58,10 +106,67 @@ public:
      */
     std::tuple<bool, Ogre::Vector3, Ogre::Entity*> GetIntersection(const Ogre::Ray & ray) const;
 
+    /**
+     *	Batch version of GetIntersection, rays are transformed to the ground space once and traced by packets
+     *  @param rays - rays in world space, neighbouring rays should be close to each other for the best speed
+     *  @param results - output array of count elements
+     *  @param pool - optional threads to split large batches
+     */
+    void GetIntersections(const Ogre::Ray* rays, size_t count, std::tuple<bool, Ogre::Vector3, Ogre::Entity*>* results, WorkerPool* pool = nullptr) const;
+
     /**
      *	Ground is supposed to be parallel to the XZ plane
      */
     float GetGroundHeightAt(float x, float z) const;
+
+    /**
+     *	Batch version of GetGroundHeightAt
+     *  @param xs, zs - world space coordinates of the points
+     *  @param heights - output, infinity for points outside of the ground
+     *  @param pool - optional threads to split large batches
+     */
+    void GetGroundHeightsAt(const float* xs, const float* zs, float* heights, size_t count, WorkerPool* pool = nullptr) const;
+
+    /**
+     *	Heights at the points (x0 + i * dx, z0 + j * dz), i from [0, countX), j from [0, countZ)
+     *  @param heights - output of countX * countZ values, row by row along X, infinity for points outside of the ground
+     *  @param pool - optional threads to split rows
+     */
+    void GetGroundHeightsOnGrid(float x0, float z0, float dx, float dz, size_t countX, size_t countZ, float* heights, WorkerPool* pool = nullptr) const;
+
+    /**
+     *	Fixed ground, nullptr for the paged terrain
+     */
+    const Ground* GetGround() const
+    {
+        return mGround.get();
+    }
+
+    /**
+     *	Paged terrain, nullptr for the fixed ground
+     */
+    const TerrainPager* GetTerrainPager() const
+    {
+        return mPager.get();
+    }
+
+    const EternalForest* GetForest() const
+    {
+        return mForest.get();
+    }
+
+    EternalForest* GetForest()
+    {
+        return mForest.get();
+    }
+
+    /**
+     *	Threads shared by the world's subsystems
+     */
+    WorkerPool* GetWorkerPool() const
+    {
+        return mWorkerPool.get();
+    }
 };
 
 
@@ -0,0 +1,88 @@
+/**
+* @file HeightConvert.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+//Converts a height map image to the memory mapped heights file.
+//Usage: HeightConvert <image> <output.hf> [uint16|float] [tile size]
+//Heights are the red channel in [0, 1], the same values the ground reads from the image.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <OgreRoot.h>
+#include <OgreImage.h>
+#include <OgreDataStream.h>
+#include <OgreColourValue.h>
+
+#include "../src/Nature/HeightFile.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::printf("Usage: HeightConvert <image> <output.hf> [uint16|float] [tile size]\n");
+        return 1;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+    HeightFile::SampleType type = HeightFile::SAMPLE_UINT16;
+    if (argc > 3 && 0 == std::strcmp(argv[3], "float"))
+    {
+        type = HeightFile::SAMPLE_FLOAT;
+    }
+    size_t tileSize = (argc > 4) ? static_cast<size_t>(std::atoi(argv[4])) : 64;
+    if (0 == tileSize)
+    {
+        std::printf("Wrong tile size\n");
+        return 1;
+    }
+
+    //root registers the image codecs
+    Ogre::Root root("", "", "HeightConvert.log");
+
+    std::size_t dot = input.find_last_of('.');
+    if (std::string::npos == dot)
+    {
+        std::printf("Unknown image format: %s\n", input.c_str());
+        return 1;
+    }
+    std::ifstream* file = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(input.c_str(), std::ios::in | std::ios::binary);
+    if (!file->is_open())
+    {
+        OGRE_DELETE_T(file, basic_ifstream, Ogre::MEMCATEGORY_GENERAL);
+        std::printf("Can't open %s\n", input.c_str());
+        return 1;
+    }
+    Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(input, file, true));
+    Ogre::Image image;
+    image.load(stream, input.substr(dot + 1));
+
+    const size_t width = image.getWidth();
+    const size_t height = image.getHeight();
+    std::vector<float> heights(width * height);
+    for (size_t y = 0; y < height; ++y)
+    {
+        for (size_t x = 0; x < width; ++x)
+        {
+            heights[y * width + x] = image.getColourAt(x, y, 0)[0];
+        }
+    }
+
+    if (!HeightFile::Write(output, heights.data(), width, height, tileSize, type))
+    {
+        std::printf("Can't write %s\n", output.c_str());
+        return 1;
+    }
+    std::printf("%s: %zux%zu %s samples, %zu tile\n", output.c_str(), width, height, (HeightFile::SAMPLE_UINT16 == type) ? "uint16" : "float", tileSize);
+    return 0;
+}